@@ -0,0 +1,864 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "lz.h"
+#include "hist.h"
+#include "presence.h"
+#include "shm.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// Gerador de carga: simula vários usuários conectados ao servidor, que enviam
+// mensagens públicas e privadas a uma taxa fixa, e reporta a vazão e os
+// percentis da latência de entrega de ponta a ponta. O instante em que cada
+// mensagem deveria ser enviada é incluído no seu conteúdo, e a latência é
+// medida a partir dele (e não do envio real) para que atrasos do próprio
+// gerador não escondam a latência do servidor.
+
+// Valores padrão das opções.
+#define DEFAULT_USERS 10
+#define DEFAULT_RATE 10
+#define DEFAULT_SECONDS 5
+#define DEFAULT_MIN_SIZE 32
+#define DEFAULT_MAX_SIZE 256
+#define DEFAULT_WORKERS 2
+
+// Número máximo de quadros decodificados em cada lote.
+#define FRAME_BATCH_SIZE 64
+
+// Tamanho mínimo do conteúdo das mensagens, que precisa comportar o timestamp.
+#define MIN_SIZE 24
+
+// Tempo, em milissegundos, que o gerador aguarda as últimas entregas após
+// parar de enviar mensagens, e tempo máximo de espera pela saída dos usuários.
+#define DRAIN_MS 1000
+#define LEAVE_MS 5000
+
+// Fases da execução. Os usuários enviam mensagens apenas na fase PHASE_RUN, e
+// saem do grupo na fase PHASE_LEAVE.
+#define PHASE_RUN 0
+#define PHASE_DRAIN 1
+#define PHASE_LEAVE 2
+
+// Marca, no "data" do epoll, o eventfd da memória compartilhada de um usuário.
+#define EPOLL_TAG_SHM 1
+
+// Usuário simulado.
+typedef struct bot_t {
+  // Socket da conexão com o servidor.
+  int sock;
+
+  // ID do usuário.
+  int id;
+
+  // Indica se as mensagens são trocadas no formato binário.
+  int binary;
+
+  // Indica se as mensagens longas são compactadas.
+  int compress;
+
+  // Indica que o servidor fechou a conexão.
+  int done;
+
+  // Leitor de quadros da conexão.
+  frame_reader_t reader;
+
+  // Anéis de memória compartilhada, usados no lugar do socket caso aceitos
+  // pelo servidor.
+  shm_link_t shm;
+} bot_t;
+
+// Thread que controla um subconjunto dos usuários, enviando suas mensagens e
+// recebendo as mensagens destinadas a eles.
+typedef struct worker_t {
+  pthread_t thread;
+
+  // Usuários da thread: as posições "first", "first + step", ... de "bots".
+  int first;
+  int step;
+
+  // Semente do gerador de números aleatórios da thread.
+  unsigned int seed;
+
+  // Latências de entrega, em nanossegundos.
+  hist_t latency;
+
+  // Contadores de mensagens enviadas, entregues, confirmações e erros. As
+  // mensagens recusadas pelos limites de taxa do servidor são contadas à parte.
+  uint64_t sent;
+  uint64_t delivered;
+  uint64_t acks;
+  uint64_t errors;
+  uint64_t throttled;
+
+  // Número de usuários desconectados pelo servidor antes da saída.
+  uint64_t dropped;
+} worker_t;
+
+// Configuração da execução.
+int num_bots = DEFAULT_USERS;
+int rate = DEFAULT_RATE;
+int min_size = DEFAULT_MIN_SIZE;
+int max_size = DEFAULT_MAX_SIZE;
+int private_pct = 0;
+
+// Número de salas. Quando maior que 0, cada usuário entra em uma das salas e
+// suas mensagens públicas são enviadas apenas à sua sala.
+int num_rooms = 0;
+
+// Indica que os usuários solicitam o transporte por memória compartilhada.
+int use_shm = 0;
+
+// Usuários simulados.
+bot_t* bots;
+
+// Fase atual da execução e instante de início, usado como referência dos
+// timestamps.
+atomic_int phase;
+uint64_t start_ns;
+
+// Escreve o quadro "buffer", de tamanho "len", no anel de saída do usuário
+// "bot". Enquanto o anel estiver cheio, a thread aguarda que o servidor libere
+// espaço.
+void bot_send_shm(bot_t* bot, const char* buffer, size_t len) {
+  uint16_t net_len = htons(len);
+  struct iovec iov[2] = {{.iov_base = &net_len, .iov_len = sizeof(uint16_t)},
+                         {.iov_base = (void*)buffer, .iov_len = len}};
+  struct iovec* ptr = iov;
+  int iovcnt = 2;
+  int waited = 0;
+
+  while (1) {
+    ssize_t count = shm_writev(&bot->shm, ptr, iovcnt);
+    if (count < 0) {
+      eprintf("Shared memory ring is corrupted.\n");
+      exit(EXIT_FAILURE);
+    }
+
+    // Avança pelos bytes escritos, que podem ser apenas parte do total
+    while (iovcnt > 0 && (size_t)count >= ptr->iov_len) {
+      count -= ptr->iov_len;
+      ptr++;
+      iovcnt--;
+    }
+    if (iovcnt == 0) {
+      break;
+    }
+    ptr->iov_base = (char*)ptr->iov_base + count;
+    ptr->iov_len -= count;
+
+    // O eventfd também é notificado quando há novas mensagens, e o
+    // encerramento do socket indica que o servidor não vai mais liberar espaço
+    struct pollfd fds[2] = {{.fd = bot->shm.wait_fd, .events = POLLIN},
+                            {.fd = bot->sock, .events = 0}};
+    if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+      log_exit("poll");
+    }
+    if (fds[1].revents & (POLLHUP | POLLERR)) {
+      eprintf("Server closed the connection.\n");
+      exit(EXIT_FAILURE);
+    }
+    shm_ack(&bot->shm);
+    waited = 1;
+  }
+
+  // As notificações consumidas durante a espera podiam indicar novas
+  // mensagens, então a próxima espera da thread não deve bloquear
+  if (waited) {
+    shm_rearm(&bot->shm);
+  }
+}
+
+// Envia a mensagem "msg" pela conexão do usuário "bot".
+void bot_send(bot_t* bot, const msg_view_t* msg) {
+  char buffer[BUFFER_SIZE];
+  int len = !bot->binary   ? encode_view(msg, buffer)
+            : bot->compress ? encode_lz(msg, buffer)
+                            : encode_bin(msg, buffer);
+  if (bot->shm.area != NULL) {
+    bot_send_shm(bot, buffer, len);
+  } else if (send_frame(bot->sock, buffer, len) != 0) {
+    log_exit("send");
+  }
+}
+
+// Envia uma mensagem do usuário "bot", com o timestamp "sched_ns", para todos
+// os usuários ou para um usuário aleatório, de acordo com a proporção de
+// mensagens privadas.
+void bot_send_message(worker_t* worker, bot_t* bot, uint64_t sched_ns) {
+  char content[BUFFER_SIZE];
+  int size = min_size;
+  if (max_size > min_size) {
+    size += rand_r(&worker->seed) % (max_size - min_size + 1);
+  }
+
+  msg_view_t msg = {.id_msg = MSG, .id_sender = bot->id, .id_receiver = NULL_ID};
+  if (num_bots > 1 && rand_r(&worker->seed) % 100 < (unsigned)private_pct) {
+    // O destinatário é qualquer outro usuário
+    int target = rand_r(&worker->seed) % (num_bots - 1);
+    bot_t* receiver = &bots[target >= bot - bots ? target + 1 : target];
+    msg.id_receiver = receiver->id;
+  } else if (num_rooms > 0) {
+    msg.id_msg = ROOM_MSG;
+  }
+
+  // O conteúdo de uma mensagem de sala começa com o nome da sala
+  int len = 0;
+  if (msg.id_msg == ROOM_MSG) {
+    len = sprintf(content, "r%d ", (int)(bot - bots) % num_rooms);
+  }
+  len += sprintf(content + len, "%llu ", (unsigned long long)(sched_ns - start_ns));
+  if (size < len) {
+    size = len;
+  }
+  memset(content + len, 'x', size - len);
+
+  msg.message = content;
+  msg.len = size;
+
+  bot_send(bot, &msg);
+  worker->sent++;
+}
+
+// Trata a mensagem "msg" recebida pelo usuário "bot".
+void bot_handle(worker_t* worker, bot_t* bot, const msg_view_t* msg) {
+  if (msg->id_msg == MSG || msg->id_msg == ROOM_MSG) {
+    // O timestamp de uma mensagem de sala vem após o nome da sala
+    const char* text = msg->message;
+    size_t len = msg->len;
+    if (msg->id_msg == ROOM_MSG) {
+      const char* space = memchr(text, ' ', len);
+      len = space != NULL ? len - (space + 1 - text) : 0;
+      text = space != NULL ? space + 1 : text;
+    }
+
+    // As cópias das próprias mensagens e os avisos de entrada no grupo não
+    // começam com o timestamp
+    if (msg->id_sender == bot->id || len == 0 || text[0] < '0' || text[0] > '9') {
+      return;
+    }
+
+    uint64_t sched_ns = start_ns + strtoull(text, NULL, 10);
+    uint64_t now = now_ns();
+    hist_record(&worker->latency, now > sched_ns ? now - sched_ns : 0);
+    worker->delivered++;
+  } else if (msg->id_msg == HEARTBEAT) {
+    msg_view_t reply = {.id_msg = HEARTBEAT,
+                        .id_sender = bot->id,
+                        .id_receiver = NULL_ID,
+                        .message = "HEARTBEAT",
+                        .len = strlen("HEARTBEAT")};
+    bot_send(bot, &reply);
+  } else if (msg->id_msg == OK) {
+    worker->acks++;
+  } else if (msg->id_msg == ERROR) {
+    if (msg->len == strlen("Rate limit exceeded") &&
+        memcmp(msg->message, "Rate limit exceeded", msg->len) == 0) {
+      worker->throttled++;
+    } else {
+      worker->errors++;
+    }
+  }
+}
+
+// Trata todas as mensagens completas presentes no leitor do usuário "bot".
+void bot_frames(worker_t* worker, bot_t* bot) {
+  frame_view_t frames[FRAME_BATCH_SIZE];
+  char buffer[BUFFER_SIZE];
+
+  // Os quadros são decodificados em lote, sem cópia. Um quadro compactado
+  // interrompe o lote e é descompactado individualmente
+  while (1) {
+    size_t n = frame_reader_batch(&bot->reader, frames, FRAME_BATCH_SIZE, bot->binary);
+    for (size_t i = 0; i < n; i++) {
+      bot_handle(worker, bot, &frames[i].msg);
+    }
+    if (n == FRAME_BATCH_SIZE) {
+      continue;
+    }
+
+    char* frame;
+    size_t len;
+    int ret = frame_reader_next(&bot->reader, &frame, &len);
+    if (ret == 0) {
+      return;
+    }
+
+    msg_view_t msg;
+    if (ret < 0 || !bot->compress || !is_compressed_msg(frame, len) ||
+        lz_inflate_msg(frame, len, buffer, &len) == 0 || decode_bin(&msg, buffer, len) == 0) {
+      parse_error();
+    }
+    bot_handle(worker, bot, &msg);
+  }
+}
+
+// Lê e trata todas as mensagens disponíveis na conexão do usuário "bot".
+// Retorna 0 caso o servidor tenha fechado a conexão e 1 caso contrário.
+int bot_recv(worker_t* worker, bot_t* bot) {
+  while (1) {
+    ssize_t count = frame_reader_fill(&bot->reader, bot->sock, MSG_DONTWAIT);
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return 1;
+    } else if (count <= 0) {
+      return 0;
+    }
+
+    bot_frames(worker, bot);
+  }
+}
+
+// Copia para o leitor do usuário "bot" os bytes disponíveis no seu anel de
+// entrada. Retorna o número de bytes copiados.
+size_t bot_fill_shm(bot_t* bot) {
+  const char* data;
+  ssize_t available = shm_peek(&bot->shm, &data);
+  if (available < 0) {
+    eprintf("Shared memory ring is corrupted.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t count = frame_reader_append(&bot->reader, data, available);
+  if (available > 0 && count == 0) {
+    parse_error();
+  }
+  shm_consume(&bot->shm, count);
+  return count;
+}
+
+// Lê e trata todas as mensagens disponíveis no anel de entrada do usuário
+// "bot", até que ele fique vazio.
+void bot_recv_shm(worker_t* worker, bot_t* bot) {
+  shm_ack(&bot->shm);
+  while (bot_fill_shm(bot) > 0 || !shm_idle(&bot->shm)) {
+    bot_frames(worker, bot);
+  }
+}
+
+// Envia a mensagem REQ_REM do usuário "bot".
+void bot_leave(bot_t* bot) {
+  msg_view_t msg = {.id_msg = REQ_REM,
+                    .id_sender = bot->id,
+                    .id_receiver = NULL_ID,
+                    .message = "REQ_REM",
+                    .len = strlen("REQ_REM")};
+  bot_send(bot, &msg);
+}
+
+// Função executada por cada thread do gerador. As mensagens dos usuários da
+// thread são enviadas em intervalos regulares, e a espera por novas mensagens
+// dura no máximo até o próximo envio.
+void* worker_thread(void* args) {
+  worker_t* worker = (worker_t*)args;
+
+  int epoll_fd = epoll_create1(0);
+  if (epoll_fd == -1) {
+    log_exit("epoll_create1");
+  }
+
+  int count = 0;
+  for (int i = worker->first; i < num_bots; i += worker->step) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &bots[i]};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, bots[i].sock, &ev) != 0) {
+      log_exit("epoll_ctl");
+    }
+
+    // Com memória compartilhada, as mensagens chegam pelo anel, e o socket só
+    // indica o encerramento da conexão
+    if (bots[i].shm.area != NULL) {
+      ev.data.u64 = (uintptr_t)&bots[i] | EPOLL_TAG_SHM;
+      if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, bots[i].shm.wait_fd, &ev) != 0) {
+        log_exit("epoll_ctl");
+      }
+    }
+    count++;
+  }
+
+  // Intervalo entre dois envios da thread, considerando todos os seus usuários
+  uint64_t interval = count > 0 ? 1000000000ULL / ((uint64_t)rate * count) : 0;
+  uint64_t next = start_ns;
+  int next_bot = worker->first;
+
+  int left = 0;
+  int open = count;
+  uint64_t leave_deadline = 0;
+  struct epoll_event events[64];
+
+  while (open > 0) {
+    uint64_t now = now_ns();
+    int current = atomic_load(&phase);
+    // A espera tem precisão de nanossegundos, já que o intervalo entre envios
+    // pode ser menor que 1 ms
+    uint64_t timeout = 100000000;
+
+    if (current == PHASE_RUN && count > 0 && rate > 0) {
+      // Envia as mensagens cujo instante já passou, inclusive as atrasadas
+      while (next <= now) {
+        if (!bots[next_bot].done) {
+          bot_send_message(worker, &bots[next_bot], next);
+        }
+        next += interval;
+        next_bot += worker->step;
+        if (next_bot >= num_bots) {
+          next_bot = worker->first;
+        }
+      }
+      timeout = next - now;
+    } else if (current == PHASE_LEAVE) {
+      if (!left) {
+        for (int i = worker->first; i < num_bots; i += worker->step) {
+          if (!bots[i].done) {
+            bot_leave(&bots[i]);
+          }
+        }
+        left = 1;
+        leave_deadline = now + (uint64_t)LEAVE_MS * 1000000;
+      } else if (now > leave_deadline) {
+        break;
+      }
+    }
+
+    struct timespec ts = {.tv_sec = timeout / 1000000000, .tv_nsec = timeout % 1000000000};
+    int n = epoll_pwait2(epoll_fd, events, 64, &ts, NULL);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      log_exit("epoll_pwait2");
+    }
+
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.u64 & EPOLL_TAG_SHM) {
+        bot_t* bot = (bot_t*)(uintptr_t)(events[i].data.u64 & ~(uint64_t)EPOLL_TAG_SHM);
+        if (!bot->done) {
+          bot_recv_shm(worker, bot);
+        }
+        continue;
+      }
+
+      bot_t* bot = (bot_t*)events[i].data.ptr;
+      if (bot->done) {
+        continue;
+      }
+      if (bot_recv(worker, bot) == 0) {
+        // Antes da saída, o fechamento indica que o servidor desconectou o
+        // usuário, por exemplo por ele ser lento
+        if (!left) {
+          worker->dropped++;
+        }
+        bot->done = 1;
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, bot->sock, NULL);
+        if (bot->shm.area != NULL) {
+          epoll_ctl(epoll_fd, EPOLL_CTL_DEL, bot->shm.wait_fd, NULL);
+        }
+        open--;
+      }
+    }
+  }
+
+  close(epoll_fd);
+  pthread_exit(NULL);
+}
+
+// Envia, no socket UNIX "sock", o quadro "buffer", de tamanho "len", junto com
+// os "num_fds" file descriptors de "fds". Retorna 0 em caso de sucesso e -1
+// caso contrário.
+int send_frame_fds(int sock, const char* buffer, size_t len, const int* fds, int num_fds) {
+  union {
+    char buf[CMSG_SPACE(SHM_NUM_FDS * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  uint16_t net_len = htons(len);
+  struct iovec iov[2] = {{.iov_base = &net_len, .iov_len = sizeof(uint16_t)},
+                         {.iov_base = (void*)buffer, .iov_len = len}};
+  struct msghdr hdr = {.msg_iov = iov,
+                       .msg_iovlen = 2,
+                       .msg_control = control.buf,
+                       .msg_controllen = CMSG_SPACE(num_fds * sizeof(int))};
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(num_fds * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, num_fds * sizeof(int));
+
+  // Os file descriptors acompanham os primeiros bytes enviados, e o restante
+  // do quadro é enviado sem eles
+  while (hdr.msg_iovlen > 0) {
+    ssize_t count = sendmsg(sock, &hdr, 0);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count <= 0) {
+      return -1;
+    }
+    hdr.msg_control = NULL;
+    hdr.msg_controllen = 0;
+
+    // Avança pelos bytes enviados, que podem ser apenas parte do total
+    while (hdr.msg_iovlen > 0 && (size_t)count >= hdr.msg_iov->iov_len) {
+      count -= hdr.msg_iov->iov_len;
+      hdr.msg_iov++;
+      hdr.msg_iovlen--;
+    }
+    if (hdr.msg_iovlen > 0) {
+      hdr.msg_iov->iov_base = (char*)hdr.msg_iov->iov_base + count;
+      hdr.msg_iov->iov_len -= count;
+    }
+  }
+
+  return 0;
+}
+
+// Aguarda a resposta ao REQ_ADD do usuário "bot", que solicitou a memória
+// compartilhada. A resposta chega pelo anel caso o servidor tenha aceitado o
+// transporte, e pelo socket caso contrário, quando os anéis são liberados.
+void bot_wait_shm(bot_t* bot) {
+  while (1) {
+    if (bot_fill_shm(bot) > 0) {
+      // Mensagens que chegarem ao anel antes da criação da thread ainda
+      // precisam ser lidas por ela
+      shm_rearm(&bot->shm);
+      return;
+    } else if (!shm_idle(&bot->shm)) {
+      continue;
+    }
+
+    struct pollfd fds[2] = {{.fd = bot->shm.wait_fd, .events = POLLIN},
+                            {.fd = bot->sock, .events = POLLIN}};
+    if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+      log_exit("poll");
+    }
+    if (fds[1].revents != 0) {
+      shm_link_close(&bot->shm);
+      return;
+    }
+    shm_ack(&bot->shm);
+  }
+}
+
+// Conecta o usuário "bot" ao servidor no endereço "storage", de tamanho
+// "addrlen", e faz a sua entrada no grupo, solicitando o formato "format".
+void bot_join(bot_t* bot, const struct sockaddr_storage* storage, socklen_t addrlen,
+              int format) {
+  bot->sock = socket(storage->ss_family, SOCK_STREAM, 0);
+  if (bot->sock == -1) {
+    log_exit("socket");
+  }
+
+  if (connect(bot->sock, (const struct sockaddr*)storage, addrlen) != 0) {
+    log_exit("connect");
+  }
+
+  // Cada mensagem é enviada imediatamente, sem aguardar o agrupamento com as
+  // seguintes
+  int enable = 1;
+  if (storage->ss_family != AF_UNIX &&
+      setsockopt(bot->sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(int)) != 0) {
+    log_exit("setsockopt");
+  }
+
+  frame_reader_init(&bot->reader);
+  bot->done = 0;
+  bot->shm.area = NULL;
+  bot->shm.wait_fd = -1;
+  bot->shm.wake_fd = -1;
+
+  msg_t msg = {.id_msg = REQ_ADD, .id_sender = NULL_ID, .id_receiver = NULL_ID};
+  const char* requests[NUM_FORMATS] = {"REQ_ADD", "REQ_ADD " CAP_BINARY " " CAP_PRESENCE,
+                                       "REQ_ADD " CAP_BINARY " " CAP_LZ " " CAP_PRESENCE};
+  strcpy(msg.message, requests[format]);
+
+  char buffer[BUFFER_SIZE];
+  if (use_shm) {
+    // Os anéis e os eventfds são enviados junto com o REQ_ADD, e as cópias
+    // locais dos file descriptors do servidor são fechadas após o envio
+    int fds[SHM_NUM_FDS];
+    if (shm_link_create(&bot->shm, fds) != 0) {
+      log_exit("shm_link_create");
+    }
+    strcat(msg.message, " " CAP_SHM);
+    encode(&msg, buffer);
+    int ret = send_frame_fds(bot->sock, buffer, strlen(buffer), fds, SHM_NUM_FDS);
+    for (int i = 0; i < SHM_NUM_FDS; i++) {
+      close(fds[i]);
+    }
+    if (ret != 0) {
+      log_exit("sendmsg");
+    }
+    bot_wait_shm(bot);
+  } else {
+    encode(&msg, buffer);
+    if (send_msg(bot->sock, buffer) != 0) {
+      log_exit("send");
+    }
+  }
+
+  // A primeira resposta indica o formato usado pelo servidor e o ID do
+  // usuário. As demais mensagens permanecem no leitor
+  char* frame;
+  size_t len;
+  int ret;
+  while ((ret = frame_reader_next(&bot->reader, &frame, &len)) == 0) {
+    if (bot->shm.area != NULL) {
+      bot_wait_shm(bot);
+    } else if (frame_reader_fill(&bot->reader, bot->sock, 0) <= 0) {
+      log_exit("recv");
+    }
+  }
+  if (ret < 0) {
+    parse_error();
+  }
+
+  memcpy(buffer, frame, len);
+  buffer[len] = '\0';
+  bot->binary = is_binary_msg(buffer, len);
+  bot->compress = bot->binary && format == FORMAT_LZ;
+  if (decode_msg(&msg, buffer, len, bot->binary) == 0) {
+    parse_error();
+  }
+
+  if (msg.id_msg != MSG) {
+    eprintf("%s\n", msg.message);
+    exit(EXIT_FAILURE);
+  }
+  bot->id = msg.id_sender;
+
+  // A confirmação da entrada na sala é ignorada pelo tratamento das mensagens
+  if (num_rooms > 0) {
+    char name[ROOM_NAME_SIZE];
+    msg_view_t join = {.id_msg = ROOM_JOIN, .id_sender = bot->id, .id_receiver = NULL_ID};
+    join.message = name;
+    join.len = sprintf(name, "r%d", (int)(bot - bots) % num_rooms);
+    bot_send(bot, &join);
+  }
+}
+
+void usage(const char* bin) {
+  eprintf("Usage: %s [-n users] [-r msgs/s per user] [-d seconds] [-s size|min:max] "
+          "[-P private %%] [-R rooms] [-w threads] [-t|-z] [-S] "
+          "<server IP address> <server port> | <server UNIX socket path>\n",
+          bin);
+  eprintf("  -t uses the text format instead of the binary format\n");
+  eprintf("  -z compresses long messages in the binary format\n");
+  eprintf("  -R spreads the users over rooms, and public messages go to the sender's room\n");
+  eprintf("  -S exchanges messages over shared-memory rings (UNIX socket only)\n");
+  eprintf("Example: %s -n 100 -r 50 -d 10 -s 64:512 -P 20 127.0.0.1 51511\n", bin);
+  eprintf("Example: %s -n 100 -r 50 -S /tmp/chat.sock\n", bin);
+  exit(EXIT_FAILURE);
+}
+
+// Faz o parse do endereço passado como argumento e inicializa um struct do tipo
+// sockaddr_storage de acordo com o protocolo adequado. Um endereço que contém
+// "/" é o caminho de um socket UNIX, e dispensa a porta. Retorna 0 quando há
+// sucesso e -1 caso contrário. Retirado das aulas do professor Ítalo.
+int parse_address(const char* addr_str, const char* port_str,
+                  struct sockaddr_storage* storage) {
+  if (addr_str != NULL && strchr(addr_str, '/') != NULL) {
+    struct sockaddr_un* addr_un = (struct sockaddr_un*)storage;
+    if (port_str != NULL || strlen(addr_str) >= sizeof(addr_un->sun_path)) {
+      return -1;
+    }
+    memset(storage, 0, sizeof(*storage));
+    addr_un->sun_family = AF_UNIX;
+    strcpy(addr_un->sun_path, addr_str);
+    return 0;
+  }
+
+  if (addr_str == NULL || port_str == NULL) {
+    return -1;
+  }
+
+  uint16_t port = (uint16_t)atoi(port_str); // unsigned short
+  if (port == 0) {
+    return -1;
+  }
+  port = htons(port); // host to network short
+
+  memset(storage, 0, sizeof(*storage));
+
+  struct in_addr inaddr4;                       // 32-bit IPv4 address
+  if (inet_pton(AF_INET, addr_str, &inaddr4)) { // presentation to network
+    struct sockaddr_in* addr4 = (struct sockaddr_in*)storage;
+    addr4->sin_family = AF_INET;
+    addr4->sin_port = port;
+    addr4->sin_addr = inaddr4;
+    return 0;
+  }
+
+  struct in6_addr inaddr6;                       // 128-bit IPv6 address
+  if (inet_pton(AF_INET6, addr_str, &inaddr6)) { // presentation to network
+    struct sockaddr_in6* addr6 = (struct sockaddr_in6*)storage;
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = port;
+    memcpy(&(addr6->sin6_addr), &inaddr6, sizeof(inaddr6));
+    return 0;
+  }
+
+  return -1;
+}
+
+// Aguarda "ms" milissegundos.
+void sleep_ms(long ms) {
+  struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000};
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int seconds = DEFAULT_SECONDS;
+  int num_workers = DEFAULT_WORKERS;
+  int format = FORMAT_BINARY;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:d:s:P:R:w:tzS")) != -1) {
+    switch (opt) {
+    case 'n':
+      num_bots = atoi(optarg);
+      break;
+    case 'r':
+      rate = atoi(optarg);
+      break;
+    case 'd':
+      seconds = atoi(optarg);
+      break;
+    case 's':
+      if (sscanf(optarg, "%d:%d", &min_size, &max_size) == 1) {
+        max_size = min_size;
+      }
+      break;
+    case 'P':
+      private_pct = atoi(optarg);
+      break;
+    case 'R':
+      num_rooms = atoi(optarg);
+      break;
+    case 'w':
+      num_workers = atoi(optarg);
+      break;
+    case 't':
+      format = FORMAT_TEXT;
+      break;
+    case 'z':
+      format = FORMAT_LZ;
+      break;
+    case 'S':
+      use_shm = 1;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if (argc - optind < 1 || argc - optind > 2 || num_bots <= 0 || rate < 0 || seconds <= 0 || num_workers <= 0 ||
+      private_pct < 0 || private_pct > 100 || num_rooms < 0 || min_size > max_size) {
+    usage(argv[0]);
+  }
+
+  // O conteúdo precisa comportar o timestamp e caber em uma mensagem no
+  // formato de texto
+  if (min_size < MIN_SIZE) {
+    min_size = MIN_SIZE;
+  }
+  if (max_size > WIRE_MAX_PAYLOAD - 32) {
+    max_size = WIRE_MAX_PAYLOAD - 32;
+  }
+  if (min_size > max_size) {
+    min_size = max_size;
+  }
+  if (num_workers > num_bots) {
+    num_workers = num_bots;
+  }
+
+  struct sockaddr_storage storage;
+  if (parse_address(argv[optind], argv[optind + 1], &storage) != 0 ||
+      (use_shm && storage.ss_family != AF_UNIX)) {
+    usage(argv[0]);
+  }
+  socklen_t addrlen =
+      storage.ss_family == AF_UNIX ? sizeof(struct sockaddr_un) : sizeof(storage);
+
+  // Todos os usuários entram no grupo antes do início dos envios
+  bots = (bot_t*)malloc(num_bots * sizeof(bot_t));
+  if (bots == NULL) {
+    log_exit("malloc");
+  }
+  for (int i = 0; i < num_bots; i++) {
+    bot_join(&bots[i], &storage, addrlen, format);
+  }
+
+  worker_t* workers = (worker_t*)calloc(num_workers, sizeof(worker_t));
+  if (workers == NULL) {
+    log_exit("calloc");
+  }
+
+  atomic_init(&phase, PHASE_RUN);
+  start_ns = now_ns();
+  for (int i = 0; i < num_workers; i++) {
+    workers[i].first = i;
+    workers[i].step = num_workers;
+    workers[i].seed = i + 1;
+    hist_init(&workers[i].latency);
+    pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]);
+  }
+
+  sleep_ms(seconds * 1000L);
+  double elapsed = (now_ns() - start_ns) / 1e9;
+  atomic_store(&phase, PHASE_DRAIN);
+  sleep_ms(DRAIN_MS);
+  atomic_store(&phase, PHASE_LEAVE);
+
+  hist_t latency;
+  hist_init(&latency);
+  uint64_t sent = 0, delivered = 0, acks = 0, errors = 0, throttled = 0, dropped = 0;
+  for (int i = 0; i < num_workers; i++) {
+    pthread_join(workers[i].thread, NULL);
+    hist_merge(&latency, &workers[i].latency);
+    sent += workers[i].sent;
+    delivered += workers[i].delivered;
+    acks += workers[i].acks;
+    errors += workers[i].errors;
+    throttled += workers[i].throttled;
+    dropped += workers[i].dropped;
+  }
+
+  const char* format_name = bots[0].compress ? "binary+lz" : bots[0].binary ? "binary" : "text";
+  const char* transport = bots[0].shm.area != NULL     ? "shm"
+                          : storage.ss_family == AF_UNIX ? "unix"
+                                                         : "tcp";
+  printf("users: %d  threads: %d  format: %s  transport: %s  size: %d-%d  private: %d%%  "
+         "rooms: %d\n",
+         num_bots, num_workers, format_name, transport, min_size, max_size, private_pct,
+         num_rooms);
+  printf("sent: %llu (%.1f msg/s)  delivered: %llu (%.1f msg/s)\n", (unsigned long long)sent,
+         sent / elapsed, (unsigned long long)delivered, delivered / elapsed);
+  printf("acks: %llu  errors: %llu  throttled: %llu  dropped users: %llu\n",
+         (unsigned long long)acks, (unsigned long long)errors, (unsigned long long)throttled,
+         (unsigned long long)dropped);
+  printf("latency (us): mean %.1f  p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+         hist_mean(&latency) / 1e3, hist_percentile(&latency, 50) / 1e3,
+         hist_percentile(&latency, 99) / 1e3, hist_percentile(&latency, 99.9) / 1e3,
+         latency.max / 1e3);
+
+  for (int i = 0; i < num_bots; i++) {
+    close(bots[i].sock);
+    shm_link_close(&bots[i].shm);
+  }
+  free(workers);
+  free(bots);
+
+  exit(EXIT_SUCCESS);
+}
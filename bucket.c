@@ -0,0 +1,28 @@
+#include "bucket.h"
+
+void bucket_init(bucket_t* bucket, double rate, double burst, uint64_t now_ms) {
+  bucket->rate = rate;
+  bucket->burst = burst;
+  bucket->tokens = burst;
+  bucket->last_ms = now_ms;
+}
+
+int bucket_take(bucket_t* bucket, double cost, uint64_t now_ms) {
+  if (bucket->rate == 0) {
+    return 1;
+  }
+
+  if (now_ms > bucket->last_ms) {
+    bucket->tokens += bucket->rate * (now_ms - bucket->last_ms) / 1000;
+    if (bucket->tokens > bucket->burst) {
+      bucket->tokens = bucket->burst;
+    }
+    bucket->last_ms = now_ms;
+  }
+
+  if (bucket->tokens < cost) {
+    return 0;
+  }
+  bucket->tokens -= cost;
+  return 1;
+}
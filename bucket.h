@@ -0,0 +1,26 @@
+#ifndef BUCKET_H
+#define BUCKET_H
+
+#include <stdint.h>
+
+// Balde de fichas: "rate" fichas por segundo são acumuladas, até o limite
+// "burst", e cada operação admitida consome fichas. A taxa 0 indica que não há
+// limite. O balde é acessado por uma única thread, e o tempo é informado pelo
+// chamador em milissegundos, de modo que a verificação não faz chamadas de
+// sistema.
+typedef struct bucket_t {
+  double tokens;
+  double rate;
+  double burst;
+  uint64_t last_ms;
+} bucket_t;
+
+// Inicializa um balde cheio com taxa "rate" e capacidade "burst" no instante
+// "now_ms".
+void bucket_init(bucket_t* bucket, double rate, double burst, uint64_t now_ms);
+
+// Consome "cost" fichas do balde no instante "now_ms". Retorna 1 caso haja
+// fichas suficientes e 0 caso contrário, quando nenhuma ficha é consumida.
+int bucket_take(bucket_t* bucket, double cost, uint64_t now_ms);
+
+#endif
@@ -1,12 +1,16 @@
 #include "common.h"
 #include <arpa/inet.h>
 #include <ctype.h>
+#include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
+#include <unistd.h>
 
 int is_number(const char* str, size_t len) {
   if (!isdigit(str[0]) && (str[0] != '-' || len == 1)) {
@@ -24,7 +28,7 @@ int is_number(const char* str, size_t len) {
 void set_time_str(char* time_str) {
   time_t now = time(NULL);
   struct tm* local_time = localtime(&now);
-  strftime(time_str, sizeof(time_str) + 1, "[%H:%M]", local_time);
+  strftime(time_str, TIME_STR_SIZE, "[%H:%M]", local_time);
 }
 
 int encode(const msg_t* msg, char* outBuf) {
@@ -33,84 +37,287 @@ int encode(const msg_t* msg, char* outBuf) {
 }
 
 int decode(msg_t* msg, char* inBuf) {
-  char* token;
-  char delim[1] = {SEPARATOR};
-
-  // ID da mensagem
-  token = strtok(inBuf, delim);
-  if (token == NULL)
+  msg_view_t view;
+  if (decode_text(&view, inBuf, strlen(inBuf)) == 0)
     return 0;
 
-  // Certifica que o ID da mensagem é um número inteiro válido antes de fazer a
-  // conversão.
-  if (!is_number(token, strlen(token)))
+  msg->id_msg = view.id_msg;
+  msg->id_sender = view.id_sender;
+  msg->id_receiver = view.id_receiver;
+  msg->req_id = 0;
+  // O conteúdo termina no caractere nulo de "inBuf", de modo que ele cabe em
+  // "msg->message" junto com o caractere nulo
+  memcpy(msg->message, view.message, view.len + 1);
+
+  return 1;
+}
+
+int encode_view_header(const msg_view_t* msg, char* outBuf) {
+  return sprintf(outBuf, "%d%c%d%c%d%c", msg->id_msg, SEPARATOR, msg->id_receiver, SEPARATOR,
+                 msg->id_sender, SEPARATOR);
+}
+
+int encode_view(const msg_view_t* msg, char* outBuf) {
+  int len = snprintf(outBuf, BUFFER_SIZE, "%d%c%d%c%d%c%.*s", msg->id_msg, SEPARATOR,
+                     msg->id_receiver, SEPARATOR, msg->id_sender, SEPARATOR, (int)msg->len,
+                     msg->message);
+
+  // snprintf retorna o tamanho que a string teria sem truncamento
+  return len < BUFFER_SIZE ? len : BUFFER_SIZE - 1;
+}
+
+int decode_view(msg_view_t* msg, char* inBuf) {
+  return decode_text(msg, inBuf, strlen(inBuf));
+}
+
+// Lê o número inteiro que começa na posição "*pos" de "buf", de tamanho "len",
+// e que termina no separador seguinte. Os dígitos são validados e convertidos
+// na mesma passagem, e "*pos" passa a indicar o byte após o separador. Retorna
+// 1 caso o campo seja um número inteiro válido, que caiba em um int, seguido do
+// separador, e 0 caso contrário.
+static int parse_field(const char* buf, size_t len, size_t* pos, int* value) {
+  size_t i = *pos;
+  int negative = i < len && buf[i] == '-';
+  i += negative;
+
+  size_t digits = i;
+  int64_t result = 0;
+  for (; i < len; i++) {
+    unsigned int digit = (unsigned char)buf[i] - '0';
+    if (digit > 9) {
+      break;
+    }
+    result = result * 10 + digit;
+    if (result > INT_MAX) {
+      return 0;
+    }
+  }
+
+  if (i == digits || i == len || buf[i] != SEPARATOR) {
     return 0;
-  msg->id_msg = atoi(token);
+  }
 
-  // ID do remetente
-  token = strtok(NULL, delim);
-  if (token == NULL)
+  *value = negative ? (int)-result : (int)result;
+  *pos = i + 1;
+  return 1;
+}
+
+int decode_text(msg_view_t* msg, const char* inBuf, size_t len) {
+  // Os três primeiros campos são o ID da mensagem, o ID do destinatário e o ID
+  // do remetente. Cada byte do cabeçalho é lido uma única vez, e o conteúdo,
+  // que pode conter o separador, não é percorrido
+  size_t pos = 0;
+  int fields[3];
+  for (int i = 0; i < 3; i++) {
+    if (parse_field(inBuf, len, &pos, &fields[i]) == 0)
+      return 0;
+  }
+
+  // Mensagem
+  if (pos == len)
     return 0;
 
-  // Certifica que o ID do remetente é um número inteiro válido antes de fazer a
-  // conversão.
-  if (!is_number(token, strlen(token)))
+  msg->id_msg = fields[0];
+  msg->id_receiver = fields[1];
+  msg->id_sender = fields[2];
+  msg->req_id = 0;
+  msg->message = inBuf + pos;
+  msg->len = len - pos;
+
+  return 1;
+}
+
+// Escreve o inteiro "value" de 32 bits na representação de rede em "buf".
+static void put_u32(char* buf, uint32_t value) {
+  value = htonl(value);
+  memcpy(buf, &value, sizeof(uint32_t));
+}
+
+// Lê um inteiro de 32 bits na representação de rede a partir de "buf".
+static uint32_t get_u32(const char* buf) {
+  uint32_t value;
+  memcpy(&value, buf, sizeof(uint32_t));
+  return ntohl(value);
+}
+
+// Retorna o tamanho do conteúdo da mensagem "msg" no formato binário, que é
+// truncado para que a mensagem codificada com o cabeçalho de tamanho
+// "hdr_len" caiba em BUFFER_SIZE junto com o caractere nulo.
+static size_t bin_payload_len(const msg_view_t* msg, size_t hdr_len) {
+  size_t max_len = BUFFER_SIZE - 1 - hdr_len;
+  return msg->len < max_len ? msg->len : max_len;
+}
+
+int encode_bin_header(const msg_view_t* msg, char* outBuf) {
+  size_t hdr_len = WIRE_HDR_SIZE + (msg->req_id != 0 ? WIRE_REQ_ID_SIZE : 0);
+  uint16_t payload_len = htons(bin_payload_len(msg, hdr_len));
+
+  outBuf[0] = (char)msg->id_msg;
+  outBuf[1] = msg->req_id != 0 ? WIRE_FLAG_REQ_ID : 0; // flags
+  memcpy(outBuf + 2, &payload_len, sizeof(uint16_t));
+  put_u32(outBuf + 4, (uint32_t)msg->id_sender);
+  put_u32(outBuf + 8, (uint32_t)msg->id_receiver);
+  if (msg->req_id != 0) {
+    put_u32(outBuf + WIRE_HDR_SIZE, msg->req_id);
+  }
+
+  return hdr_len;
+}
+
+int encode_bin(const msg_view_t* msg, char* outBuf) {
+  size_t hdr_len = encode_bin_header(msg, outBuf);
+  size_t len = bin_payload_len(msg, hdr_len);
+  memcpy(outBuf + hdr_len, msg->message, len);
+
+  return hdr_len + len;
+}
+
+int decode_bin(msg_view_t* msg, const char* inBuf, size_t len) {
+  if (len < WIRE_HDR_SIZE || (inBuf[1] & WIRE_FLAG_COMPRESSED))
     return 0;
-  msg->id_receiver = atoi(token);
 
-  // ID do destinatário
-  token = strtok(NULL, delim);
-  if (token == NULL)
+  uint16_t payload_len;
+  memcpy(&payload_len, inBuf + 2, sizeof(uint16_t));
+  payload_len = ntohs(payload_len);
+
+  size_t hdr_len = WIRE_HDR_SIZE + (inBuf[1] & WIRE_FLAG_REQ_ID ? WIRE_REQ_ID_SIZE : 0);
+
+  // O tamanho informado no cabeçalho precisa ser consistente com o tamanho do
+  // quadro recebido
+  if (hdr_len + payload_len != len)
     return 0;
 
-  // Certifica que o ID do destinatário é um número inteiro válido antes de
-  // fazer a conversão.
-  if (!is_number(token, strlen(token)))
+  msg->id_msg = (unsigned char)inBuf[0];
+  msg->id_sender = (int32_t)get_u32(inBuf + 4);
+  msg->id_receiver = (int32_t)get_u32(inBuf + 8);
+  msg->req_id = hdr_len > WIRE_HDR_SIZE ? get_u32(inBuf + WIRE_HDR_SIZE) : 0;
+  msg->message = inBuf + hdr_len;
+  msg->len = payload_len;
+
+  return 1;
+}
+
+int is_binary_msg(const char* inBuf, size_t len) {
+  return len > 0 && !isdigit((unsigned char)inBuf[0]) && inBuf[0] != '-';
+}
+
+int encode_msg(const msg_t* msg, char* outBuf, int binary) {
+  if (!binary) {
+    return encode(msg, outBuf);
+  }
+
+  msg_view_t view = {.id_msg = msg->id_msg,
+                     .id_sender = msg->id_sender,
+                     .id_receiver = msg->id_receiver,
+                     .req_id = msg->req_id,
+                     .message = msg->message,
+                     .len = strlen(msg->message)};
+  return encode_bin(&view, outBuf);
+}
+
+int decode_msg(msg_t* msg, char* inBuf, size_t len, int binary) {
+  if (!binary) {
+    return decode(msg, inBuf);
+  }
+
+  msg_view_t view;
+  if (decode_bin(&view, inBuf, len) == 0)
     return 0;
-  msg->id_sender = atoi(token);
 
-  // Mensagem
-  token = strtok(NULL, delim);
-  if (token == NULL)
+  msg->id_msg = view.id_msg;
+  msg->id_sender = view.id_sender;
+  msg->id_receiver = view.id_receiver;
+  msg->req_id = view.req_id;
+  // Apenas os bytes do conteúdo são copiados, seguidos do caractere nulo
+  memcpy(msg->message, view.message, view.len);
+  msg->message[view.len] = '\0';
+
+  return 1;
+}
+
+int encode_stream_header(char* outBuf, uint32_t stream_id, int kind) {
+  put_u32(outBuf, stream_id);
+  outBuf[4] = (char)kind;
+  return STREAM_HDR_SIZE;
+}
+
+int decode_stream(const msg_view_t* msg, uint32_t* stream_id, int* kind) {
+  if (msg->len < STREAM_HDR_SIZE)
     return 0;
 
-  memset(msg->message, 0, BUFFER_SIZE);
-  strcpy(msg->message, token);
+  *stream_id = get_u32(msg->message);
+  *kind = (unsigned char)msg->message[4];
+  return *kind <= STREAM_CANCEL;
+}
+
+int encode_credit(char* outBuf, uint32_t stream_id, uint32_t credits) {
+  put_u32(outBuf, stream_id);
+  put_u32(outBuf + 4, credits);
+  return CREDIT_SIZE;
+}
 
+int decode_credit(const msg_view_t* msg, uint32_t* stream_id, uint32_t* credits) {
+  if (msg->len != CREDIT_SIZE)
+    return 0;
+
+  *stream_id = get_u32(msg->message);
+  *credits = get_u32(msg->message + 4);
   return 1;
 }
 
 int send_msg(int socket, const char* buffer) {
-  size_t buffer_len = strlen(buffer);
+  return send_frame(socket, buffer, strlen(buffer));
+}
+
+int send_frame(int socket, const char* buffer, size_t buffer_len) {
   // Faz a conversão para a representação de rede
   uint16_t msg_size = htons(buffer_len);
 
-  // Envia um inteiro positivo de 16 bits para informar o tamanho da mensagem
-  // que será enviada
-  if (send(socket, &msg_size, sizeof(uint16_t), 0) != sizeof(uint16_t)) {
-    // Assume que o envio foi mal-sucedido caso o número de bytes enviados não
-    // seja igual ao que se desejava enviar
-    return -1;
-  }
+  // O inteiro positivo de 16 bits que informa o tamanho da mensagem e a
+  // mensagem de fato são enviados na mesma chamada de writev
+  struct iovec iov[2] = {{.iov_base = &msg_size, .iov_len = sizeof(uint16_t)},
+                         {.iov_base = (void*)buffer, .iov_len = buffer_len}};
+  int iovcnt = 2;
+  struct iovec* ptr = iov;
 
-  // Envia a mensagem de fato
-  if (send(socket, buffer, buffer_len, 0) != buffer_len) {
-    // Assume que o envio foi mal-sucedido caso o número de bytes enviados não
-    // seja igual ao que se desejava enviar
-    return -1;
+  while (iovcnt > 0) {
+    ssize_t count = writev(socket, ptr, iovcnt);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count <= 0) {
+      // Assume que o envio foi mal-sucedido caso não seja possível enviar os
+      // bytes restantes
+      return -1;
+    }
+
+    // Avança pelos bytes enviados, que podem ser apenas parte do total
+    while (iovcnt > 0 && (size_t)count >= ptr->iov_len) {
+      count -= ptr->iov_len;
+      ptr++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      ptr->iov_base = (char*)ptr->iov_base + count;
+      ptr->iov_len -= count;
+    }
   }
 
   return 0;
 }
 
-size_t recv_msg(int socket, char* buffer) {
+ssize_t recv_msg(int socket, char* buffer) {
+  size_t len;
+  return recv_frame(socket, buffer, &len);
+}
+
+ssize_t recv_frame(int socket, char* buffer, size_t* len) {
   size_t header_size = sizeof(uint16_t);
   char header_buffer[sizeof(uint16_t)];
 
   // Primeiro, recebe o "cabeçalho" que e informa o tamanho do conteúdo da
   // mensagem e tem exatamente 16 bits
   char* ptr = header_buffer;
-  size_t count;
+  ssize_t count;
   while (header_size > 0) {
     count = recv(socket, ptr, header_size, 0);
     if (count <= 0) {
@@ -126,6 +333,13 @@ size_t recv_msg(int socket, char* buffer) {
   // Faz a conversão para a representação da máquina
   msg_size = ntohs(msg_size);
 
+  // A mensagem precisa caber no buffer junto com o caractere nulo
+  if (msg_size >= BUFFER_SIZE) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  *len = msg_size;
+
   // Após determinar o tamanho da mensagem, recebe o conteúdo da mensagem
   ptr = buffer;
   while (msg_size > 0) {
@@ -141,6 +355,169 @@ size_t recv_msg(int socket, char* buffer) {
   return 1;
 }
 
+void frame_reader_init(frame_reader_t* reader) {
+  reader->start = 0;
+  reader->end = 0;
+}
+
+size_t frame_reader_space(const frame_reader_t* reader) {
+  return FRAME_READER_SIZE - reader->end;
+}
+
+// Prepara o buffer do leitor para receber mais bytes. Os bytes de um quadro
+// incompleto só são movidos para o início do buffer quando não há mais espaço
+// para um quadro de tamanho máximo no final.
+static void frame_reader_compact(frame_reader_t* reader) {
+  if (reader->start == reader->end) {
+    reader->start = 0;
+    reader->end = 0;
+  } else if (frame_reader_space(reader) < sizeof(uint16_t) + BUFFER_SIZE) {
+    memmove(reader->buf, reader->buf + reader->start, reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+  }
+}
+
+ssize_t frame_reader_fill(frame_reader_t* reader, int socket, int flags) {
+  frame_reader_compact(reader);
+
+  ssize_t count;
+  do {
+    count = recv(socket, reader->buf + reader->end, frame_reader_space(reader), flags);
+  } while (count < 0 && errno == EINTR);
+
+  if (count > 0) {
+    reader->end += count;
+  }
+
+  return count;
+}
+
+ssize_t frame_reader_fill_fds(frame_reader_t* reader, int socket, int flags, int* fds,
+                              int max_fds, int* num_fds) {
+  frame_reader_compact(reader);
+  *num_fds = 0;
+
+  // O buffer de controle comporta no máximo FRAME_READER_MAX_FDS file
+  // descriptors. Os excedentes são fechados pelo kernel
+  union {
+    char buf[CMSG_SPACE(FRAME_READER_MAX_FDS * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = {.iov_base = reader->buf + reader->end,
+                      .iov_len = frame_reader_space(reader)};
+  struct msghdr msg = {.msg_iov = &iov,
+                       .msg_iovlen = 1,
+                       .msg_control = control.buf,
+                       .msg_controllen = sizeof(control.buf)};
+
+  ssize_t count;
+  do {
+    count = recvmsg(socket, &msg, flags | MSG_CMSG_CLOEXEC);
+  } while (count < 0 && errno == EINTR);
+
+  if (count <= 0) {
+    return count;
+  }
+  reader->end += count;
+
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+
+    int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (int i = 0; i < n; i++) {
+      int fd;
+      memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+      if (*num_fds < max_fds) {
+        fds[(*num_fds)++] = fd;
+      } else {
+        close(fd);
+      }
+    }
+  }
+
+  return count;
+}
+
+size_t frame_reader_append(frame_reader_t* reader, const char* data, size_t len) {
+  frame_reader_compact(reader);
+
+  size_t space = frame_reader_space(reader);
+  if (len > space) {
+    len = space;
+  }
+
+  memcpy(reader->buf + reader->end, data, len);
+  reader->end += len;
+
+  return len;
+}
+
+int frame_reader_next(frame_reader_t* reader, char** frame, size_t* len) {
+  size_t available = reader->end - reader->start;
+  if (available < sizeof(uint16_t)) {
+    return 0;
+  }
+
+  uint16_t msg_size;
+  memcpy(&msg_size, reader->buf + reader->start, sizeof(uint16_t));
+  // Faz a conversão para a representação da máquina
+  msg_size = ntohs(msg_size);
+
+  // A mensagem precisa caber em um buffer de BUFFER_SIZE bytes junto com o
+  // caractere nulo
+  if (msg_size >= BUFFER_SIZE) {
+    return -1;
+  }
+
+  if (available < sizeof(uint16_t) + msg_size) {
+    return 0;
+  }
+
+  *frame = reader->buf + reader->start + sizeof(uint16_t);
+  *len = msg_size;
+  reader->start += sizeof(uint16_t) + msg_size;
+
+  return 1;
+}
+
+size_t frame_reader_batch(frame_reader_t* reader, frame_view_t* frames, size_t max, int binary) {
+  size_t count = 0;
+  while (count < max) {
+    size_t start = reader->start;
+    char* frame;
+    size_t len;
+    if (frame_reader_next(reader, &frame, &len) != 1) {
+      break;
+    }
+
+    frame_view_t* view = &frames[count];
+    int ret = binary ? decode_bin(&view->msg, frame, len) : decode_text(&view->msg, frame, len);
+    if (ret == 0) {
+      // O quadro permanece no leitor para ser tratado individualmente
+      reader->start = start;
+      break;
+    }
+    view->len = len;
+    count++;
+
+    // O REQ_ADD pode alterar o formato dos quadros seguintes
+    if (!binary && view->msg.id_msg == REQ_ADD) {
+      break;
+    }
+  }
+
+  return count;
+}
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 void log_exit(const char* msg) {
   perror(msg);
   exit(EXIT_FAILURE);
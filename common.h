@@ -1,14 +1,16 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 // Macro usada para imprimir no stderr.
 #define eprintf(...) fprintf(stderr, __VA_ARGS__)
 
 #define BUFFER_SIZE 2048
 
-#define MAX_CLIENTS 15
 #define NULL_ID -1
 
 #define SEPARATOR '\x1D' // Group separator
@@ -19,6 +21,113 @@
 #define MSG 6
 #define ERROR 7
 #define OK 8
+#define STREAM 9
+#define CREDIT 10
+#define ROOM_JOIN 11
+#define ROOM_LEAVE 12
+#define ROOM_MSG 13
+#define HISTORY 14
+#define HEARTBEAT 15
+#define PRESENCE 16
+
+// Versão do formato binário das mensagens. O cliente solicita o formato binário
+// incluindo a capacidade CAP_BINARY no conteúdo da mensagem REQ_ADD, que é
+// sempre enviada no formato de texto. Caso o servidor aceite, a resposta ao
+// REQ_ADD e todas as mensagens seguintes, nos dois sentidos, usam o formato
+// binário.
+#define WIRE_VERSION 1
+#define CAP_BINARY "BIN1"
+
+// Tamanho do cabeçalho do formato binário: tipo (8 bits), flags (8 bits),
+// tamanho do conteúdo (16 bits), remetente (32 bits) e destinatário (32 bits),
+// todos na representação de rede.
+#define WIRE_HDR_SIZE 12
+
+// Tamanho máximo do conteúdo de uma mensagem no formato binário, de modo que a
+// mensagem codificada caiba em BUFFER_SIZE junto com o caractere nulo.
+#define WIRE_MAX_PAYLOAD (BUFFER_SIZE - 1 - WIRE_HDR_SIZE)
+
+// Flag do cabeçalho binário que indica que o cabeçalho é seguido por um ID de
+// requisição de 32 bits, na representação de rede. O cliente associa um ID a
+// cada mensagem privada, e o servidor repete o mesmo ID no OK ou ERROR
+// correspondente, o que permite que o cliente tenha várias mensagens privadas
+// aguardando confirmação. No formato de texto não há ID, e as confirmações são
+// associadas pela ordem, já que o servidor responde às mensagens de uma conexão
+// na ordem em que as recebe.
+#define WIRE_FLAG_REQ_ID 0x01
+#define WIRE_REQ_ID_SIZE 4
+
+// Flag do cabeçalho binário que indica que o conteúdo está compactado (ver
+// lz.h). Mensagens compactadas são descompactadas antes de "decode_bin", que
+// as rejeita.
+#define WIRE_FLAG_COMPRESSED 0x02
+
+// Formatos em que as mensagens de uma conexão são codificadas: texto, binário
+// e binário com compactação.
+#define FORMAT_TEXT 0
+#define FORMAT_BINARY 1
+#define FORMAT_LZ 2
+#define NUM_FORMATS 3
+
+// Transferências de conteúdos grandes (por exemplo, arquivos) são feitas como
+// streams: uma sequência de mensagens STREAM privadas, cada uma com um trecho
+// do conteúdo, que o servidor repassa ao destinatário sem armazená-las. O
+// conteúdo de cada mensagem STREAM começa com o ID do stream (32 bits),
+// escolhido pelo remetente, e o tipo do trecho (8 bits). Streams só são
+// permitidos no formato binário, já que os trechos podem conter qualquer byte.
+#define STREAM_HDR_SIZE 5
+
+// Tipos dos trechos de um stream. O primeiro trecho traz o nome do conteúdo,
+// e o último não traz dados. O remetente pode cancelar o stream com um trecho
+// STREAM_CANCEL. No sentido contrário, o destinatário, ou o servidor caso o
+// destinatário não exista ou não use o formato binário, aborta o stream com
+// uma mensagem STREAM_ABORT enviada ao remetente.
+#define STREAM_OPEN 0
+#define STREAM_DATA 1
+#define STREAM_END 2
+#define STREAM_ABORT 3
+#define STREAM_CANCEL 4
+
+// Tamanho máximo dos dados de cada trecho.
+#define STREAM_CHUNK_SIZE (WIRE_MAX_PAYLOAD - STREAM_HDR_SIZE)
+
+// Controle de fluxo: o remetente só pode enviar um trecho de dados quando
+// possui créditos para o stream. Ele começa com STREAM_WINDOW créditos, e o
+// destinatário devolve créditos com mensagens CREDIT à medida que consome os
+// trechos. Assim, cada stream tem no máximo STREAM_WINDOW trechos em trânsito,
+// e as filas do servidor nunca acumulam uma transferência inteira. O conteúdo
+// de uma mensagem CREDIT é o ID do stream seguido do número de créditos, ambos
+// de 32 bits.
+#define STREAM_WINDOW 16
+#define CREDIT_SIZE 8
+
+// Salas de conversa. Um usuário entra em uma sala com uma mensagem ROOM_JOIN
+// e sai com uma mensagem ROOM_LEAVE, ambas com o nome da sala como conteúdo.
+// O servidor repassa as duas mensagens, com o usuário como remetente, a todos
+// os membros da sala, inclusive ao próprio usuário, o que serve de
+// confirmação. O conteúdo de uma mensagem ROOM_MSG é o nome da sala, um espaço
+// e o texto, e ela é repassada sem alterações a todos os membros da sala,
+// inclusive ao remetente. Os nomes têm no máximo ROOM_NAME_SIZE - 1
+// caracteres, e cada usuário pode estar em até ROOMS_PER_USER salas.
+#define ROOM_NAME_SIZE 32
+#define ROOMS_PER_USER 16
+
+// Ao entrar no grupo, após o RES_LIST, o usuário recebe as últimas mensagens
+// públicas como mensagens HISTORY, da mais antiga para a mais recente. O
+// remetente é o autor da mensagem original, e o conteúdo é o horário original
+// no formato "[HH:MM]", um espaço e o texto. Uma mensagem enviada enquanto o
+// usuário entra no grupo pode ser recebida tanto no histórico quanto como uma
+// mensagem MSG.
+
+// O servidor envia uma mensagem HEARTBEAT, com o usuário como destinatário, a
+// cada usuário que fica sem enviar mensagens por um intervalo configurado. O
+// cliente responde com uma mensagem HEARTBEAT, com ele mesmo como remetente e
+// destinatário nulo. Uma conexão que não envia nenhuma mensagem após um prazo
+// maior é encerrada, e a saída do usuário é informada como um REQ_REM.
+
+// Os clientes que negociam a presença compacta recebem, no lugar do RES_LIST e
+// dos anúncios de entrada e saída, mensagens PRESENCE com um snapshot dos IDs
+// ativos e as alterações seguintes, numeradas por versão (ver presence.h).
 
 // Estrutura de dados usada para representar uma mensagem.
 typedef struct msg_t {
@@ -31,14 +140,67 @@ typedef struct msg_t {
   // ID do destinatário
   int id_receiver;
 
+  // ID de requisição, ou 0 caso a mensagem não tenha um
+  uint32_t req_id;
+
   // Contéudo da mensagem
   char message[BUFFER_SIZE];
 } msg_t;
 
+// Visão de uma mensagem cujo conteúdo não é copiado: "message" aponta para os
+// bytes do conteúdo em outro buffer (por exemplo, o buffer de recebimento) e
+// não é necessariamente terminado por caractere nulo.
+typedef struct msg_view_t {
+  // ID da mensagem
+  unsigned int id_msg;
+
+  // ID do remetente
+  int id_sender;
+
+  // ID do destinatário
+  int id_receiver;
+
+  // ID de requisição, ou 0 caso a mensagem não tenha um
+  uint32_t req_id;
+
+  // Contéudo da mensagem e seu tamanho
+  const char* message;
+  size_t len;
+} msg_view_t;
+
+// Tamanho do buffer de recebimento de cada conexão. Ele comporta vários
+// quadros, de modo que uma única chamada de recv pode trazer um lote inteiro de
+// mensagens.
+#define FRAME_READER_SIZE (8 * BUFFER_SIZE)
+
+// Leitor de quadros com buffer. Os bytes recebidos são acumulados em "buf" e os
+// quadros completos são entregues um a um, sem cópia, a partir de "start". Um
+// quadro incompleto permanece no buffer até que o restante dos seus bytes seja
+// recebido.
+typedef struct frame_reader_t {
+  // Bytes recebidos.
+  char buf[FRAME_READER_SIZE];
+
+  // Início dos bytes ainda não entregues e fim dos bytes recebidos.
+  size_t start;
+  size_t end;
+} frame_reader_t;
+
+// Quadro decodificado em lote por "frame_reader_batch": a visão da mensagem,
+// cujo conteúdo aponta para o buffer do leitor, e o tamanho do quadro.
+typedef struct frame_view_t {
+  msg_view_t msg;
+  size_t len;
+} frame_view_t;
+
 // Função auxiliar usada para verificar se uma string representa um número
 // inteiro válido.
 int is_number(const char* str, size_t len);
 
+// Tamanho da string de timestamp gerada por "set_time_str", incluindo o
+// caractere nulo.
+#define TIME_STR_SIZE 8
+
 // Função auxiliar usada para gerar uma string de timestamp no formato "[HH:MM]".
 void set_time_str(char* time_str);
 
@@ -53,13 +215,134 @@ int encode(const msg_t* msg, char* outBuf);
 // 0 caso contrário.
 int decode(msg_t* msg, char* inBuf);
 
+// Escreve em "outBuf" apenas os campos que precedem o conteúdo da mensagem no
+// formato de texto. Retorna o tamanho da string resultante.
+int encode_view_header(const msg_view_t* msg, char* outBuf);
+
+// Faz a codificação de uma visão de mensagem para o formato de texto. O
+// conteúdo é truncado caso a mensagem codificada não caiba em BUFFER_SIZE.
+// Retorna o tamanho da string resultante.
+int encode_view(const msg_view_t* msg, char* outBuf);
+
+// Faz a decodificação de uma mensagem no formato de texto sem copiar o seu
+// conteúdo: "msg->message" passa a apontar para dentro de "inBuf". Retorna 1
+// caso a decodificação tenha sido bem sucedida e 0 caso contrário.
+int decode_view(msg_view_t* msg, char* inBuf);
+
+// Faz a decodificação de uma mensagem no formato de texto, de tamanho "len",
+// sem copiar o seu conteúdo e sem depender de um caractere nulo ao final. Os
+// IDs do cabeçalho são validados e convertidos em uma única passagem, e o
+// conteúdo, que é o restante da mensagem, não é percorrido. Retorna 1 caso a
+// decodificação tenha sido bem sucedida e 0 caso contrário.
+int decode_text(msg_view_t* msg, const char* inBuf, size_t len);
+
+// Escreve em "outBuf" apenas o cabeçalho de uma mensagem no formato binário,
+// usando "msg->len" como tamanho do conteúdo. O ID de requisição é incluído
+// caso não seja 0. Retorna o tamanho do cabeçalho.
+int encode_bin_header(const msg_view_t* msg, char* outBuf);
+
+// Faz a codificação de uma visão de mensagem para o formato binário. O conteúdo
+// é truncado para que a mensagem codificada caiba em BUFFER_SIZE junto com o
+// caractere nulo. Retorna o tamanho da mensagem codificada.
+int encode_bin(const msg_view_t* msg, char* outBuf);
+
+// Faz a decodificação de uma mensagem no formato binário, de tamanho "len", sem
+// copiar o seu conteúdo. Retorna 1 caso a decodificação tenha sido bem sucedida
+// e 0 caso contrário.
+int decode_bin(msg_view_t* msg, const char* inBuf, size_t len);
+
+// Retorna 1 caso a mensagem em "inBuf" esteja no formato binário. Mensagens no
+// formato de texto sempre começam com um dígito, enquanto o primeiro byte de
+// uma mensagem binária é o seu tipo.
+int is_binary_msg(const char* inBuf, size_t len);
+
+// Codifica a mensagem "msg" no formato binário ou de texto, de acordo com
+// "binary". Retorna o tamanho da mensagem codificada.
+int encode_msg(const msg_t* msg, char* outBuf, int binary);
+
+// Decodifica a mensagem "inBuf", de tamanho "len", no formato binário ou de
+// texto, de acordo com "binary". O conteúdo é copiado para "msg->message".
+// Retorna 1 caso a decodificação tenha sido bem sucedida e 0 caso contrário.
+int decode_msg(msg_t* msg, char* inBuf, size_t len, int binary);
+
+// Escreve em "outBuf" o início do conteúdo de uma mensagem STREAM, com o ID
+// "stream_id" e o tipo de trecho "kind". Retorna STREAM_HDR_SIZE.
+int encode_stream_header(char* outBuf, uint32_t stream_id, int kind);
+
+// Lê o ID do stream e o tipo do trecho de uma mensagem STREAM. Os dados do
+// trecho são os bytes de "msg->message" após STREAM_HDR_SIZE. Retorna 1 caso a
+// mensagem seja válida e 0 caso contrário.
+int decode_stream(const msg_view_t* msg, uint32_t* stream_id, int* kind);
+
+// Escreve em "outBuf" o conteúdo de uma mensagem CREDIT. Retorna CREDIT_SIZE.
+int encode_credit(char* outBuf, uint32_t stream_id, uint32_t credits);
+
+// Lê o conteúdo de uma mensagem CREDIT. Retorna 1 caso a mensagem seja válida
+// e 0 caso contrário.
+int decode_credit(const msg_view_t* msg, uint32_t* stream_id, uint32_t* credits);
+
+// Inicializa um leitor de quadros vazio.
+void frame_reader_init(frame_reader_t* reader);
+
+// Lê do socket "socket", em uma única chamada de recv com as flags "flags",
+// todos os bytes disponíveis que couberem no buffer. Os quadros obtidos
+// anteriormente por "frame_reader_next" deixam de ser válidos. Retorna o número
+// de bytes lidos, 0 caso a conexão tenha sido fechada e -1 em caso de erro.
+ssize_t frame_reader_fill(frame_reader_t* reader, int socket, int flags);
+
+// Número máximo de file descriptors recebidos em cada leitura por
+// "frame_reader_fill_fds".
+#define FRAME_READER_MAX_FDS 4
+
+// Como "frame_reader_fill", mas no socket UNIX "socket", armazenando em "fds"
+// até "max_fds" file descriptors recebidos junto com os bytes (SCM_RIGHTS), no
+// máximo FRAME_READER_MAX_FDS, e em "num_fds" o número deles. Os demais são
+// fechados.
+ssize_t frame_reader_fill_fds(frame_reader_t* reader, int socket, int flags, int* fds,
+                              int max_fds, int* num_fds);
+
+// Copia para o buffer do leitor os bytes de "data", de tamanho "len", que já
+// foram recebidos por outro meio. Como "frame_reader_fill", invalida os quadros
+// obtidos anteriormente. Retorna o número de bytes copiados, que pode ser menor
+// que "len" caso o buffer esteja cheio.
+size_t frame_reader_append(frame_reader_t* reader, const char* data, size_t len);
+
+// Retorna 1 caso haja um quadro completo no buffer, armazenando em "frame" um
+// ponteiro para o seu conteúdo e em "len" o seu tamanho. Retorna 0 caso não
+// haja um quadro completo e -1 caso o quadro seja maior do que BUFFER_SIZE - 1.
+int frame_reader_next(frame_reader_t* reader, char** frame, size_t* len);
+
+// Decodifica, sem cópia, até "max" quadros completos do leitor em "frames", no
+// formato binário caso "binary" seja 1 ou no formato de texto caso contrário.
+// A decodificação para no primeiro quadro que não pode ser lido como visão
+// (compactado ou inválido), que permanece no leitor para ser obtido por
+// "frame_reader_next", e, no formato de texto, após um REQ_ADD, que pode
+// alterar o formato dos quadros seguintes. As visões deixam de ser válidas na
+// próxima leitura do socket. Retorna o número de quadros decodificados.
+size_t frame_reader_batch(frame_reader_t* reader, frame_view_t* frames, size_t max, int binary);
+
+// Retorna a quantidade de bytes livres no final do buffer do leitor.
+size_t frame_reader_space(const frame_reader_t* reader);
+
+// Função auxiliar usada para enviar uma mensagem de tamanho "len" em um socket.
+// Retorna 0 caso o envio tenha sido bem sucedido e -1 caso contrário.
+int send_frame(int socket, const char* buffer, size_t len);
+
 // Função auxiliar usada para enviar uma mensagem em um socket. Retorna -1 caso
 // o envio tenha sido bem sucedido e 0 caso contrário.
 int send_msg(int socket, const char* buffer);
 
+// Função auxiliar usada para receber uma mensagem em um socket. O tamanho da
+// mensagem recebida é armazenado em "len". Retorna 1 caso o recebimento tenha
+// sido bem sucedido.
+ssize_t recv_frame(int socket, char* buffer, size_t* len);
+
 // Função auxiliar usada para receber uma mensagem em um socket. Retorna 1 caso
 // o envio tenha sido bem sucedido.
-size_t recv_msg(int socket, char* buffer);
+ssize_t recv_msg(int socket, char* buffer);
+
+// Retorna o instante atual do relógio monotônico, em nanossegundos.
+uint64_t now_ns();
 
 // Retirado das aulas do professor Ítalo.
 void log_exit(const char* msg);
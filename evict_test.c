@@ -0,0 +1,231 @@
+#include "common.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Teste de isolamento de falhas do servidor: um usuário entra no grupo e, para
+// cada quadro inválido, um segundo usuário entra no grupo e envia o quadro. O
+// teste verifica que apenas a conexão do segundo usuário é encerrada e que o
+// primeiro continua conectado, enviando e recebendo mensagens públicas.
+
+// Tempo máximo, em milissegundos, de espera por cada resposta do servidor.
+#define WAIT_MS 2000
+
+// Quadro inválido enviado por um dos usuários.
+typedef struct garbage_t {
+  // Descrição do caso.
+  const char* name;
+
+  // Bytes do quadro, incluindo o tamanho, e número de bytes. Caso "raw" seja
+  // 0, o tamanho é incluído pelo teste. Caso "own_id" seja 1, "data" é um
+  // formato em que "%d" é substituído pelo ID do usuário que envia o quadro.
+  const char* data;
+  size_t len;
+  int raw;
+  int own_id;
+} garbage_t;
+
+// Conexão de um usuário do teste.
+typedef struct peer_t {
+  int sock;
+  int id;
+  frame_reader_t reader;
+} peer_t;
+
+// Faz o parse do endereço passado como argumento e inicializa um struct do tipo
+// sockaddr_storage de acordo com o protocolo adequado. Retorna 0 quando há
+// sucesso e -1 caso contrário. Retirado das aulas do professor Ítalo.
+int parse_address(const char* addr_str, const char* port_str,
+                  struct sockaddr_storage* storage) {
+  uint16_t port = (uint16_t)atoi(port_str); // unsigned short
+  if (port == 0) {
+    return -1;
+  }
+  port = htons(port); // host to network short
+
+  memset(storage, 0, sizeof(*storage));
+
+  struct in_addr inaddr4;                       // 32-bit IPv4 address
+  if (inet_pton(AF_INET, addr_str, &inaddr4)) { // presentation to network
+    struct sockaddr_in* addr4 = (struct sockaddr_in*)storage;
+    addr4->sin_family = AF_INET;
+    addr4->sin_port = port;
+    addr4->sin_addr = inaddr4;
+    return 0;
+  }
+
+  struct in6_addr inaddr6;                       // 128-bit IPv6 address
+  if (inet_pton(AF_INET6, addr_str, &inaddr6)) { // presentation to network
+    struct sockaddr_in6* addr6 = (struct sockaddr_in6*)storage;
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = port;
+    memcpy(&(addr6->sin6_addr), &inaddr6, sizeof(inaddr6));
+    return 0;
+  }
+
+  return -1;
+}
+
+// Aguarda o próximo quadro da conexão "peer" e o decodifica em "msg". Retorna 1
+// caso um quadro tenha sido recebido, 0 caso o servidor tenha fechado a conexão
+// e -1 caso o prazo tenha expirado.
+int peer_next(peer_t* peer, msg_view_t* msg) {
+  while (1) {
+    char* frame;
+    size_t len;
+    int ret = frame_reader_next(&peer->reader, &frame, &len);
+    if (ret < 0 || (ret == 1 && decode_text(msg, frame, len) == 0)) {
+      parse_error();
+    } else if (ret == 1) {
+      return 1;
+    }
+
+    ssize_t count = frame_reader_fill(&peer->reader, peer->sock, 0);
+    if (count == 0 || (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      return 0;
+    } else if (count < 0) {
+      return -1;
+    }
+  }
+}
+
+// Conecta um usuário ao servidor no endereço "storage" e faz a sua entrada no
+// grupo, no formato de texto.
+void peer_join(peer_t* peer, const struct sockaddr_storage* storage) {
+  peer->sock = socket(storage->ss_family, SOCK_STREAM, 0);
+  if (peer->sock == -1) {
+    log_exit("socket");
+  }
+  if (connect(peer->sock, (const struct sockaddr*)storage, sizeof(*storage)) != 0) {
+    log_exit("connect");
+  }
+
+  struct timeval tv = {.tv_sec = WAIT_MS / 1000, .tv_usec = (WAIT_MS % 1000) * 1000};
+  if (setsockopt(peer->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0) {
+    log_exit("setsockopt");
+  }
+  frame_reader_init(&peer->reader);
+
+  msg_t msg = {.id_msg = REQ_ADD, .id_sender = NULL_ID, .id_receiver = NULL_ID};
+  strcpy(msg.message, "REQ_ADD");
+  char buffer[BUFFER_SIZE];
+  encode(&msg, buffer);
+  if (send_msg(peer->sock, buffer) != 0) {
+    log_exit("send");
+  }
+
+  // A resposta ao REQ_ADD traz o ID do usuário
+  msg_view_t reply;
+  if (peer_next(peer, &reply) != 1 || reply.id_msg != MSG) {
+    eprintf("REQ_ADD was not answered.\n");
+    exit(EXIT_FAILURE);
+  }
+  peer->id = reply.id_sender;
+}
+
+// Envia uma mensagem pública do usuário "peer" e aguarda a sua cópia. Retorna 1
+// caso ela tenha sido recebida e 0 caso contrário.
+int peer_echo(peer_t* peer, const char* text) {
+  char buffer[BUFFER_SIZE];
+  msg_view_t msg = {.id_msg = MSG,
+                    .id_sender = peer->id,
+                    .id_receiver = NULL_ID,
+                    .message = text,
+                    .len = strlen(text)};
+  int len = encode_view(&msg, buffer);
+  if (send_frame(peer->sock, buffer, len) != 0) {
+    return 0;
+  }
+
+  // Os avisos de entrada e saída dos demais usuários são ignorados
+  msg_view_t reply;
+  while (peer_next(peer, &reply) == 1) {
+    if (reply.id_msg == MSG && reply.id_sender == peer->id && reply.len >= msg.len &&
+        memcmp(reply.message + reply.len - msg.len, text, msg.len) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Envia o quadro inválido "garbage" pelo usuário "peer" e verifica que o
+// servidor encerra a sua conexão. Retorna 1 em caso de sucesso e 0 caso
+// contrário.
+int peer_garbage(peer_t* peer, const garbage_t* garbage) {
+  char buffer[BUFFER_SIZE];
+  int ret;
+  if (garbage->own_id) {
+    int len = snprintf(buffer, sizeof(buffer), garbage->data, peer->id);
+    ret = send_frame(peer->sock, buffer, len);
+  } else if (garbage->raw) {
+    ret = write(peer->sock, garbage->data, garbage->len) == (ssize_t)garbage->len ? 0 : -1;
+  } else {
+    ret = send_frame(peer->sock, garbage->data, garbage->len);
+  }
+  if (ret != 0) {
+    return 0;
+  }
+
+  msg_view_t msg;
+  while ((ret = peer_next(peer, &msg)) == 1) {
+  }
+  return ret == 0;
+}
+
+void usage(const char* bin) {
+  eprintf("Usage: %s <server IP address> <server port>\n", bin);
+  eprintf("Example: %s 127.0.0.1 51511\n", bin);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    usage(argv[0]);
+  }
+
+  struct sockaddr_storage storage;
+  if (parse_address(argv[1], argv[2], &storage) != 0) {
+    usage(argv[0]);
+  }
+
+  // Um tamanho maior que o de qualquer mensagem válida
+  static const char oversized[] = {(char)0xFF, (char)0xFF, 'x', 'x', 'x', 'x'};
+  garbage_t cases[] = {
+      {"not a message", "hello world", strlen("hello world"), 0},
+      {"unknown message ID", "99\x1D-1\x1D" "0\x1Dhi", strlen("99\x1D-1\x1D" "0\x1Dhi"), 0},
+      {"ID out of range", "6\x1D-1\x1D" "99999999999\x1Dhi",
+       strlen("6\x1D-1\x1D" "99999999999\x1Dhi"), 0},
+      {"stream header", "9\x1D" "0\x1D" "%d\x1Dx", 0, 0, 1},
+      {"credit size", "10\x1D" "0\x1D" "%d\x1Dxyz", 0, 0, 1},
+      {"forged stream", "9\x1D" "0\x1D" "0\x1D\x01\x01\x01\x01\x03", 0, 0, 1},
+      {"oversized frame", oversized, sizeof(oversized), 1},
+  };
+  int num_cases = sizeof(cases) / sizeof(cases[0]);
+
+  peer_t good;
+  peer_join(&good, &storage);
+
+  int failures = 0;
+  for (int i = 0; i < num_cases; i++) {
+    peer_t bad;
+    peer_join(&bad, &storage);
+
+    int evicted = peer_garbage(&bad, &cases[i]);
+    int alive = peer_echo(&good, cases[i].name);
+    printf("%-20s %s\n", cases[i].name, evicted && alive ? "ok" : "FAILED");
+    if (!evicted || !alive) {
+      failures++;
+    }
+    close(bad.sock);
+  }
+
+  close(good.sock);
+  exit(failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
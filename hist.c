@@ -0,0 +1,86 @@
+#include "hist.h"
+#include <string.h>
+
+// Os valores menores que HIST_SUB_COUNT têm posições exatas. Os demais são
+// agrupados pela sua potência de 2 e pelos HIST_SUB_BITS bits seguintes ao bit
+// mais significativo.
+int hist_index(uint64_t value) {
+  if (value < HIST_SUB_COUNT) {
+    return value;
+  }
+
+  int exp = 63 - __builtin_clzll(value);
+  int shift = exp - HIST_SUB_BITS;
+  return (shift + 1) * HIST_SUB_COUNT + ((value >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+// Retorna o maior valor correspondente à posição "index".
+static uint64_t hist_value(int index) {
+  if (index < HIST_SUB_COUNT) {
+    return index;
+  }
+
+  int shift = index / HIST_SUB_COUNT - 1;
+  uint64_t low = (uint64_t)(HIST_SUB_COUNT + index % HIST_SUB_COUNT) << shift;
+  return low + ((uint64_t)1 << shift) - 1;
+}
+
+void hist_init(hist_t* hist) {
+  memset(hist, 0, sizeof(*hist));
+  hist->min = UINT64_MAX;
+}
+
+void hist_record(hist_t* hist, uint64_t value) {
+  hist->counts[hist_index(value)]++;
+  hist->count++;
+  hist->sum += value;
+  if (value < hist->min) {
+    hist->min = value;
+  }
+  if (value > hist->max) {
+    hist->max = value;
+  }
+}
+
+void hist_merge(hist_t* dst, const hist_t* src) {
+  for (int i = 0; i < HIST_SIZE; i++) {
+    dst->counts[i] += src->counts[i];
+  }
+
+  dst->count += src->count;
+  dst->sum += src->sum;
+  if (src->min < dst->min) {
+    dst->min = src->min;
+  }
+  if (src->max > dst->max) {
+    dst->max = src->max;
+  }
+}
+
+uint64_t hist_percentile(const hist_t* hist, double percentile) {
+  if (hist->count == 0) {
+    return 0;
+  }
+
+  // Posição, na ordem crescente, do valor procurado
+  uint64_t rank = (uint64_t)(percentile / 100.0 * hist->count + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  for (int i = 0; i < HIST_SIZE; i++) {
+    seen += hist->counts[i];
+    if (seen >= rank) {
+      // O valor reportado nunca ultrapassa o máximo registrado
+      uint64_t value = hist_value(i);
+      return value < hist->max ? value : hist->max;
+    }
+  }
+
+  return hist->max;
+}
+
+double hist_mean(const hist_t* hist) {
+  return hist->count == 0 ? 0 : (double)hist->sum / hist->count;
+}
@@ -0,0 +1,50 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+
+// Número de bits de precisão de cada faixa do histograma. Cada potência de 2 é
+// dividida em 2^HIST_SUB_BITS subfaixas lineares, o que limita o erro relativo
+// dos valores reportados a cerca de 3%.
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+
+// Número total de posições do histograma, suficiente para qualquer valor de 64
+// bits.
+#define HIST_SIZE ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+// Histograma com faixas log-lineares (no estilo do HdrHistogram), usado para
+// registrar latências com precisão relativa constante e memória fixa. Não é
+// sincronizado: cada thread registra valores no seu próprio histograma, e os
+// histogramas são combinados com "hist_merge" na hora de reportar.
+typedef struct hist_t {
+  // Contagem de cada posição.
+  uint64_t counts[HIST_SIZE];
+
+  // Número de valores registrados, sua soma e os valores mínimo e máximo.
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+} hist_t;
+
+// Retorna a posição do histograma correspondente ao valor "value".
+int hist_index(uint64_t value);
+
+// Inicializa um histograma vazio.
+void hist_init(hist_t* hist);
+
+// Registra o valor "value" no histograma.
+void hist_record(hist_t* hist, uint64_t value);
+
+// Adiciona ao histograma "dst" todos os valores registrados em "src".
+void hist_merge(hist_t* dst, const hist_t* src);
+
+// Retorna o valor abaixo do qual estão "percentile" por cento dos valores
+// registrados, ou 0 caso o histograma esteja vazio.
+uint64_t hist_percentile(const hist_t* hist, double percentile);
+
+// Retorna a média dos valores registrados, ou 0 caso o histograma esteja vazio.
+double hist_mean(const hist_t* hist);
+
+#endif
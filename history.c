@@ -0,0 +1,120 @@
+#include "history.h"
+#include "lz.h"
+#include <stdlib.h>
+#include <string.h>
+
+void history_init(history_t* history, size_t max_msgs, size_t max_bytes) {
+  pthread_mutex_init(&history->lock, NULL);
+  history->capacity = max_msgs;
+  history->head = 0;
+  history->count = 0;
+  history->bytes = 0;
+  history->max_bytes = max_bytes;
+
+  history->entries = NULL;
+  if (max_msgs > 0) {
+    history->entries = (history_entry_t*)calloc(max_msgs, sizeof(history_entry_t));
+    if (history->entries == NULL) {
+      log_exit("calloc");
+    }
+  }
+}
+
+// Descarta a mensagem mais antiga do histórico. Deve ser chamada com a trava.
+static void history_pop(history_t* history) {
+  history_entry_t* entry = &history->entries[history->head];
+  for (int i = 0; i < NUM_FORMATS; i++) {
+    if (entry->frames[i] != NULL) {
+      shbuf_unref(entry->frames[i]);
+      entry->frames[i] = NULL;
+    }
+  }
+
+  history->bytes -= entry->bytes;
+  history->head = (history->head + 1) % history->capacity;
+  history->count--;
+}
+
+void history_destroy(history_t* history) {
+  while (history->count > 0) {
+    history_pop(history);
+  }
+  free(history->entries);
+  pthread_mutex_destroy(&history->lock);
+}
+
+void history_push(history_t* history, const msg_view_t* msg, const char* time_str) {
+  if (history->capacity == 0) {
+    return;
+  }
+
+  // O conteúdo é o horário original da mensagem seguido do seu texto. O quadro
+  // é codificado fora da trava
+  char content[WIRE_MAX_PAYLOAD];
+  size_t time_len = strlen(time_str);
+  size_t len = msg->len < sizeof(content) - time_len - 1 ? msg->len
+                                                         : sizeof(content) - time_len - 1;
+  memcpy(content, time_str, time_len);
+  content[time_len] = ' ';
+  memcpy(content + time_len + 1, msg->message, len);
+
+  msg_view_t hist_msg = {
+      .id_msg = HISTORY, .id_sender = msg->id_sender, .id_receiver = NULL_ID};
+  hist_msg.message = content;
+  hist_msg.len = time_len + 1 + len;
+  shbuf_t* frame = shbuf_msg(&hist_msg, FORMAT_BINARY);
+
+  if (frame->len > history->max_bytes) {
+    shbuf_unref(frame);
+    return;
+  }
+
+  pthread_mutex_lock(&history->lock);
+
+  while (history->count == history->capacity ||
+         history->bytes + frame->len > history->max_bytes) {
+    history_pop(history);
+  }
+
+  history_entry_t* entry =
+      &history->entries[(history->head + history->count) % history->capacity];
+  entry->frames[FORMAT_BINARY] = frame;
+  entry->bytes = frame->len;
+  history->bytes += frame->len;
+  history->count++;
+
+  pthread_mutex_unlock(&history->lock);
+}
+
+size_t history_snapshot(history_t* history, int format, shbuf_t** frames) {
+  pthread_mutex_lock(&history->lock);
+
+  for (size_t i = 0; i < history->count; i++) {
+    history_entry_t* entry = &history->entries[(history->head + i) % history->capacity];
+
+    if (entry->frames[format] == NULL) {
+      // Os demais formatos são obtidos a partir do quadro binário
+      shbuf_t* binary = entry->frames[FORMAT_BINARY];
+      msg_view_t msg;
+      if (decode_bin(&msg, binary->data + sizeof(uint16_t), binary->len - sizeof(uint16_t)) ==
+          0) {
+        parse_error();
+      }
+
+      if (format == FORMAT_LZ && msg.len < LZ_MIN_SIZE) {
+        shbuf_ref(binary);
+        entry->frames[format] = binary;
+      } else {
+        entry->frames[format] = shbuf_msg(&msg, format);
+      }
+    }
+
+    shbuf_ref(entry->frames[format]);
+    frames[i] = entry->frames[format];
+  }
+
+  size_t count = history->count;
+  pthread_mutex_unlock(&history->lock);
+
+  return count;
+}
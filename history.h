@@ -0,0 +1,60 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "common.h"
+#include "outq.h"
+#include <pthread.h>
+#include <stddef.h>
+
+// Limites padrão do histórico: número de mensagens e total de bytes dos
+// quadros armazenados.
+#define HISTORY_DEFAULT_MSGS 64
+#define HISTORY_DEFAULT_BYTES (256 * 1024)
+
+// Mensagem do histórico, já codificada como uma mensagem HISTORY. O quadro de
+// cada formato é codificado uma única vez, na primeira vez em que é
+// solicitado, e compartilhado por todos os usuários que entram no grupo.
+typedef struct history_entry_t {
+  shbuf_t* frames[NUM_FORMATS];
+
+  // Tamanho do quadro binário, contabilizado no limite de bytes.
+  size_t bytes;
+} history_entry_t;
+
+// Histórico das últimas mensagens públicas, em um buffer circular limitado
+// pelo número de mensagens e pelo total de bytes. As mensagens mais antigas
+// são descartadas quando algum dos limites é ultrapassado.
+typedef struct history_t {
+  // Trava que protege o histórico, usada por todos os reatores.
+  pthread_mutex_t lock;
+
+  // Buffer circular com "capacity" posições, das quais "count" estão em uso a
+  // partir de "head".
+  history_entry_t* entries;
+  size_t capacity;
+  size_t head;
+  size_t count;
+
+  // Total de bytes armazenados e seu limite.
+  size_t bytes;
+  size_t max_bytes;
+} history_t;
+
+// Inicializa um histórico vazio com até "max_msgs" mensagens e "max_bytes"
+// bytes. Caso "max_msgs" seja 0, o histórico fica desativado.
+void history_init(history_t* history, size_t max_msgs, size_t max_bytes);
+
+// Libera a memória do histórico e as referências aos quadros.
+void history_destroy(history_t* history);
+
+// Adiciona ao histórico a mensagem pública "msg", recebida no instante
+// "time_str" (no formato de "set_time_str").
+void history_push(history_t* history, const msg_view_t* msg, const char* time_str);
+
+// Armazena em "frames" os quadros, no formato "format", das mensagens do
+// histórico, da mais antiga para a mais recente, com uma referência a cada um.
+// "frames" deve comportar a capacidade do histórico. Retorna o número de
+// quadros.
+size_t history_snapshot(history_t* history, int format, shbuf_t** frames);
+
+#endif
@@ -0,0 +1,235 @@
+#include "logger.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Nível de log ativo.
+static int log_level = LOG_CHAT;
+
+// Lista dos buffers das threads que já registraram algum evento. Os buffers
+// são inseridos no início da lista e só são liberados em "logger_destroy".
+static _Atomic(log_ring_t*) rings = NULL;
+
+// Buffer da thread atual, criado no primeiro registro.
+static __thread log_ring_t* local_ring = NULL;
+
+// Relógio aproximado: o horário atual no formato de "set_time_str", armazenado
+// em um inteiro de 64 bits para que seja lido e escrito atomicamente.
+static atomic_uint_least64_t clock_str;
+
+// Minuto correspondente a "clock_str", usado pela thread de escrita.
+static time_t clock_minute = -1;
+
+static atomic_int running;
+static pthread_t writer;
+
+// Atualiza o relógio aproximado. Só é chamada pela thread de escrita e, antes
+// dela ser iniciada, por "logger_init".
+static void clock_update() {
+  time_t now = time(NULL);
+  if (now / 60 == clock_minute) {
+    return;
+  }
+  clock_minute = now / 60;
+
+  char time_str[TIME_STR_SIZE] = {0};
+  struct tm local_time;
+  localtime_r(&now, &local_time);
+  strftime(time_str, TIME_STR_SIZE, "[%H:%M]", &local_time);
+
+  uint64_t value;
+  memcpy(&value, time_str, sizeof(value));
+  atomic_store_explicit(&clock_str, value, memory_order_relaxed);
+}
+
+void logger_time_str(char* time_str) {
+  uint64_t value = atomic_load_explicit(&clock_str, memory_order_relaxed);
+  memcpy(time_str, &value, TIME_STR_SIZE);
+}
+
+int logger_enabled(int level) {
+  return level <= log_level;
+}
+
+// Retorna o buffer da thread atual, criando-o caso necessário.
+static log_ring_t* ring_get() {
+  if (local_ring != NULL) {
+    return local_ring;
+  }
+
+  log_ring_t* ring = (log_ring_t*)malloc(sizeof(log_ring_t));
+  if (ring == NULL) {
+    log_exit("malloc");
+  }
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->dropped, 0);
+
+  ring->next = atomic_load(&rings);
+  while (!atomic_compare_exchange_weak(&rings, &ring->next, ring)) {
+  }
+
+  local_ring = ring;
+  return ring;
+}
+
+// Reserva o próximo registro do buffer da thread atual. Retorna NULL caso o
+// buffer esteja cheio. O registro só se torna visível em "record_commit".
+static log_record_t* record_reserve(log_ring_t* ring) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (tail - head == LOG_RING_SIZE) {
+    atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+    return NULL;
+  }
+  return &ring->records[tail % LOG_RING_SIZE];
+}
+
+static void record_commit(log_ring_t* ring) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// Registra um evento com o texto "text", de tamanho "len".
+static void log_record(int level, int event, int id, const char* time_str, const char* text,
+                       size_t len) {
+  if (!logger_enabled(level)) {
+    return;
+  }
+
+  log_ring_t* ring = ring_get();
+  log_record_t* record = record_reserve(ring);
+  if (record == NULL) {
+    return;
+  }
+
+  record->level = level;
+  record->event = event;
+  record->id = id;
+  memcpy(record->time_str, time_str, TIME_STR_SIZE);
+  record->len = len < sizeof(record->text) ? len : sizeof(record->text);
+  memcpy(record->text, text, record->len);
+  record_commit(ring);
+}
+
+void log_event(int level, int event, int id) {
+  char time_str[TIME_STR_SIZE];
+  logger_time_str(time_str);
+  log_record(level, event, id, time_str, NULL, 0);
+}
+
+void log_chat(const char* time_str, int id, const char* text, size_t len) {
+  log_record(LOG_CHAT, LOG_EVENT_MSG, id, time_str, text, len);
+}
+
+void log_printf(int level, const char* fmt, ...) {
+  if (!logger_enabled(level)) {
+    return;
+  }
+
+  char text[BUFFER_SIZE];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(text, sizeof(text), fmt, args);
+  va_end(args);
+  if (len < 0) {
+    return;
+  }
+
+  char time_str[TIME_STR_SIZE];
+  logger_time_str(time_str);
+  log_record(level, LOG_EVENT_TEXT, NULL_ID, time_str, text,
+             (size_t)len < sizeof(text) ? (size_t)len : sizeof(text) - 1);
+}
+
+// Formata o registro "record" na sua saída: a saída de erros para LOG_ERROR e a
+// saída padrão para os demais níveis.
+static void record_write(const log_record_t* record) {
+  FILE* out = record->level == LOG_ERROR ? stderr : stdout;
+
+  switch (record->event) {
+  case LOG_EVENT_ADDED:
+    fprintf(out, "User %d added\n", record->id);
+    break;
+  case LOG_EVENT_REMOVED:
+    fprintf(out, "User %d removed\n", record->id);
+    break;
+  case LOG_EVENT_NOT_FOUND:
+    fprintf(out, "User %d not found\n", record->id);
+    break;
+  case LOG_EVENT_MSG:
+    fprintf(out, "%s %d: %.*s\n", record->time_str, record->id, (int)record->len, record->text);
+    break;
+  default:
+    fprintf(out, "%.*s\n", (int)record->len, record->text);
+  }
+}
+
+// Escreve os registros pendentes de todos os buffers. Retorna o número de
+// registros escritos.
+static size_t drain() {
+  size_t count = 0;
+
+  for (log_ring_t* ring = atomic_load(&rings); ring != NULL; ring = ring->next) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    for (; head != tail; head++) {
+      record_write(&ring->records[head % LOG_RING_SIZE]);
+      // O registro é liberado para o produtor apenas após ser formatado
+      atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+      count++;
+    }
+
+    size_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+    if (dropped > 0) {
+      fprintf(stderr, "%zu log records dropped\n", dropped);
+    }
+  }
+
+  if (count > 0) {
+    fflush(stdout);
+  }
+  return count;
+}
+
+// Thread de escrita. Os registros das threads de uma mesma verificação são
+// escritos em sequência por thread, então registros simultâneos de threads
+// diferentes podem aparecer fora de ordem.
+static void* logger_thread(void* arg) {
+  struct timespec idle = {.tv_sec = 0, .tv_nsec = LOG_FLUSH_MS * 1000000};
+
+  for (;;) {
+    int stop = !atomic_load(&running);
+    clock_update();
+    if (drain() == 0) {
+      if (stop) {
+        break;
+      }
+      nanosleep(&idle, NULL);
+    }
+  }
+
+  return NULL;
+}
+
+void logger_init(int level) {
+  log_level = level;
+  clock_update();
+
+  atomic_init(&running, 1);
+  pthread_create(&writer, NULL, logger_thread, NULL);
+}
+
+void logger_destroy() {
+  atomic_store(&running, 0);
+  pthread_join(writer, NULL);
+
+  log_ring_t* ring = atomic_exchange(&rings, NULL);
+  while (ring != NULL) {
+    log_ring_t* next = ring->next;
+    free(ring);
+    ring = next;
+  }
+}
@@ -0,0 +1,91 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "common.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Níveis de log. Cada nível inclui os anteriores: LOG_INFO registra também os
+// erros, e LOG_CHAT registra também o conteúdo das mensagens públicas.
+#define LOG_ERROR 0
+#define LOG_INFO 1
+#define LOG_CHAT 2
+
+// Eventos registrados no log. Os registros só armazenam o evento e seus
+// argumentos, e o texto é formatado pela thread de escrita.
+#define LOG_EVENT_TEXT 0      // Texto livre
+#define LOG_EVENT_ADDED 1     // "User <id> added"
+#define LOG_EVENT_REMOVED 2   // "User <id> removed"
+#define LOG_EVENT_NOT_FOUND 3 // "User <id> not found"
+#define LOG_EVENT_MSG 4       // "<horário> <id>: <texto>"
+
+// Número de registros do buffer circular de cada thread. Quando o buffer está
+// cheio, os novos registros são descartados e contabilizados, de modo que as
+// threads que registram eventos nunca aguardam a escrita.
+#define LOG_RING_SIZE 256
+
+// Intervalo, em milissegundos, entre as verificações dos buffers pela thread
+// de escrita quando não há registros. É também a precisão do relógio
+// aproximado.
+#define LOG_FLUSH_MS 10
+
+// Registro de tamanho fixo. Apenas os "len" primeiros bytes de "text" são
+// copiados.
+typedef struct log_record_t {
+  uint8_t level;
+  uint8_t event;
+  int32_t id;
+
+  // Horário do registro, no formato de "set_time_str".
+  char time_str[TIME_STR_SIZE];
+
+  uint16_t len;
+  char text[BUFFER_SIZE];
+} log_record_t;
+
+// Buffer circular de registros de uma única thread, sem travas, com um
+// produtor (a própria thread) e um consumidor (a thread de escrita).
+typedef struct log_ring_t {
+  // Próxima posição a ser escrita, alterada apenas pelo produtor, e próxima
+  // posição a ser lida, alterada apenas pelo consumidor.
+  atomic_size_t tail;
+  atomic_size_t head;
+
+  // Registros descartados por falta de espaço, ainda não informados.
+  atomic_size_t dropped;
+
+  // Próximo buffer da lista de buffers das threads.
+  struct log_ring_t* next;
+
+  log_record_t records[LOG_RING_SIZE];
+} log_ring_t;
+
+// Inicializa o log com o nível "level" e inicia a thread de escrita.
+void logger_init(int level);
+
+// Escreve os registros pendentes, encerra a thread de escrita e libera os
+// buffers.
+void logger_destroy();
+
+// Retorna 1 caso o nível "level" esteja ativo.
+int logger_enabled(int level);
+
+// Armazena em "time_str" o horário atual no formato de "set_time_str", a partir
+// do relógio aproximado mantido pela thread de escrita, sem chamadas de
+// sistema.
+void logger_time_str(char* time_str);
+
+// Registra o evento "event" do usuário "id" com o nível "level".
+void log_event(int level, int event, int id);
+
+// Registra a mensagem pública "text", de tamanho "len", enviada pelo usuário
+// "id" no horário "time_str".
+void log_chat(const char* time_str, int id, const char* text, size_t len);
+
+// Registra um texto formatado com o nível "level". A formatação é feita pela
+// thread que registra, então deve ser usada apenas fora dos caminhos
+// frequentes.
+void log_printf(int level, const char* fmt, ...);
+
+#endif
@@ -0,0 +1,328 @@
+#include "lz.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <string.h>
+
+// Tamanho mínimo de uma repetição. Repetições menores são codificadas como
+// literais.
+#define LZ_MIN_MATCH 4
+
+// Número de bits da tabela de hash usada para encontrar repetições.
+#define LZ_HASH_BITS 10
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+
+// Dicionário compartilhado, com trechos comuns nas mensagens do chat. Ele é
+// tratado como se precedesse o conteúdo, de modo que as repetições podem
+// apontar para ele já no início de mensagens curtas. Alterar o dicionário
+// exige uma nova versão de CAP_LZ.
+static const char dict[] =
+    "User limit exceeded. User not found. Receiver not found. Removed Successfully. "
+    "joined the group! has left the group. Private message from Message from "
+    "http://www. https://www. .com/ .html "
+    "I don't know. I think that we should it is not what are you doing? "
+    "Thank you! thanks, please, hello everyone, good morning, good night, "
+    "and the of the in the to the for the with the on the at the from the "
+    "this that there their they them then than when where which while what who "
+    "would could should have been will be about after before because really "
+    "ahahahahahaha hahahahaha kkkkkkkkkk lol ok okay yes no maybe sure right "
+    "something anything everything nothing people time today tomorrow yesterday ";
+
+#define DICT_SIZE (sizeof(dict) - 1)
+
+// Tabela de hash do dicionário, com a última posição (mais um) em que cada hash
+// ocorre, calculada uma única vez.
+static uint16_t dict_table[LZ_HASH_SIZE];
+static pthread_once_t dict_once = PTHREAD_ONCE_INIT;
+
+static uint32_t read_u32(const char* ptr) {
+  uint32_t value;
+  memcpy(&value, ptr, sizeof(uint32_t));
+  return value;
+}
+
+static unsigned hash(uint32_t value) {
+  return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void dict_init() {
+  for (size_t pos = 0; pos + LZ_MIN_MATCH <= DICT_SIZE; pos++) {
+    dict_table[hash(read_u32(dict + pos))] = pos + 1;
+  }
+}
+
+// Retorna o byte na posição "pos" da concatenação do dicionário com "src".
+static inline char byte_at(const char* src, size_t pos) {
+  return pos < DICT_SIZE ? dict[pos] : src[pos - DICT_SIZE];
+}
+
+// Escreve em "dst" o tamanho "len" estendido com bytes 255, como no LZ4, caso
+// ele não caiba nos 4 bits do token. Retorna o ponteiro após os bytes escritos,
+// ou NULL caso eles ultrapassem "end".
+static char* put_length(char* dst, const char* end, size_t len) {
+  if (len < 15) {
+    return dst;
+  }
+
+  len -= 15;
+  while (1) {
+    if (dst >= end) {
+      return NULL;
+    }
+    if (len < 255) {
+      *dst++ = (char)len;
+      return dst;
+    }
+    *dst++ = (char)255;
+    len -= 255;
+  }
+}
+
+// Escreve uma sequência com "lit_len" literais a partir de "lit" seguidos de
+// uma repetição de "match_len" bytes a "offset" bytes de distância. A última
+// sequência tem apenas literais ("match_len" igual a 0). Retorna o ponteiro
+// após a sequência, ou NULL caso ela ultrapasse "end".
+static char* put_sequence(char* dst, const char* end, const char* lit, size_t lit_len,
+                          size_t offset, size_t match_len) {
+  if (dst >= end) {
+    return NULL;
+  }
+
+  size_t match_code = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+  *dst++ = (char)(((lit_len < 15 ? lit_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+
+  dst = put_length(dst, end, lit_len);
+  if (dst == NULL || (size_t)(end - dst) < lit_len) {
+    return NULL;
+  }
+  memcpy(dst, lit, lit_len);
+  dst += lit_len;
+
+  if (match_len == 0) {
+    return dst;
+  }
+
+  if (end - dst < 2) {
+    return NULL;
+  }
+  *dst++ = (char)(offset & 0xFF);
+  *dst++ = (char)(offset >> 8);
+
+  return put_length(dst, end, match_code);
+}
+
+size_t lz_compress(const char* src, size_t len, char* dst, size_t cap) {
+  pthread_once(&dict_once, dict_init);
+
+  // As posições são contadas a partir do início do dicionário, e cada entrada
+  // guarda a posição mais um, de modo que 0 indica uma entrada vazia. O
+  // conteúdo de uma mensagem cabe em BUFFER_SIZE, então as posições cabem em
+  // 16 bits.
+  uint16_t table[LZ_HASH_SIZE];
+  memset(table, 0, sizeof(table));
+
+  char* out = dst;
+  const char* end = dst + cap;
+  size_t anchor = 0;
+  size_t pos = 0;
+
+  while (pos + LZ_MIN_MATCH <= len) {
+    uint32_t value = read_u32(src + pos);
+    unsigned h = hash(value);
+    size_t cur = DICT_SIZE + pos;
+    size_t entry = table[h] != 0 ? table[h] : dict_table[h];
+    table[h] = cur + 1;
+    if (entry == 0) {
+      pos++;
+      continue;
+    }
+
+    size_t cand = entry - 1;
+    size_t match_len = 0;
+    while (pos + match_len < len && byte_at(src, cand + match_len) == src[pos + match_len]) {
+      match_len++;
+    }
+    if (match_len < LZ_MIN_MATCH) {
+      pos++;
+      continue;
+    }
+
+    out = put_sequence(out, end, src + anchor, pos - anchor, cur - cand, match_len);
+    if (out == NULL) {
+      return 0;
+    }
+
+    pos += match_len;
+    anchor = pos;
+  }
+
+  out = put_sequence(out, end, src + anchor, len - anchor, 0, 0);
+  return out == NULL ? 0 : (size_t)(out - dst);
+}
+
+// Lê de "src" a extensão de um tamanho cujo valor no token é "len", avançando
+// "src". Retorna o tamanho, ou -1 caso a extensão ultrapasse "end".
+static long get_length(const unsigned char** src, const unsigned char* end, size_t len) {
+  if (len < 15) {
+    return len;
+  }
+
+  while (1) {
+    if (*src >= end) {
+      return -1;
+    }
+    unsigned char byte = *(*src)++;
+    len += byte;
+    if (byte < 255) {
+      return len;
+    }
+  }
+}
+
+long lz_decompress(const char* src, size_t len, char* dst, size_t cap) {
+  const unsigned char* in = (const unsigned char*)src;
+  const unsigned char* in_end = in + len;
+  size_t out = 0;
+
+  while (in < in_end) {
+    unsigned char token = *in++;
+
+    long lit_len = get_length(&in, in_end, token >> 4);
+    if (lit_len < 0 || in_end - in < lit_len || cap - out < (size_t)lit_len) {
+      return -1;
+    }
+    memcpy(dst + out, in, lit_len);
+    in += lit_len;
+    out += lit_len;
+
+    // A última sequência termina após os literais
+    if (in == in_end) {
+      break;
+    }
+
+    if (in_end - in < 2) {
+      return -1;
+    }
+    size_t offset = in[0] | (size_t)in[1] << 8;
+    in += 2;
+
+    long match_len = get_length(&in, in_end, token & 0x0F);
+    if (match_len < 0) {
+      return -1;
+    }
+    match_len += LZ_MIN_MATCH;
+
+    size_t from = DICT_SIZE + out;
+    if (offset == 0 || offset > from || cap - out < (size_t)match_len) {
+      return -1;
+    }
+    from -= offset;
+
+    // A parte da repetição que está no dicionário é copiada primeiro. O
+    // restante pode se sobrepor aos bytes que ele mesmo escreve, e nesse caso
+    // é copiado byte a byte
+    if (from < DICT_SIZE) {
+      size_t len = DICT_SIZE - from < (size_t)match_len ? DICT_SIZE - from : (size_t)match_len;
+      memcpy(dst + out, dict + from, len);
+      out += len;
+      from += len;
+      match_len -= len;
+    }
+    from -= DICT_SIZE;
+    if (offset >= (size_t)match_len) {
+      memcpy(dst + out, dst + from, match_len);
+      out += match_len;
+    } else {
+      for (long i = 0; i < match_len; i++) {
+        dst[out++] = dst[from++];
+      }
+    }
+  }
+
+  return out;
+}
+
+int encode_lz(const msg_view_t* msg, char* outBuf) {
+  if (msg->len < LZ_MIN_SIZE) {
+    return encode_bin(msg, outBuf);
+  }
+
+  size_t hdr_len = encode_bin_header(msg, outBuf);
+  size_t max_len = BUFFER_SIZE - 1 - hdr_len;
+  size_t len = msg->len < max_len ? msg->len : max_len;
+
+  // O conteúdo compactado, junto com o tamanho original, precisa ser menor que
+  // o conteúdo original
+  char* payload = outBuf + hdr_len + sizeof(uint16_t);
+  size_t compressed = lz_compress(msg->message, len, payload, len - sizeof(uint16_t) - 1);
+  if (compressed == 0) {
+    return encode_bin(msg, outBuf);
+  }
+
+  uint16_t original_len = htons(len);
+  memcpy(outBuf + hdr_len, &original_len, sizeof(uint16_t));
+
+  uint16_t payload_len = htons(sizeof(uint16_t) + compressed);
+  outBuf[1] |= WIRE_FLAG_COMPRESSED;
+  memcpy(outBuf + 2, &payload_len, sizeof(uint16_t));
+
+  return hdr_len + sizeof(uint16_t) + compressed;
+}
+
+int is_compressed_msg(const char* inBuf, size_t len) {
+  return len >= WIRE_HDR_SIZE && (inBuf[1] & WIRE_FLAG_COMPRESSED);
+}
+
+// Lê o cabeçalho da mensagem compactada "inBuf", de tamanho "len", escrevendo
+// em "hdr_len" o tamanho do cabeçalho e em "original_len" o tamanho do conteúdo
+// sem compactação. Retorna 1 caso o cabeçalho seja válido e 0 caso contrário.
+static int lz_header(const char* inBuf, size_t len, size_t* hdr_len, uint16_t* original_len) {
+  if (len < WIRE_HDR_SIZE)
+    return 0;
+
+  *hdr_len = WIRE_HDR_SIZE + (inBuf[1] & WIRE_FLAG_REQ_ID ? WIRE_REQ_ID_SIZE : 0);
+  if (len < *hdr_len + sizeof(uint16_t))
+    return 0;
+
+  memcpy(original_len, inBuf + *hdr_len, sizeof(uint16_t));
+  *original_len = ntohs(*original_len);
+  return *hdr_len + *original_len <= BUFFER_SIZE - 1;
+}
+
+int lz_peek_msg(msg_view_t* msg, const char* inBuf, size_t len) {
+  size_t hdr_len;
+  uint16_t original_len;
+  if (!lz_header(inBuf, len, &hdr_len, &original_len))
+    return 0;
+
+  // O cabeçalho é decodificado como o de uma mensagem sem conteúdo
+  char header[WIRE_HDR_SIZE + WIRE_REQ_ID_SIZE];
+  memcpy(header, inBuf, hdr_len);
+  header[1] &= ~WIRE_FLAG_COMPRESSED;
+  memset(header + 2, 0, sizeof(uint16_t));
+  if (decode_bin(msg, header, hdr_len) == 0)
+    return 0;
+
+  msg->message = NULL;
+  msg->len = original_len;
+  return 1;
+}
+
+int lz_inflate_msg(const char* inBuf, size_t len, char* outBuf, size_t* out_len) {
+  size_t hdr_len;
+  uint16_t original_len;
+  if (!lz_header(inBuf, len, &hdr_len, &original_len))
+    return 0;
+
+  const char* payload = inBuf + hdr_len + sizeof(uint16_t);
+  size_t payload_len = len - hdr_len - sizeof(uint16_t);
+  if (lz_decompress(payload, payload_len, outBuf + hdr_len, original_len) != original_len)
+    return 0;
+
+  memcpy(outBuf, inBuf, hdr_len);
+  outBuf[1] &= ~WIRE_FLAG_COMPRESSED;
+  uint16_t new_len = htons(original_len);
+  memcpy(outBuf + 2, &new_len, sizeof(uint16_t));
+  *out_len = hdr_len + original_len;
+
+  return 1;
+}
@@ -0,0 +1,53 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include "common.h"
+#include <stddef.h>
+
+// Compactação das mensagens no formato binário, negociada no REQ_ADD com a
+// capacidade CAP_LZ (junto com CAP_BINARY). O conteúdo de uma mensagem
+// compactada, indicada pela flag WIRE_FLAG_COMPRESSED do cabeçalho, é o tamanho
+// original (16 bits, na representação de rede) seguido do conteúdo compactado
+// com um codec LZ77 no formato de blocos do LZ4. Todas as conexões usam o mesmo
+// dicionário estático, com trechos comuns nas mensagens do chat, de modo que um
+// broadcast é compactado uma única vez para todos os destinatários que usam a
+// compactação. O servidor aceita a compactação sempre que aceita o formato
+// binário, então o cliente passa a compactar as suas mensagens quando a
+// resposta ao REQ_ADD está no formato binário.
+#define CAP_LZ "LZ1"
+
+// Tamanho mínimo do conteúdo para que a mensagem seja compactada. As mensagens
+// menores são enviadas sem compactação, já que o ganho não compensa o custo.
+#define LZ_MIN_SIZE 64
+
+// Compacta os "len" bytes de "src" em "dst", que comporta até "cap" bytes.
+// Retorna o tamanho compactado, ou 0 caso ele ultrapasse "cap".
+size_t lz_compress(const char* src, size_t len, char* dst, size_t cap);
+
+// Descompacta os "len" bytes de "src" em "dst", que comporta até "cap" bytes.
+// Retorna o tamanho descompactado, ou -1 caso os dados sejam inválidos ou não
+// caibam em "dst".
+long lz_decompress(const char* src, size_t len, char* dst, size_t cap);
+
+// Faz a codificação de uma visão de mensagem para o formato binário,
+// compactando o conteúdo caso ele tenha pelo menos LZ_MIN_SIZE bytes e a
+// compactação reduza o seu tamanho. Retorna o tamanho da mensagem codificada.
+int encode_lz(const msg_view_t* msg, char* outBuf);
+
+// Retorna 1 caso a mensagem binária "inBuf", de tamanho "len", esteja
+// compactada.
+int is_compressed_msg(const char* inBuf, size_t len);
+
+// Decodifica em "msg" apenas o cabeçalho da mensagem binária compactada "inBuf",
+// de tamanho "len", sem descompactá-la. O campo "len" recebe o tamanho do
+// conteúdo sem compactação, e "message" é NULL. Retorna 1 caso o cabeçalho seja
+// válido e 0 caso contrário.
+int lz_peek_msg(msg_view_t* msg, const char* inBuf, size_t len);
+
+// Descompacta a mensagem binária compactada "inBuf", de tamanho "len",
+// escrevendo em "outBuf" a mesma mensagem sem compactação e em "out_len" o seu
+// tamanho, que é no máximo BUFFER_SIZE - 1. Retorna 1 caso a descompactação
+// tenha sido bem sucedida e 0 caso contrário.
+int lz_inflate_msg(const char* inBuf, size_t len, char* outBuf, size_t* out_len);
+
+#endif
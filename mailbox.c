@@ -0,0 +1,96 @@
+#include "mailbox.h"
+#include "common.h"
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+void mailbox_init(mailbox_t* mb) {
+  atomic_init(&mb->stub.next, NULL);
+  atomic_init(&mb->head, &mb->stub);
+  mb->tail = &mb->stub;
+  atomic_init(&mb->pending, 0);
+
+  mb->event_fd = eventfd(0, EFD_NONBLOCK);
+  if (mb->event_fd == -1) {
+    log_exit("eventfd");
+  }
+}
+
+void mailbox_destroy(mailbox_t* mb) {
+  close(mb->event_fd);
+}
+
+// Insere o nó na fila, sem notificar o consumidor.
+static void push(mailbox_t* mb, mailbox_node_t* node) {
+  atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+  mailbox_node_t* prev = atomic_exchange_explicit(&mb->head, node, memory_order_acq_rel);
+  // Entre a troca acima e a escrita abaixo, o nó ainda não é visível para o
+  // consumidor
+  atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+void mailbox_post(mailbox_t* mb, mailbox_node_t* node) {
+  push(mb, node);
+
+  // Apenas o produtor que encontra a caixa sem notificação pendente escreve no
+  // eventfd
+  if (atomic_exchange(&mb->pending, 1) == 0) {
+    uint64_t value = 1;
+    while (write(mb->event_fd, &value, sizeof(value)) < 0) {
+      if (errno != EINTR && errno != EAGAIN) {
+        log_exit("write");
+      }
+    }
+  }
+}
+
+void mailbox_ack(mailbox_t* mb) {
+  uint64_t value;
+  while (read(mb->event_fd, &value, sizeof(value)) < 0) {
+    if (errno == EAGAIN) {
+      break;
+    } else if (errno != EINTR) {
+      log_exit("read");
+    }
+  }
+
+  // Os itens inseridos a partir daqui geram uma nova notificação
+  atomic_store(&mb->pending, 0);
+}
+
+mailbox_node_t* mailbox_pop(mailbox_t* mb) {
+  mailbox_node_t* tail = mb->tail;
+  mailbox_node_t* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+  // O nó auxiliar é pulado
+  if (tail == &mb->stub) {
+    if (next == NULL) {
+      return NULL;
+    }
+    mb->tail = next;
+    tail = next;
+    next = atomic_load_explicit(&next->next, memory_order_acquire);
+  }
+
+  if (next != NULL) {
+    mb->tail = next;
+    return tail;
+  }
+
+  // O nó "tail" é o último da fila, mas só pode ser removido depois que o nó
+  // auxiliar for inserido após ele
+  if (tail != atomic_load_explicit(&mb->head, memory_order_acquire)) {
+    return NULL;
+  }
+
+  push(mb, &mb->stub);
+
+  next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  if (next != NULL) {
+    mb->tail = next;
+    return tail;
+  }
+
+  return NULL;
+}
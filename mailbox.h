@@ -0,0 +1,54 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <stdatomic.h>
+
+// Nó de uma caixa de mensagens. Deve ser o primeiro campo da estrutura que
+// representa cada item, de modo que o item possa ser obtido a partir do nó.
+typedef struct mailbox_node_t {
+  _Atomic(struct mailbox_node_t*) next;
+} mailbox_node_t;
+
+// Caixa de mensagens de um reator: uma fila sem travas com vários produtores
+// (as threads dos demais reatores) e um único consumidor (a thread do próprio
+// reator). O consumidor é acordado por um eventfd, que só é escrito quando a
+// caixa passa de vazia para não vazia, evitando uma chamada de sistema por
+// item.
+typedef struct mailbox_t {
+  // Último nó inserido, alterado pelos produtores.
+  _Atomic(mailbox_node_t*) head;
+
+  // Próximo nó a ser removido, alterado apenas pelo consumidor.
+  mailbox_node_t* tail;
+
+  // Nó auxiliar, que permite que a fila nunca fique sem nós.
+  mailbox_node_t stub;
+
+  // Indica que o consumidor já foi acordado e ainda não esvaziou a caixa.
+  atomic_int pending;
+
+  // File descriptor do eventfd usado para acordar o consumidor.
+  int event_fd;
+} mailbox_t;
+
+// Inicializa uma caixa de mensagens vazia.
+void mailbox_init(mailbox_t* mb);
+
+// Libera os recursos da caixa de mensagens. Os itens restantes não são
+// liberados.
+void mailbox_destroy(mailbox_t* mb);
+
+// Insere o nó "node" no final da caixa e acorda o consumidor, caso necessário.
+// Pode ser chamada por várias threads simultaneamente.
+void mailbox_post(mailbox_t* mb, mailbox_node_t* node);
+
+// Consome a notificação do eventfd. Deve ser chamada pelo consumidor antes de
+// esvaziar a caixa com "mailbox_pop".
+void mailbox_ack(mailbox_t* mb);
+
+// Remove o primeiro nó da caixa. Retorna NULL caso a caixa esteja vazia ou
+// caso um produtor ainda esteja concluindo uma inserção, que nesse caso gera
+// uma nova notificação. Deve ser chamada apenas pelo consumidor.
+mailbox_node_t* mailbox_pop(mailbox_t* mb);
+
+#endif
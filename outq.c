@@ -0,0 +1,203 @@
+#include "outq.h"
+#include "common.h"
+#include "lz.h"
+#include "pool.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+shbuf_t* shbuf_new(size_t len) {
+  shbuf_t* buf = (shbuf_t*)pool_alloc(sizeof(shbuf_t) + len);
+  atomic_init(&buf->refs, 1);
+  buf->len = len;
+
+  return buf;
+}
+
+shbuf_t* shbuf_frame(const char* payload, size_t len) {
+  shbuf_t* buf = shbuf_new(sizeof(uint16_t) + len);
+
+  // Faz a conversão para a representação de rede
+  uint16_t msg_size = htons(len);
+  memcpy(buf->data, &msg_size, sizeof(uint16_t));
+  memcpy(buf->data + sizeof(uint16_t), payload, len);
+
+  return buf;
+}
+
+shbuf_t* shbuf_msg(const msg_view_t* msg, int format) {
+  // A mensagem compactada só tem tamanho conhecido após a compactação
+  if (format == FORMAT_LZ && msg->len >= LZ_MIN_SIZE) {
+    char buffer[BUFFER_SIZE];
+    int len = encode_lz(msg, buffer);
+    return shbuf_frame(buffer, len);
+  }
+
+  // O tamanho do quadro é conhecido antes da codificação, então o buffer é
+  // alocado com o tamanho exato e o conteúdo é copiado uma única vez. Os
+  // cabeçalhos têm no máximo três inteiros e três separadores
+  char header[64];
+  size_t hdr_len = format == FORMAT_TEXT ? encode_view_header(msg, header)
+                                         : encode_bin_header(msg, header);
+  size_t max_len = BUFFER_SIZE - 1 - hdr_len;
+  size_t payload_len = msg->len < max_len ? msg->len : max_len;
+
+  shbuf_t* buf = shbuf_new(sizeof(uint16_t) + hdr_len + payload_len);
+  uint16_t msg_size = htons(hdr_len + payload_len);
+  memcpy(buf->data, &msg_size, sizeof(uint16_t));
+  memcpy(buf->data + sizeof(uint16_t), header, hdr_len);
+  memcpy(buf->data + sizeof(uint16_t) + hdr_len, msg->message, payload_len);
+
+  return buf;
+}
+
+void shbuf_ref(shbuf_t* buf) {
+  atomic_fetch_add_explicit(&buf->refs, 1, memory_order_relaxed);
+}
+
+void shbuf_unref(shbuf_t* buf) {
+  if (atomic_fetch_sub_explicit(&buf->refs, 1, memory_order_acq_rel) == 1) {
+    pool_free(buf);
+  }
+}
+
+void outq_init(outq_t* q) {
+  memset(q, 0, sizeof(*q));
+}
+
+void outq_push(outq_t* q, const outq_slice_t* slices, int n) {
+  for (int i = 0; i < n; i++) {
+    outq_seg_t* seg = (outq_seg_t*)pool_alloc(sizeof(outq_seg_t));
+
+    shbuf_ref(slices[i].buf);
+    seg->slice = slices[i];
+    seg->first = i == 0;
+    seg->next = NULL;
+
+    if (q->tail == NULL) {
+      q->head = seg;
+    } else {
+      q->tail->next = seg;
+    }
+    q->tail = seg;
+    q->bytes += seg->slice.len;
+  }
+
+  q->frames++;
+}
+
+// Remove o segmento "seg", que vem logo após "prev" (ou é o primeiro da fila,
+// caso "prev" seja nulo), e libera sua referência ao buffer.
+static void remove_seg(outq_t* q, outq_seg_t* prev, outq_seg_t* seg) {
+  if (prev == NULL) {
+    q->head = seg->next;
+  } else {
+    prev->next = seg->next;
+  }
+  if (q->tail == seg) {
+    q->tail = prev;
+  }
+
+  q->bytes -= seg->slice.len;
+  shbuf_unref(seg->slice.buf);
+  pool_free(seg);
+}
+
+// Remove o primeiro segmento da fila.
+static void pop_head(outq_t* q) {
+  outq_seg_t* next = q->head->next;
+  if (next == NULL || next->first) {
+    q->frames--;
+  }
+
+  remove_seg(q, NULL, q->head);
+  q->offset = 0;
+}
+
+int outq_iov(const outq_t* q, struct iovec* iov, int max) {
+  int iovcnt = 0;
+  for (outq_seg_t* seg = q->head; seg != NULL && iovcnt < max; seg = seg->next) {
+    size_t skip = iovcnt == 0 ? q->offset : 0;
+    iov[iovcnt].iov_base = seg->slice.buf->data + seg->slice.off + skip;
+    iov[iovcnt].iov_len = seg->slice.len - skip;
+    iovcnt++;
+  }
+
+  return iovcnt;
+}
+
+void outq_consume(outq_t* q, size_t count) {
+  // Remove os segmentos que foram enviados por completo
+  while (count > 0) {
+    size_t remaining = q->head->slice.len - q->offset;
+    if (count < remaining) {
+      q->offset += count;
+      break;
+    }
+
+    count -= remaining;
+    pop_head(q);
+  }
+}
+
+int outq_flush(outq_t* q, int socket) {
+  while (q->head != NULL) {
+    struct iovec iov[OUTQ_IOV_MAX];
+    int iovcnt = outq_iov(q, iov, OUTQ_IOV_MAX);
+
+    // MSG_NOSIGNAL evita que o processo receba SIGPIPE caso o cliente tenha
+    // fechado a conexão
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iovcnt};
+    ssize_t count = sendmsg(socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (count < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+      } else if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+
+    outq_consume(q, count);
+  }
+
+  return 1;
+}
+
+size_t outq_drop_oldest(outq_t* q, size_t max_bytes) {
+  // O quadro do primeiro segmento é mantido caso já tenha sido enviado
+  // parcialmente, para não corromper o fluxo de bytes da conexão
+  outq_seg_t* prev = NULL;
+  outq_seg_t* seg = q->head;
+  if (seg != NULL && (q->offset > 0 || !seg->first)) {
+    do {
+      prev = seg;
+      seg = seg->next;
+    } while (seg != NULL && !seg->first);
+  }
+
+  size_t dropped = 0;
+  while (seg != NULL && q->bytes > max_bytes) {
+    // Remove todos os segmentos do quadro
+    do {
+      outq_seg_t* next = seg->next;
+      remove_seg(q, prev, seg);
+      seg = next;
+    } while (seg != NULL && !seg->first);
+
+    q->frames--;
+    dropped++;
+  }
+
+  return dropped;
+}
+
+void outq_clear(outq_t* q) {
+  while (q->head != NULL) {
+    pop_head(q);
+  }
+}
@@ -0,0 +1,113 @@
+#ifndef OUTQ_H
+#define OUTQ_H
+
+#include "common.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+// Número máximo de segmentos enviados em uma única chamada de writev.
+#define OUTQ_IOV_MAX 64
+
+// Buffer imutável compartilhado por várias filas de saída. A memória é liberada
+// quando a última referência é removida, o que permite que um broadcast seja
+// codificado uma única vez e enviado a todos os destinatários sem cópias.
+typedef struct shbuf_t {
+  // Número de referências ao buffer.
+  atomic_int refs;
+
+  // Tamanho do buffer.
+  size_t len;
+
+  // Bytes do buffer.
+  char data[];
+} shbuf_t;
+
+// Trecho de um buffer compartilhado.
+typedef struct outq_slice_t {
+  shbuf_t* buf;
+  size_t off;
+  size_t len;
+} outq_slice_t;
+
+// Segmento da fila de saída, que referencia um trecho de um buffer
+// compartilhado. Um quadro pode ser formado por vários segmentos consecutivos.
+typedef struct outq_seg_t {
+  // Próximo segmento da fila.
+  struct outq_seg_t* next;
+
+  // Trecho referenciado pelo segmento.
+  outq_slice_t slice;
+
+  // Indica se o segmento é o primeiro do seu quadro.
+  int first;
+} outq_seg_t;
+
+// Fila de saída de uma conexão. Os segmentos são enviados na ordem em que foram
+// inseridos, e o primeiro segmento pode ter sido enviado parcialmente.
+typedef struct outq_t {
+  // Primeiro e último segmentos da fila.
+  outq_seg_t* head;
+  outq_seg_t* tail;
+
+  // Bytes do primeiro segmento que já foram enviados.
+  size_t offset;
+
+  // Total de bytes na fila, incluindo os que já foram enviados do primeiro
+  // segmento.
+  size_t bytes;
+
+  // Número de quadros na fila.
+  size_t frames;
+} outq_t;
+
+// Cria um buffer compartilhado de tamanho "len", com uma referência. A memória
+// é obtida do pool de blocos por classe de tamanho.
+shbuf_t* shbuf_new(size_t len);
+
+// Cria um buffer compartilhado com o quadro da mensagem "payload", de tamanho
+// "len": o cabeçalho de 16 bits com o tamanho, seguido pelo conteúdo.
+shbuf_t* shbuf_frame(const char* payload, size_t len);
+
+// Cria um buffer compartilhado com o quadro da mensagem "msg" codificada no
+// formato "format" (FORMAT_TEXT, FORMAT_BINARY ou FORMAT_LZ). O buffer tem o
+// tamanho exato do quadro, e o conteúdo é truncado como em "encode_bin" e
+// "encode_view".
+shbuf_t* shbuf_msg(const msg_view_t* msg, int format);
+
+// Adiciona uma referência ao buffer "buf".
+void shbuf_ref(shbuf_t* buf);
+
+// Remove uma referência do buffer "buf", liberando-o caso seja a última.
+void shbuf_unref(shbuf_t* buf);
+
+// Inicializa uma fila vazia.
+void outq_init(outq_t* q);
+
+// Insere no final da fila um quadro formado pelos "n" trechos de "slices". A
+// fila adiciona uma referência a cada buffer usado.
+void outq_push(outq_t* q, const outq_slice_t* slices, int n);
+
+// Preenche "iov" com até "max" segmentos do início da fila, a partir do
+// primeiro byte ainda não enviado. Retorna o número de segmentos preenchidos.
+int outq_iov(const outq_t* q, struct iovec* iov, int max);
+
+// Remove da fila os "count" primeiros bytes ainda não enviados, que devem ter
+// sido enviados com sucesso.
+void outq_consume(outq_t* q, size_t count);
+
+// Envia o máximo possível de bytes da fila no socket não bloqueante "socket",
+// agrupando vários segmentos em cada chamada de writev. Retorna 1 caso a fila
+// tenha sido esvaziada, 0 caso o socket não aceite mais dados no momento e -1
+// em caso de erro.
+int outq_flush(outq_t* q, int socket);
+
+// Descarta os quadros mais antigos que ainda não começaram a ser enviados até
+// que a fila tenha no máximo "max_bytes" bytes. Retorna o número de quadros
+// descartados.
+size_t outq_drop_oldest(outq_t* q, size_t max_bytes);
+
+// Descarta todos os quadros da fila.
+void outq_clear(outq_t* q);
+
+#endif
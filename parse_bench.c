@@ -0,0 +1,260 @@
+#include "common.h"
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Comparação da decodificação de mensagens no formato de texto: um buffer de
+// recebimento é preenchido com quadros MSG, como os que o servidor recebe, e
+// os quadros são decodificados repetidamente pela implementação anterior,
+// baseada em strtok_r, e por "frame_reader_batch". Para cada uma, é reportado o
+// tempo médio por quadro e a vazão em bytes de quadros por segundo.
+
+// Valores padrão das opções.
+#define DEFAULT_MIN_SIZE 32
+#define DEFAULT_MAX_SIZE 256
+#define DEFAULT_ROUNDS 200000
+
+// Número máximo de quadros decodificados em cada lote.
+#define FRAME_BATCH_SIZE 64
+
+// Resultado de uma rodada, usado para verificar que as implementações
+// decodificam os mesmos valores e para que a decodificação não seja eliminada
+// pelo compilador.
+typedef struct checksum_t {
+  uint64_t frames;
+  uint64_t fields;
+  uint64_t bytes;
+} checksum_t;
+
+// Implementação anterior de "is_number", mantida para comparação.
+static int legacy_is_number(const char* str, size_t len) {
+  if (!isdigit(str[0]) && (str[0] != '-' || len == 1)) {
+    return 0;
+  }
+
+  for (int i = 1; i < len; i++) {
+    if (!isdigit(str[i]))
+      return 0;
+  }
+
+  return 1;
+}
+
+// Implementação anterior de "decode", mantida para comparação. O conteúdo termina
+// no separador seguinte, e "inBuf" precisa ser terminado por caractere nulo.
+static int legacy_decode(msg_t* msg, char* inBuf) {
+  char* token;
+  char* saveptr;
+  char delim[2] = {SEPARATOR, '\0'};
+
+  token = strtok_r(inBuf, delim, &saveptr);
+  if (token == NULL || !legacy_is_number(token, strlen(token)))
+    return 0;
+  msg->id_msg = atoi(token);
+
+  token = strtok_r(NULL, delim, &saveptr);
+  if (token == NULL || !legacy_is_number(token, strlen(token)))
+    return 0;
+  msg->id_receiver = atoi(token);
+
+  token = strtok_r(NULL, delim, &saveptr);
+  if (token == NULL || !legacy_is_number(token, strlen(token)))
+    return 0;
+  msg->id_sender = atoi(token);
+  msg->req_id = 0;
+
+  token = strtok_r(NULL, delim, &saveptr);
+  if (token == NULL)
+    return 0;
+
+  strcpy(msg->message, token);
+
+  return 1;
+}
+
+// Implementação anterior de "decode_view", mantida para comparação. "inBuf"
+// precisa ser terminado por caractere nulo.
+static int legacy_decode_view(msg_view_t* msg, char* inBuf) {
+  char* token;
+  char* saveptr;
+  char delim[2] = {SEPARATOR, '\0'};
+  int fields[3];
+
+  token = strtok_r(inBuf, delim, &saveptr);
+  for (int i = 0; i < 3; i++) {
+    if (token == NULL || !legacy_is_number(token, strlen(token)))
+      return 0;
+    fields[i] = atoi(token);
+    token = strtok_r(NULL, i < 2 ? delim : "", &saveptr);
+  }
+
+  if (token == NULL)
+    return 0;
+
+  msg->id_msg = fields[0];
+  msg->id_receiver = fields[1];
+  msg->id_sender = fields[2];
+  msg->req_id = 0;
+  msg->message = token;
+  msg->len = strlen(token);
+
+  return 1;
+}
+
+// Soma os campos da mensagem "msg" ao resultado "sum".
+static void checksum_add(checksum_t* sum, const msg_view_t* msg) {
+  sum->frames++;
+  sum->fields += msg->id_msg + msg->id_receiver + msg->id_sender;
+  sum->bytes += msg->len;
+}
+
+// Decodifica todos os quadros do leitor como o servidor fazia antes: cada
+// quadro é copiado para um buffer, terminado por caractere nulo, e
+// decodificado por "legacy_decode", que copia o conteúdo.
+static void round_decode(frame_reader_t* reader, checksum_t* sum) {
+  char buffer[BUFFER_SIZE];
+  msg_t msg;
+  char* frame;
+  size_t len;
+  while (frame_reader_next(reader, &frame, &len) == 1) {
+    memcpy(buffer, frame, len);
+    buffer[len] = '\0';
+    if (legacy_decode(&msg, buffer) == 0) {
+      parse_error();
+    }
+
+    msg_view_t view = {.id_msg = msg.id_msg,
+                       .id_sender = msg.id_sender,
+                       .id_receiver = msg.id_receiver,
+                       .message = msg.message,
+                       .len = strlen(msg.message)};
+    checksum_add(sum, &view);
+  }
+}
+
+// Decodifica todos os quadros do leitor com "legacy_decode_view", após copiar
+// cada quadro para um buffer terminado por caractere nulo.
+static void round_decode_view(frame_reader_t* reader, checksum_t* sum) {
+  char buffer[BUFFER_SIZE];
+  msg_view_t msg = {0};
+  char* frame;
+  size_t len;
+  while (frame_reader_next(reader, &frame, &len) == 1) {
+    memcpy(buffer, frame, len);
+    buffer[len] = '\0';
+    if (legacy_decode_view(&msg, buffer) == 0) {
+      parse_error();
+    }
+    checksum_add(sum, &msg);
+  }
+}
+
+// Decodifica todos os quadros do leitor em lotes, sem cópia.
+static void round_batch(frame_reader_t* reader, checksum_t* sum) {
+  frame_view_t frames[FRAME_BATCH_SIZE];
+  size_t count;
+  do {
+    count = frame_reader_batch(reader, frames, FRAME_BATCH_SIZE, 0);
+    for (size_t i = 0; i < count; i++) {
+      checksum_add(sum, &frames[i].msg);
+    }
+  } while (count == FRAME_BATCH_SIZE);
+
+  if (reader->start != reader->end) {
+    parse_error();
+  }
+}
+
+// Executa "rounds" rodadas da função "round" sobre os quadros do leitor
+// "reader", que contém "bytes" bytes, e reporta o resultado com o nome "name".
+static void run(const char* name, void (*round)(frame_reader_t*, checksum_t*),
+                frame_reader_t* reader, size_t bytes, long rounds, checksum_t* sum) {
+  memset(sum, 0, sizeof(*sum));
+
+  uint64_t start = now_ns();
+  for (long i = 0; i < rounds; i++) {
+    reader->start = 0;
+    round(reader, sum);
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  printf("%-22s %8.1f ns/frame %10.1f MB/s\n", name, (double)elapsed / sum->frames,
+         (double)bytes * rounds * 1000 / elapsed);
+}
+
+void usage(const char* bin) {
+  eprintf("Usage: %s [-s size|min:max] [-r rounds]\n", bin);
+  eprintf("Example: %s -s 64:512 -r 100000\n", bin);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+  int min_size = DEFAULT_MIN_SIZE;
+  int max_size = DEFAULT_MAX_SIZE;
+  long rounds = DEFAULT_ROUNDS;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:r:")) != -1) {
+    switch (opt) {
+    case 's':
+      if (sscanf(optarg, "%d:%d", &min_size, &max_size) == 1) {
+        max_size = min_size;
+      }
+      break;
+    case 'r':
+      rounds = atol(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if (optind != argc || min_size <= 0 || max_size < min_size || rounds <= 0 ||
+      max_size > WIRE_MAX_PAYLOAD - 32) {
+    usage(argv[0]);
+  }
+
+  // Preenche o leitor com quadros MSG públicos de remetentes e tamanhos
+  // variados, como um lote recebido em uma única chamada de recv
+  static frame_reader_t reader;
+  frame_reader_init(&reader);
+  char content[BUFFER_SIZE];
+  char buffer[sizeof(uint16_t) + BUFFER_SIZE];
+  srand(1);
+  while (1) {
+    int size = min_size + rand() % (max_size - min_size + 1);
+    memset(content, 'x', size);
+    msg_view_t msg = {.id_msg = MSG,
+                      .id_sender = rand() % 10000,
+                      .id_receiver = NULL_ID,
+                      .message = content,
+                      .len = size};
+    uint16_t len = encode_view(&msg, buffer + sizeof(uint16_t));
+    uint16_t net_len = htons(len);
+    memcpy(buffer, &net_len, sizeof(uint16_t));
+    if (frame_reader_space(&reader) < sizeof(uint16_t) + len) {
+      break;
+    }
+    frame_reader_append(&reader, buffer, sizeof(uint16_t) + len);
+  }
+
+  checksum_t base, sum;
+  run("decode (strtok_r)", round_decode, &reader, reader.end, rounds, &base);
+  run("decode_view (strtok_r)", round_decode_view, &reader, reader.end, rounds, &sum);
+  if (memcmp(&base, &sum, sizeof(sum)) != 0) {
+    eprintf("decode_view mismatch\n");
+    exit(EXIT_FAILURE);
+  }
+  run("frame_reader_batch", round_batch, &reader, reader.end, rounds, &sum);
+  if (memcmp(&base, &sum, sizeof(sum)) != 0) {
+    eprintf("frame_reader_batch mismatch\n");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("%llu frames per round, %zu bytes\n", (unsigned long long)base.frames / rounds,
+         reader.end);
+  return 0;
+}
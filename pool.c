@@ -0,0 +1,76 @@
+#include "pool.h"
+#include "common.h"
+#include <stdlib.h>
+
+// Cabeçalho de cada bloco, que precede a memória entregue ao chamador. Enquanto
+// o bloco está livre, o cabeçalho também guarda o próximo bloco da lista. O
+// tamanho do cabeçalho preserva o alinhamento de 16 bytes do malloc.
+typedef union pool_block_t {
+  struct {
+    // Classe de tamanho do bloco, ou POOL_CLASSES caso ele tenha sido
+    // alocado diretamente pelo malloc.
+    int cls;
+
+    // Próximo bloco livre da mesma classe.
+    union pool_block_t* next;
+  };
+  max_align_t align;
+} pool_block_t;
+
+// Listas de blocos livres de uma thread, uma por classe de tamanho.
+typedef struct pool_cache_t {
+  pool_block_t* free[POOL_CLASSES];
+  size_t count[POOL_CLASSES];
+} pool_cache_t;
+
+static __thread pool_cache_t cache;
+
+// Retorna a menor classe cujos blocos comportam "size" bytes, ou POOL_CLASSES
+// caso nenhuma classe os comporte.
+static int pool_class(size_t size) {
+  int cls = 0;
+  while (cls < POOL_CLASSES && (size_t)POOL_MIN_SIZE << cls < size) {
+    cls++;
+  }
+  return cls;
+}
+
+void* pool_alloc(size_t size) {
+  size += sizeof(pool_block_t);
+  int cls = pool_class(size);
+
+  pool_block_t* block;
+  if (cls < POOL_CLASSES && cache.free[cls] != NULL) {
+    block = cache.free[cls];
+    cache.free[cls] = block->next;
+    cache.count[cls]--;
+  } else {
+    // Um bloco de classe é sempre alocado com o tamanho máximo da classe, de
+    // modo que possa ser reaproveitado por qualquer alocação dela
+    block = (pool_block_t*)malloc(cls < POOL_CLASSES ? (size_t)POOL_MIN_SIZE << cls : size);
+    if (block == NULL) {
+      log_exit("malloc");
+    }
+    block->cls = cls;
+  }
+
+  return block + 1;
+}
+
+void pool_free(void* ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+
+  pool_block_t* block = (pool_block_t*)ptr - 1;
+  int cls = block->cls;
+  if (cls == POOL_CLASSES ||
+      cache.count[cls] >= POOL_CACHE_BYTES / ((size_t)POOL_MIN_SIZE << cls)) {
+    free(block);
+    return;
+  }
+
+  block->next = cache.free[cls];
+  cache.free[cls] = block;
+  cache.count[cls]++;
+}
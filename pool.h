@@ -0,0 +1,25 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+// Número de classes de tamanho do pool. A classe "k" atende blocos de até
+// POOL_MIN_SIZE << k bytes, incluindo o cabeçalho de cada bloco.
+#define POOL_CLASSES 8
+#define POOL_MIN_SIZE 32
+
+// Limite de bytes mantidos na lista de blocos livres de cada classe, em cada
+// thread. Os blocos liberados além desse limite são devolvidos ao malloc.
+#define POOL_CACHE_BYTES (256 * 1024)
+
+// Aloca um bloco de pelo menos "size" bytes. Os blocos de até
+// POOL_MIN_SIZE << (POOL_CLASSES - 1) bytes são reaproveitados a partir da
+// lista de blocos livres da classe correspondente na thread atual, sem travas.
+// Os maiores são alocados diretamente pelo malloc. A memória não é zerada.
+void* pool_alloc(size_t size);
+
+// Libera o bloco "ptr", obtido por "pool_alloc". Pode ser chamada por qualquer
+// thread: o bloco passa para a lista de blocos livres da thread que o liberou.
+void pool_free(void* ptr);
+
+#endif
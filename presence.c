@@ -0,0 +1,167 @@
+#include "presence.h"
+#include <limits.h>
+#include <string.h>
+
+// Escreve o varint "value" em "buf". Retorna o número de bytes escritos.
+static size_t put_varint(char* buf, uint64_t value) {
+  size_t len = 0;
+  while (value >= 0x80) {
+    buf[len++] = (char)(value | 0x80);
+    value >>= 7;
+  }
+  buf[len++] = (char)value;
+  return len;
+}
+
+// Retorna o número de bytes do varint "value".
+static size_t varint_size(uint64_t value) {
+  size_t len = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    len++;
+  }
+  return len;
+}
+
+// Lê um varint de até 32 bits de "buf", de tamanho "len", a partir de "*pos".
+// Retorna 1 em caso de sucesso e 0 caso o varint seja inválido ou incompleto.
+static int get_varint(const char* buf, size_t len, size_t* pos, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 7 * PRESENCE_VARINT_MAX; shift += 7) {
+    if (*pos >= len) {
+      return 0;
+    }
+
+    uint8_t byte = (uint8_t)buf[(*pos)++];
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return *value <= UINT32_MAX;
+    }
+  }
+
+  return 0;
+}
+
+size_t presence_encode_snapshot(char* buf, size_t max_len, uint32_t version, const int* ids,
+                                size_t count, size_t* pos) {
+  size_t start = *pos;
+  uint32_t base = (uint32_t)ids[start];
+  size_t hdr_len = 1 + varint_size(version) + varint_size(base);
+
+  // IDs que cabem na lista de diferenças
+  size_t list_end = start + 1;
+  size_t list_len = hdr_len;
+  while (list_end < count) {
+    size_t size = varint_size((uint32_t)(ids[list_end] - ids[list_end - 1]));
+    if (list_len + size > max_len) {
+      break;
+    }
+    list_len += size;
+    list_end++;
+  }
+
+  // IDs que cabem no bitmap, que cobre 8 IDs por byte a partir do primeiro
+  uint64_t span = (uint64_t)(max_len - hdr_len) * 8;
+  size_t bitmap_end = start + 1;
+  while (bitmap_end < count && (uint64_t)(ids[bitmap_end] - base) < span) {
+    bitmap_end++;
+  }
+
+  int kind = bitmap_end > list_end ? PRESENCE_BITMAP : PRESENCE_LIST;
+  size_t len = 0;
+  buf[len++] = (char)kind;
+  len += put_varint(buf + len, version);
+  len += put_varint(buf + len, base);
+
+  if (kind == PRESENCE_LIST) {
+    for (size_t i = start + 1; i < list_end; i++) {
+      len += put_varint(buf + len, (uint32_t)(ids[i] - ids[i - 1]));
+    }
+    *pos = list_end;
+  } else {
+    size_t bytes = (ids[bitmap_end - 1] - base) / 8 + 1;
+    memset(buf + len, 0, bytes);
+    for (size_t i = start; i < bitmap_end; i++) {
+      uint32_t offset = ids[i] - base;
+      buf[len + offset / 8] |= (char)(1 << (offset % 8));
+    }
+    len += bytes;
+    *pos = bitmap_end;
+  }
+
+  return len;
+}
+
+size_t presence_encode_delta(char* buf, size_t max_len, uint32_t version,
+                             const presence_change_t* changes, size_t count, size_t* pos) {
+  size_t len = 0;
+  buf[len++] = PRESENCE_DELTA;
+  len += put_varint(buf + len, version + (uint32_t)*pos);
+
+  for (; *pos < count; (*pos)++) {
+    uint64_t value = ((uint64_t)changes[*pos].id << 1) | (changes[*pos].present ? 0 : 1);
+    if (len + varint_size(value) > max_len) {
+      break;
+    }
+    len += put_varint(buf + len, value);
+  }
+
+  return len;
+}
+
+int presence_decode(const char* buf, size_t len, presence_fn fn, void* arg) {
+  if (len == 0) {
+    return -1;
+  }
+
+  int kind = (uint8_t)buf[0];
+  size_t pos = 1;
+  uint64_t version;
+  if (!get_varint(buf, len, &pos, &version)) {
+    return -1;
+  }
+
+  if (kind == PRESENCE_DELTA) {
+    for (uint32_t i = 0; pos < len; i++) {
+      uint64_t value;
+      if (!get_varint(buf, len, &pos, &value)) {
+        return -1;
+      }
+      fn(kind, (int)(value >> 1), (value & 1) == 0, (uint32_t)version + i, arg);
+    }
+    return kind;
+  }
+
+  uint64_t id;
+  if (!get_varint(buf, len, &pos, &id) || id > INT_MAX) {
+    return -1;
+  }
+
+  if (kind == PRESENCE_LIST) {
+    fn(kind, (int)id, 1, (uint32_t)version, arg);
+    while (pos < len) {
+      uint64_t diff;
+      if (!get_varint(buf, len, &pos, &diff) || diff == 0 || id + diff > INT_MAX) {
+        return -1;
+      }
+      id += diff;
+      fn(kind, (int)id, 1, (uint32_t)version, arg);
+    }
+  } else if (kind == PRESENCE_BITMAP) {
+    for (uint64_t offset = 0; pos < len; pos++, offset += 8) {
+      uint8_t byte = (uint8_t)buf[pos];
+      while (byte != 0) {
+        uint64_t bit_id = id + offset + __builtin_ctz(byte);
+        if (bit_id > INT_MAX) {
+          return -1;
+        }
+        fn(kind, (int)bit_id, 1, (uint32_t)version, arg);
+        byte &= byte - 1;
+      }
+    }
+  } else {
+    return -1;
+  }
+
+  return kind;
+}
@@ -0,0 +1,74 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include "common.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Presença compacta, negociada no REQ_ADD com a capacidade CAP_PRESENCE (junto
+// com CAP_BINARY). Em vez da lista de IDs em texto do RES_LIST, o usuário que
+// entra no grupo recebe um snapshot dos IDs ativos em mensagens PRESENCE, e as
+// entradas e saídas seguintes chegam como alterações incrementais, também em
+// mensagens PRESENCE, no lugar do MSG "User N joined the group!" e do REQ_REM.
+//
+// O servidor mantém uma versão de presença, incrementada a cada entrada ou
+// saída. O conteúdo de uma mensagem PRESENCE é o tipo do trecho (8 bits) e uma
+// versão, seguidos dos dados do trecho. Todos os números são varints (7 bits
+// por byte, do menos significativo para o mais significativo, com o bit mais
+// alto indicando que há mais bytes):
+//
+// - PRESENCE_LIST: trecho do snapshot com o primeiro ID seguido das diferenças
+//   entre IDs consecutivos, em ordem crescente.
+// - PRESENCE_BITMAP: trecho do snapshot com o primeiro ID seguido de um bitmap,
+//   no qual o bit j (do menos significativo) do byte k indica se o ID
+//   "primeiro + 8k + j" está ativo.
+// - PRESENCE_DELTA: alterações, cada uma codificada como "(ID << 1) | saída". A
+//   alteração de posição i tem a versão do trecho mais i.
+//
+// Todos os trechos de um snapshot têm a versão do momento em que ele foi
+// gerado, e o cliente descarta as alterações cuja versão não é maior do que a
+// última aplicada, que já estão refletidas no snapshot.
+#define CAP_PRESENCE "PRES1"
+
+#define PRESENCE_LIST 0
+#define PRESENCE_BITMAP 1
+#define PRESENCE_DELTA 2
+
+// Tamanho máximo de um varint de 32 bits e do cabeçalho de um trecho (tipo,
+// versão e primeiro ID). O buffer de cada trecho precisa comportar ao menos o
+// cabeçalho e uma alteração.
+#define PRESENCE_VARINT_MAX 5
+#define PRESENCE_HDR_MAX (1 + 2 * PRESENCE_VARINT_MAX)
+
+// Entrada (present = 1) ou saída (present = 0) do usuário de ID "id".
+typedef struct presence_change_t {
+  int id;
+  int present;
+} presence_change_t;
+
+// Função chamada para cada ID de um trecho do tipo "kind", com a versão
+// "version" da alteração (ou do snapshot) e a indicação de que o usuário está
+// ativo.
+typedef void (*presence_fn)(int kind, int id, int present, uint32_t version, void* arg);
+
+// Codifica em "buf", com até "max_len" bytes, um trecho do snapshot de versão
+// "version" com os "count" IDs de "ids", em ordem crescente, a partir da
+// posição "*pos". É usado o bitmap ou a lista de diferenças, o que comportar
+// mais IDs. Ao final, "*pos" indica a posição do primeiro ID não incluído.
+// Retorna o tamanho do trecho.
+size_t presence_encode_snapshot(char* buf, size_t max_len, uint32_t version, const int* ids,
+                                size_t count, size_t* pos);
+
+// Codifica em "buf", com até "max_len" bytes, um trecho com as "count"
+// alterações de "changes" a partir da posição "*pos". A primeira alteração de
+// "changes" tem a versão "version". Ao final, "*pos" indica a posição da
+// primeira alteração não incluída. Retorna o tamanho do trecho.
+size_t presence_encode_delta(char* buf, size_t max_len, uint32_t version,
+                             const presence_change_t* changes, size_t count, size_t* pos);
+
+// Decodifica o conteúdo "buf", de tamanho "len", de uma mensagem PRESENCE,
+// chamando "fn" para cada ID. Retorna o tipo do trecho, ou -1 caso o conteúdo
+// seja inválido, quando os IDs anteriores ao erro já foram informados.
+int presence_decode(const char* buf, size_t len, presence_fn fn, void* arg);
+
+#endif
@@ -0,0 +1,114 @@
+#include "qsbr.h"
+#include "common.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Índice da thread atual no array "thread_epochs", ou -1 caso a thread não
+// tenha sido registrada.
+static __thread int thread_index = -1;
+
+void qsbr_init(qsbr_t* qsbr) {
+  // A época 0 é reservada para indicar threads inativas
+  atomic_init(&qsbr->epoch, 1);
+  for (int i = 0; i < QSBR_MAX_THREADS; i++) {
+    atomic_init(&qsbr->thread_epochs[i], 0);
+  }
+  atomic_init(&qsbr->num_threads, 0);
+  atomic_init(&qsbr->num_retired, 0);
+
+  qsbr->retired = NULL;
+  pthread_mutex_init(&qsbr->lock, NULL);
+}
+
+void qsbr_register(qsbr_t* qsbr) {
+  int index = atomic_fetch_add(&qsbr->num_threads, 1);
+  if (index >= QSBR_MAX_THREADS) {
+    eprintf("Too many QSBR threads.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  thread_index = index;
+  qsbr_online(qsbr);
+}
+
+// Retorna a menor época observada pelas threads ativas. Caso nenhuma thread
+// esteja ativa, retorna a época global atual.
+static uint64_t min_epoch(qsbr_t* qsbr) {
+  uint64_t min = atomic_load(&qsbr->epoch);
+  int num_threads = atomic_load(&qsbr->num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    uint64_t epoch = atomic_load(&qsbr->thread_epochs[i]);
+    if (epoch != 0 && epoch < min) {
+      min = epoch;
+    }
+  }
+
+  return min;
+}
+
+// Libera os objetos que foram retirados antes da menor época observada pelas
+// threads ativas.
+static void reclaim(qsbr_t* qsbr) {
+  uint64_t min = min_epoch(qsbr);
+
+  pthread_mutex_lock(&qsbr->lock);
+  qsbr_retired_t** ptr = &qsbr->retired;
+  qsbr_retired_t* ready = NULL;
+  while (*ptr != NULL) {
+    qsbr_retired_t* item = *ptr;
+    if (item->epoch < min) {
+      *ptr = item->next;
+      item->next = ready;
+      ready = item;
+    } else {
+      ptr = &item->next;
+    }
+  }
+  pthread_mutex_unlock(&qsbr->lock);
+
+  // A liberação é feita fora da trava
+  while (ready != NULL) {
+    qsbr_retired_t* next = ready->next;
+    ready->free_fn(ready->ptr);
+    free(ready);
+    atomic_fetch_sub(&qsbr->num_retired, 1);
+    ready = next;
+  }
+}
+
+void qsbr_quiescent(qsbr_t* qsbr) {
+  atomic_store(&qsbr->thread_epochs[thread_index], atomic_load(&qsbr->epoch));
+
+  if (atomic_load(&qsbr->num_retired) > 0) {
+    reclaim(qsbr);
+  }
+}
+
+void qsbr_offline(qsbr_t* qsbr) {
+  atomic_store(&qsbr->thread_epochs[thread_index], 0);
+}
+
+void qsbr_online(qsbr_t* qsbr) {
+  atomic_store(&qsbr->thread_epochs[thread_index], atomic_load(&qsbr->epoch));
+}
+
+void qsbr_retire(qsbr_t* qsbr, void* ptr, void (*free_fn)(void*)) {
+  qsbr_retired_t* item = (qsbr_retired_t*)malloc(sizeof(qsbr_retired_t));
+  if (item == NULL) {
+    log_exit("malloc");
+  }
+
+  item->ptr = ptr;
+  item->free_fn = free_fn;
+
+  // O objeto só pode estar sendo lido por threads que não passaram por um
+  // estado quiescente desde a época atual, que é então incrementada
+  item->epoch = atomic_fetch_add(&qsbr->epoch, 1);
+
+  pthread_mutex_lock(&qsbr->lock);
+  item->next = qsbr->retired;
+  qsbr->retired = item;
+  pthread_mutex_unlock(&qsbr->lock);
+
+  atomic_fetch_add(&qsbr->num_retired, 1);
+}
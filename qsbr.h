@@ -0,0 +1,69 @@
+#ifndef QSBR_H
+#define QSBR_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Número máximo de threads que podem ler estruturas protegidas pelo QSBR.
+#define QSBR_MAX_THREADS 256
+
+// Objeto cuja liberação foi adiada até que nenhuma thread possa estar lendo-o.
+typedef struct qsbr_retired_t {
+  struct qsbr_retired_t* next;
+
+  // Objeto e função usada para liberá-lo.
+  void* ptr;
+  void (*free_fn)(void*);
+
+  // Época global no momento em que o objeto foi retirado.
+  uint64_t epoch;
+} qsbr_retired_t;
+
+// Recuperação de memória baseada em estados quiescentes (QSBR). Os leitores não
+// usam travas: eles apenas anunciam periodicamente que não possuem referências
+// a objetos compartilhados (estado quiescente), o que é feito pelas threads do
+// reator entre um lote de eventos e outro. Um objeto substituído por um
+// escritor é retirado e só é liberado quando todas as threads ativas passaram
+// por um estado quiescente depois da retirada.
+typedef struct qsbr_t {
+  // Época global, incrementada a cada retirada.
+  atomic_uint_fast64_t epoch;
+
+  // Última época observada por cada thread registrada, ou 0 caso a thread
+  // esteja inativa (por exemplo, bloqueada em epoll_wait).
+  atomic_uint_fast64_t thread_epochs[QSBR_MAX_THREADS];
+
+  // Número de threads registradas.
+  atomic_int num_threads;
+
+  // Número de objetos aguardando liberação.
+  atomic_int num_retired;
+
+  // Lista de objetos aguardando liberação, protegida por "lock".
+  qsbr_retired_t* retired;
+  pthread_mutex_t lock;
+} qsbr_t;
+
+// Inicializa o QSBR.
+void qsbr_init(qsbr_t* qsbr);
+
+// Registra a thread atual como leitora. A thread começa ativa.
+void qsbr_register(qsbr_t* qsbr);
+
+// Anuncia que a thread atual não possui referências a objetos compartilhados e
+// libera os objetos que já não podem ser lidos por nenhuma thread.
+void qsbr_quiescent(qsbr_t* qsbr);
+
+// Marca a thread atual como inativa. Até a chamada de "qsbr_online", a thread
+// não pode acessar objetos compartilhados.
+void qsbr_offline(qsbr_t* qsbr);
+
+// Marca a thread atual como ativa novamente.
+void qsbr_online(qsbr_t* qsbr);
+
+// Adia a liberação de "ptr", feita por "free_fn", até que nenhuma thread possa
+// estar lendo o objeto.
+void qsbr_retire(qsbr_t* qsbr, void* ptr, void (*free_fn)(void*));
+
+#endif
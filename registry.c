@@ -0,0 +1,200 @@
+#include "registry.h"
+#include "common.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Número de palavras de 64 bits necessárias para representar "bits" bits.
+static size_t words_for(size_t bits) {
+  return (bits + 63) / 64;
+}
+
+// Reconstrói todos os níveis do bitmap a partir do array "slots". É usada na
+// inicialização e quando o registro cresce, o que tem custo amortizado
+// constante por inserção.
+static void rebuild_levels(registry_t* reg) {
+  for (int k = 0; k < reg->num_levels; k++) {
+    free(reg->levels[k]);
+    reg->levels[k] = NULL;
+  }
+
+  size_t bits = reg->capacity;
+  int k = 0;
+  do {
+    size_t words = words_for(bits);
+    reg->levels[k] = (uint64_t*)calloc(words, sizeof(uint64_t));
+    if (reg->levels[k] == NULL) {
+      log_exit("calloc");
+    }
+
+    for (size_t i = 0; i < bits; i++) {
+      // No nível 0, o bit indica se o ID está livre. Nos demais, indica se a
+      // palavra correspondente do nível inferior possui algum bit ligado
+      int set = (k == 0) ? reg->slots[i] == NULL : reg->levels[k - 1][i] != 0;
+      if (set) {
+        reg->levels[k][i / 64] |= UINT64_C(1) << (i % 64);
+      }
+    }
+
+    bits = words;
+    k++;
+  } while (bits > 1 && k < REGISTRY_MAX_LEVELS);
+
+  reg->num_levels = k;
+}
+
+// Marca o ID "id" como ocupado, propagando a mudança para os níveis superiores
+// somente quando uma palavra deixa de ter bits livres.
+static void mark_used(registry_t* reg, size_t id) {
+  for (int k = 0; k < reg->num_levels; k++) {
+    uint64_t* word = &reg->levels[k][id / 64];
+    *word &= ~(UINT64_C(1) << (id % 64));
+    if (*word != 0) {
+      break;
+    }
+    id /= 64;
+  }
+}
+
+// Marca o ID "id" como livre, propagando a mudança para os níveis superiores
+// somente quando uma palavra passa a ter seu primeiro bit livre.
+static void mark_free(registry_t* reg, size_t id) {
+  for (int k = 0; k < reg->num_levels; k++) {
+    uint64_t* word = &reg->levels[k][id / 64];
+    int was_empty = *word == 0;
+    *word |= UINT64_C(1) << (id % 64);
+    if (!was_empty) {
+      break;
+    }
+    id /= 64;
+  }
+}
+
+// Retorna o menor ID livre, ou -1 caso não haja nenhum. Desce do nível mais
+// alto até o nível 0 escolhendo sempre o bit ligado menos significativo.
+static long find_free(const registry_t* reg) {
+  size_t idx = 0;
+  for (int k = reg->num_levels - 1; k >= 0; k--) {
+    uint64_t word = reg->levels[k][idx];
+    if (word == 0) {
+      return -1;
+    }
+    idx = idx * 64 + __builtin_ctzll(word);
+  }
+
+  return (long)idx;
+}
+
+// Dobra a capacidade do registro.
+static void grow(registry_t* reg) {
+  size_t new_capacity = reg->capacity * 2;
+
+  reg->slots = (void**)realloc(reg->slots, new_capacity * sizeof(void*));
+  reg->dense_pos = (size_t*)realloc(reg->dense_pos, new_capacity * sizeof(size_t));
+  reg->dense_ids = (int*)realloc(reg->dense_ids, new_capacity * sizeof(int));
+  if (reg->slots == NULL || reg->dense_pos == NULL || reg->dense_ids == NULL) {
+    log_exit("realloc");
+  }
+
+  memset(reg->slots + reg->capacity, 0, (new_capacity - reg->capacity) * sizeof(void*));
+  reg->capacity = new_capacity;
+
+  rebuild_levels(reg);
+}
+
+void registry_init(registry_t* reg, size_t capacity, size_t max_entries) {
+  memset(reg, 0, sizeof(*reg));
+
+  if (capacity == 0) {
+    capacity = REGISTRY_INITIAL_CAPACITY;
+  }
+
+  reg->capacity = capacity;
+  reg->max_entries = max_entries;
+  reg->slots = (void**)calloc(capacity, sizeof(void*));
+  reg->dense_pos = (size_t*)malloc(capacity * sizeof(size_t));
+  reg->dense_ids = (int*)malloc(capacity * sizeof(int));
+  if (reg->slots == NULL || reg->dense_pos == NULL || reg->dense_ids == NULL) {
+    log_exit("malloc");
+  }
+
+  rebuild_levels(reg);
+}
+
+void registry_destroy(registry_t* reg) {
+  for (int k = 0; k < reg->num_levels; k++) {
+    free(reg->levels[k]);
+  }
+
+  free(reg->slots);
+  free(reg->dense_pos);
+  free(reg->dense_ids);
+  memset(reg, 0, sizeof(*reg));
+}
+
+int registry_add(registry_t* reg, void* entry) {
+  if (reg->max_entries != 0 && reg->count >= reg->max_entries) {
+    return NULL_ID;
+  }
+
+  long id = find_free(reg);
+  if (id == -1) {
+    grow(reg);
+    id = find_free(reg);
+  }
+
+  mark_used(reg, id);
+  reg->slots[id] = entry;
+  reg->dense_pos[id] = reg->count;
+  reg->dense_ids[reg->count] = (int)id;
+  reg->count++;
+
+  return (int)id;
+}
+
+int registry_remove(registry_t* reg, int id) {
+  if (registry_get(reg, id) == NULL) {
+    return -1;
+  }
+
+  // Move o último ID do array denso para a posição do ID removido
+  size_t pos = reg->dense_pos[id];
+  int last_id = reg->dense_ids[reg->count - 1];
+  reg->dense_ids[pos] = last_id;
+  reg->dense_pos[last_id] = pos;
+  reg->count--;
+
+  reg->slots[id] = NULL;
+  mark_free(reg, id);
+
+  return 0;
+}
+
+void* registry_get(const registry_t* reg, int id) {
+  if (id < 0 || (size_t)id >= reg->capacity) {
+    return NULL;
+  }
+
+  return reg->slots[id];
+}
+
+size_t registry_count(const registry_t* reg) {
+  return reg->count;
+}
+
+int registry_id_at(const registry_t* reg, size_t pos) {
+  return reg->dense_ids[pos];
+}
+
+int registry_next(const registry_t* reg, size_t id) {
+  while (id < reg->capacity) {
+    // No nível 0, os bits ligados indicam os IDs livres
+    uint64_t used = ~reg->levels[0][id / 64] >> (id % 64);
+    if (used != 0) {
+      id += __builtin_ctzll(used);
+      break;
+    }
+    id = (id / 64 + 1) * 64;
+  }
+
+  return id < reg->capacity ? (int)id : NULL_ID;
+}
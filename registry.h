@@ -0,0 +1,78 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Capacidade inicial do registro de clientes. O registro cresce sob demanda.
+#define REGISTRY_INITIAL_CAPACITY 64
+
+// Número máximo de níveis do bitmap hierárquico. Com palavras de 64 bits, 6
+// níveis são suficientes para mais de 2^36 IDs.
+#define REGISTRY_MAX_LEVELS 6
+
+// Registro de clientes ativos, indexado pelo ID de cada cliente. Os IDs livres
+// são mantidos em um bitmap hierárquico, no qual cada bit de um nível indica se
+// a palavra correspondente do nível inferior possui algum ID livre. Dessa
+// forma, o menor ID livre é encontrado descendo um número constante de níveis.
+// Além disso, os clientes ativos também são mantidos em um array denso, de modo
+// que a iteração sobre eles tem custo proporcional ao número de clientes
+// ativos, e não à capacidade do registro.
+typedef struct registry_t {
+  // Entrada associada a cada ID, ou NULL caso o ID esteja livre.
+  void** slots;
+
+  // Posição de cada ID ativo no array denso.
+  size_t* dense_pos;
+
+  // IDs ativos, armazenados de forma contígua.
+  int* dense_ids;
+
+  // Número de clientes ativos.
+  size_t count;
+
+  // Número de IDs que o registro comporta atualmente.
+  size_t capacity;
+
+  // Limite de clientes ativos. Quando igual a 0, não há limite.
+  size_t max_entries;
+
+  // Níveis do bitmap de IDs livres. O nível 0 possui um bit por ID e o último
+  // nível possui uma única palavra.
+  uint64_t* levels[REGISTRY_MAX_LEVELS];
+
+  // Número de níveis em uso.
+  int num_levels;
+} registry_t;
+
+// Inicializa o registro com a capacidade "capacity" e o limite de clientes
+// "max_entries" (0 para ilimitado).
+void registry_init(registry_t* reg, size_t capacity, size_t max_entries);
+
+// Libera a memória usada pelo registro.
+void registry_destroy(registry_t* reg);
+
+// Associa a entrada "entry" ao menor ID livre e retorna esse ID. Retorna
+// NULL_ID caso o limite de clientes tenha sido atingido.
+int registry_add(registry_t* reg, void* entry);
+
+// Remove o cliente de ID "id". Retorna 0 caso a remoção tenha sido bem sucedida
+// e -1 caso o ID não esteja ativo.
+int registry_remove(registry_t* reg, int id);
+
+// Retorna a entrada associada ao ID "id", ou NULL caso o ID não esteja ativo.
+void* registry_get(const registry_t* reg, int id);
+
+// Retorna o número de clientes ativos.
+size_t registry_count(const registry_t* reg);
+
+// Retorna o ID do cliente na posição "pos" do array denso, em que
+// 0 <= pos < registry_count(reg).
+int registry_id_at(const registry_t* reg, size_t pos);
+
+// Retorna o menor ID ativo maior ou igual a "id", ou NULL_ID caso não haja
+// nenhum. Percorre o nível 0 do bitmap uma palavra por vez, de modo que os IDs
+// ativos podem ser listados em ordem crescente sem ordenação.
+int registry_next(const registry_t* reg, size_t id);
+
+#endif
@@ -0,0 +1,174 @@
+#include "room.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Hash FNV-1a do nome "name", de tamanho "len".
+static size_t room_hash(const char* name, size_t len) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)name[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Aloca o array de posições da tabela com "num_buckets" posições vazias.
+static room_t** buckets_new(size_t num_buckets) {
+  room_t** buckets = (room_t**)calloc(num_buckets, sizeof(room_t*));
+  if (buckets == NULL) {
+    log_exit("calloc");
+  }
+  return buckets;
+}
+
+void room_table_init(room_table_t* table, int num_locals) {
+  table->num_buckets = ROOM_TABLE_INITIAL_BUCKETS;
+  table->buckets = buckets_new(table->num_buckets);
+  table->count = 0;
+  table->num_locals = num_locals;
+}
+
+// Libera a memória da sala "room" e dos seus arrays de membros.
+static void room_free(room_t* room) {
+  for (int i = 0; i < room->num_locals; i++) {
+    free(room->local[i].members);
+  }
+  free(room);
+}
+
+void room_table_destroy(room_table_t* table) {
+  for (size_t i = 0; i < table->num_buckets; i++) {
+    room_t* room = table->buckets[i];
+    while (room != NULL) {
+      room_t* next = room->next;
+      room_free(room);
+      room = next;
+    }
+  }
+  free(table->buckets);
+}
+
+int room_name_valid(const char* name, size_t len) {
+  if (len == 0 || len >= ROOM_NAME_SIZE) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = name[i];
+    if (!isalnum(c) && c != '-' && c != '_' && c != '.') {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+room_t* room_find(const room_table_t* table, const char* name, size_t len) {
+  room_t* room = table->buckets[room_hash(name, len) % table->num_buckets];
+  for (; room != NULL; room = room->next) {
+    if (strncmp(room->name, name, len) == 0 && room->name[len] == '\0') {
+      return room;
+    }
+  }
+
+  return NULL;
+}
+
+// Dobra o número de posições da tabela, redistribuindo as salas.
+static void room_table_grow(room_table_t* table) {
+  size_t num_buckets = table->num_buckets * 2;
+  room_t** buckets = buckets_new(num_buckets);
+
+  for (size_t i = 0; i < table->num_buckets; i++) {
+    room_t* room = table->buckets[i];
+    while (room != NULL) {
+      room_t* next = room->next;
+      size_t pos = room_hash(room->name, strlen(room->name)) % num_buckets;
+      room->next = buckets[pos];
+      buckets[pos] = room;
+      room = next;
+    }
+  }
+
+  free(table->buckets);
+  table->buckets = buckets;
+  table->num_buckets = num_buckets;
+}
+
+room_t* room_create(room_table_t* table, const char* name, size_t len) {
+  if (table->count >= table->num_buckets) {
+    room_table_grow(table);
+  }
+
+  room_t* room =
+      (room_t*)calloc(1, sizeof(room_t) + table->num_locals * sizeof(room_local_t));
+  if (room == NULL) {
+    log_exit("calloc");
+  }
+
+  memcpy(room->name, name, len);
+  room->name[len] = '\0';
+  atomic_init(&room->refs, 1);
+  room->num_locals = table->num_locals;
+  for (int i = 0; i < room->num_locals; i++) {
+    atomic_init(&room->local[i].active, 0);
+  }
+
+  size_t pos = room_hash(name, len) % table->num_buckets;
+  room->next = table->buckets[pos];
+  table->buckets[pos] = room;
+  table->count++;
+
+  return room;
+}
+
+void room_drop(room_table_t* table, room_t* room) {
+  room_t** link = &table->buckets[room_hash(room->name, strlen(room->name)) % table->num_buckets];
+  while (*link != room) {
+    link = &(*link)->next;
+  }
+  *link = room->next;
+  table->count--;
+
+  room_unref(room);
+}
+
+void room_ref(room_t* room) {
+  atomic_fetch_add_explicit(&room->refs, 1, memory_order_relaxed);
+}
+
+void room_unref(room_t* room) {
+  if (atomic_fetch_sub_explicit(&room->refs, 1, memory_order_acq_rel) == 1) {
+    room_free(room);
+  }
+}
+
+size_t room_local_add(room_t* room, int local, void* member) {
+  room_local_t* set = &room->local[local];
+  if (set->num == set->capacity) {
+    size_t capacity = set->capacity == 0 ? 4 : set->capacity * 2;
+    void** members = (void**)realloc(set->members, capacity * sizeof(void*));
+    if (members == NULL) {
+      log_exit("realloc");
+    }
+    set->members = members;
+    set->capacity = capacity;
+  }
+
+  set->members[set->num] = member;
+  atomic_store(&set->active, set->num + 1);
+  return set->num++;
+}
+
+void* room_local_remove(room_t* room, int local, size_t slot) {
+  room_local_t* set = &room->local[local];
+  void* last = set->members[--set->num];
+  atomic_store(&set->active, set->num);
+
+  if (slot == set->num) {
+    return NULL;
+  }
+  set->members[slot] = last;
+  return last;
+}
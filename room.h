@@ -0,0 +1,91 @@
+#ifndef ROOM_H
+#define ROOM_H
+
+#include "common.h"
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Número inicial de posições da tabela de salas. A tabela dobra de tamanho
+// quando o número de salas ultrapassa o número de posições.
+#define ROOM_TABLE_INITIAL_BUCKETS 64
+
+// Membros de uma sala que pertencem a um mesmo reator. O array só é acessado
+// pela thread desse reator, e "active" é uma cópia de "num" que pode ser lida
+// pelos demais reatores, usada para evitar entregas a reatores sem membros da
+// sala.
+typedef struct room_local_t {
+  void** members;
+  size_t num;
+  size_t capacity;
+  atomic_size_t active;
+} room_local_t;
+
+// Sala de conversa. As salas são criadas na primeira entrada e removidas da
+// tabela quando o último membro sai, mas a memória só é liberada quando a
+// última referência é devolvida, já que entregas pendentes entre reatores podem
+// apontar para a sala.
+typedef struct room_t {
+  // Nome da sala, terminado por caractere nulo.
+  char name[ROOM_NAME_SIZE];
+
+  // Número total de membros, alterado em exclusão mútua.
+  size_t count;
+
+  // Referências à sala: uma da tabela, enquanto a sala tiver membros, e uma
+  // de cada entrega pendente.
+  atomic_int refs;
+
+  // Próxima sala da mesma posição da tabela.
+  struct room_t* next;
+
+  // Membros da sala, separados por reator.
+  int num_locals;
+  room_local_t local[];
+} room_t;
+
+// Tabela de salas, indexada pelo nome. Só é acessada em exclusão mútua.
+typedef struct room_table_t {
+  room_t** buckets;
+  size_t num_buckets;
+  size_t count;
+
+  // Número de reatores, ou seja, de conjuntos de membros de cada sala.
+  int num_locals;
+} room_table_t;
+
+// Inicializa uma tabela vazia de salas com "num_locals" conjuntos de membros.
+void room_table_init(room_table_t* table, int num_locals);
+
+// Libera a memória da tabela e das salas que ainda estão nela.
+void room_table_destroy(room_table_t* table);
+
+// Retorna 1 caso "name", de tamanho "len", seja um nome de sala válido: entre 1
+// e ROOM_NAME_SIZE - 1 letras, dígitos, '-', '_' ou '.'.
+int room_name_valid(const char* name, size_t len);
+
+// Retorna a sala de nome "name", de tamanho "len", ou NULL caso ela não exista.
+room_t* room_find(const room_table_t* table, const char* name, size_t len);
+
+// Cria e insere na tabela uma sala vazia de nome "name", de tamanho "len", que
+// não pode existir na tabela.
+room_t* room_create(room_table_t* table, const char* name, size_t len);
+
+// Remove da tabela a sala "room", que não possui mais membros, e devolve a
+// referência da tabela.
+void room_drop(room_table_t* table, room_t* room);
+
+// Obtém e devolve uma referência à sala "room". A sala é liberada quando a
+// última referência é devolvida.
+void room_ref(room_t* room);
+void room_unref(room_t* room);
+
+// Adiciona "member" aos membros da sala que pertencem ao reator "local".
+// Retorna a posição do membro no array, usada na remoção.
+size_t room_local_add(room_t* room, int local, void* member);
+
+// Remove o membro na posição "slot" dos membros do reator "local". O último
+// membro do array ocupa a posição removida e é retornado, para que sua
+// posição seja atualizada, ou NULL caso o membro removido fosse o último.
+void* room_local_remove(room_t* room, int local, size_t slot);
+
+#endif
@@ -1,289 +1,2504 @@
+#define _GNU_SOURCE
+#include "bucket.h"
 #include "common.h"
+#include "history.h"
+#include "logger.h"
+#include "lz.h"
+#include "mailbox.h"
+#include "outq.h"
+#include "pool.h"
+#include "presence.h"
+#include "qsbr.h"
+#include "registry.h"
+#include "room.h"
+#include "shm.h"
+#include "stats.h"
+#include "uring.h"
+#include "wal.h"
+#include "wheel.h"
 #include <arpa/inet.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 /* ------------------------- Variáveis globais ------------------------- */
-// Array com os sockets com conexões ativas. O valor armazenado é o file
-// descriptor do socket caso ele esteja ativo e -1 caso contrário.
-int active_sockets[MAX_CLIENTS];
-// Contagem de usuários ativos.
-unsigned int user_count = 0;
-
-// Struct que é usado para a passagem de argumentos às threads que fazem o
-// processamento de cada cliente.
-typedef struct server_thread_args {
-  // Socket do cliente processado pela thread.
-  int client_sock;
-
-  // Trava mutex a ser usada pelas threads.
-  pthread_mutex_t* mutex;
-} server_thread_args;
-
-// Função auxiliar para obter um novo ID para um cliente. Basicamente, pega a
-// primeira posição do array "active_sockets" que é igual a -1. Essa função
-// assume que há alguma posição vazia no array. Essa função precisa ser
-// executada em exclusão mútua para evitar condições de corrida, já que as
-// variáveis globais "active_sockets" e "user_count" são atualizados aqui.
-int get_id(int socket) {
-  int id = 0;
-  while (active_sockets[id] != -1) {
-    id++;
-  }
-
-  active_sockets[id] = socket;
-  user_count++;
+// Registro dos clientes ativos, indexado pelo ID de cada usuário. Cada entrada
+// aponta para o "conn_t" da conexão do usuário. O registro só é acessado pelas
+// operações de escrita (entrada e saída de usuários), em exclusão mútua. As
+// leituras são feitas sem travas, a partir de "members" e "lookup".
+registry_t clients;
+
+// Recuperação de memória das estruturas lidas sem travas.
+qsbr_t qsbr;
+
+// Salas de conversa, indexadas pelo nome. A tabela só é acessada nas entradas e
+// saídas das salas, em exclusão mútua. As mensagens de uma sala são enviadas a
+// partir das salas do remetente, sem travas e sem consultar a tabela.
+room_table_t room_table;
+
+// Últimas mensagens públicas, enviadas a cada usuário que entra no grupo.
+history_t history;
+
+// Log durável das mensagens repassadas, usado para reconstruir o histórico
+// quando o servidor é reiniciado. É nulo caso o log não tenha sido ativado.
+wal_t* wal = NULL;
+
+// Número padrão de reatores, cada um executado por uma thread.
+#define DEFAULT_THREADS 4
+
+// Número máximo de eventos retornados por chamada de epoll_wait.
+#define MAX_EVENTS 64
+
+// Número máximo de quadros decodificados em cada lote. Um leitor cheio com
+// mensagens curtas comporta algumas centenas de quadros.
+#define FRAME_BATCH_SIZE 64
+
+// Tamanho padrão, em bytes, da fila de saída de cada conexão.
+#define DEFAULT_QUEUE_BYTES (1 << 20)
+
+// Políticas aplicadas quando a fila de saída de uma conexão está cheia, ou
+// seja, quando o cliente não está lendo as mensagens na mesma velocidade em que
+// elas são geradas.
+// Descarta a nova mensagem para esse cliente.
+#define POLICY_DROP 0
+// Desconecta o cliente.
+#define POLICY_DISCONNECT 1
+// Descarta as mensagens mais antigas da fila, mantendo as mais recentes.
+#define POLICY_COALESCE 2
+
+// Mecanismos de E/S usados pelos reatores.
+// Eventos de prontidão do epoll, com as chamadas de sistema feitas pela thread.
+#define BACKEND_EPOLL 0
+// Operações assíncronas do io_uring, submetidas em lote.
+#define BACKEND_URING 1
+
+// Duração, em milissegundos, de cada tick da roda de temporizadores.
+#define TIMER_TICK_MS 100
+
+// Intervalo padrão sem mensagens do cliente, em milissegundos, após o qual o
+// servidor envia um HEARTBEAT. Sem resposta, a conexão é encerrada após
+// IDLE_FACTOR intervalos sem mensagens. Os HEARTBEATs só são enviados quando
+// ativados com a opção -k, já que clientes antigos não os respondem e seriam
+// desconectados quando inativos.
+#define DEFAULT_HEARTBEAT_MS 0
+#define IDLE_FACTOR 3
+
+// Janela padrão, em milissegundos, em que as entradas e saídas de usuários são
+// acumuladas antes de serem anunciadas, e número máximo de alterações
+// acumuladas, após o qual o anúncio é feito imediatamente.
+#define DEFAULT_PRESENCE_WINDOW_MS 20
+#define PRESENCE_BATCH_SIZE 4096
+
+// Número de entradas da fila de submissão de cada instância io_uring.
+#define URING_ENTRIES 1024
+
+// Número e tamanho dos buffers fornecidos ao kernel para os recebimentos de
+// cada reator no backend io_uring.
+#define URING_BUF_COUNT 1024
+#define URING_BUF_SIZE 4096
+
+// Tipos das operações do io_uring, armazenados nos bits menos significativos
+// do "user_data" de cada SQE, junto com o ponteiro da conexão ou do reator.
+#define URING_OP_RECV 0
+#define URING_OP_SEND 1
+#define URING_OP_ACCEPT 2
+#define URING_OP_MAILBOX 3
+#define URING_OP_TIMER 4
+#define URING_OP_ACCEPT_LOCAL 5
+#define URING_OP_MASK 7
+
+// Marca, no "data" do epoll, o eventfd de uma conexão com memória
+// compartilhada, registrado com o ponteiro da própria conexão.
+#define EPOLL_TAG_SHM 1
+
+struct conn_t;
+
+// Reator executado por uma única thread. Cada reator possui seu próprio socket
+// de escuta (com SO_REUSEPORT, de modo que o kernel distribui as novas conexões
+// entre os reatores) e é o único responsável pelas conexões que aceitou: apenas
+// a sua thread lê, escreve e altera a fila de saída dessas conexões. As
+// mensagens destinadas a usuários de outros reatores são entregues pela caixa
+// de mensagens do reator de destino.
+typedef struct reactor_t {
+  // File descriptor da instância epoll.
+  int epoll_fd;
+
+  // Socket que aguarda novas conexões.
+  int server_sock;
+
+  // Caixa de mensagens com as entregas feitas pelos demais reatores.
+  mailbox_t mailbox;
+
+  // Conexões dos usuários ativos que pertencem ao reator. Cada conexão guarda
+  // sua posição no array, o que permite removê-la em tempo constante.
+  struct conn_t** members;
+  size_t num_members;
+  size_t members_capacity;
+
+  // Cópia de "num_members" que pode ser lida pelos demais reatores, usada para
+  // evitar entregas a reatores sem usuários, e número desses usuários que
+  // recebem a presença compacta.
+  atomic_size_t active;
+  atomic_size_t active_presence;
+
+  // Limite de bytes da fila de saída de cada conexão.
+  size_t max_queue_bytes;
+
+  // Política aplicada quando a fila de saída de uma conexão está cheia.
+  int slow_policy;
+
+  // Mecanismo de E/S usado pelo reator (BACKEND_EPOLL ou BACKEND_URING).
+  int backend;
+
+  // Instância io_uring e anel de buffers de recebimento, usados apenas no
+  // backend io_uring.
+  uring_t ring;
+  uring_bufs_t bufs;
+
+  // Conexões com mensagens na fila de saída cujo envio ainda não foi
+  // submetido ao io_uring.
+  struct conn_t* dirty;
+
+  // Estatísticas do reator, atualizadas apenas pela sua thread.
+  stats_t stats;
+
+  // Roda com os temporizadores das conexões do reator, avançada a cada
+  // TIMER_TICK_MS milissegundos pelo timerfd "timer_fd".
+  wheel_t wheel;
+  int timer_fd;
+
+  // Instante, em milissegundos, da última espera por eventos. É usado como
+  // relógio aproximado para registrar a atividade das conexões.
+  uint64_t now_ms;
+
+  // Intervalo sem mensagens após o qual um HEARTBEAT é enviado e prazo após o
+  // qual a conexão é encerrada, em milissegundos. Os temporizadores só são
+  // usados caso "heartbeat_ms" não seja 0.
+  uint64_t heartbeat_ms;
+  uint64_t idle_ms;
+
+  // Limites de mensagens e de bytes por segundo de cada conexão, aplicados às
+  // mensagens MSG e ROOM_MSG. O valor 0 indica que não há limite.
+  double msg_rate;
+  double byte_rate;
+
+  // Parcela do reator no limite global de entregas por segundo, consumida por
+  // cada broadcast de acordo com o número de destinatários.
+  bucket_t fanout_budget;
+} reactor_t;
+
+// Reatores do servidor.
+reactor_t* reactors;
+
+// Socket UNIX que aguarda conexões de clientes na mesma máquina, compartilhado
+// por todos os reatores, ou -1 caso não tenha sido ativado.
+int local_sock = -1;
+int num_reactors;
+
+// Trava que serializa as entradas e saídas de usuários do grupo.
+pthread_mutex_t mutex;
+
+// Versão de presença do grupo, incrementada a cada entrada e saída de usuário,
+// em exclusão mútua.
+uint32_t presence_version;
+
+// Entradas e saídas de usuários que ainda não foram anunciadas. Durante uma
+// tempestade de conexões, cada anúncio enviado a todos os usuários tornaria o
+// número de quadros quadrático, então as alterações são acumuladas durante uma
+// janela a partir da primeira delas e anunciadas juntas: cada usuário com
+// presença compacta recebe uma única mensagem PRESENCE com todas elas. Os
+// campos, exceto "announced", são alterados em exclusão mútua.
+typedef struct presence_batch_t {
+  presence_change_t changes[PRESENCE_BATCH_SIZE];
+  size_t count;
+
+  // Duração da janela, em milissegundos (0 para anunciar cada alteração
+  // imediatamente), e instante da primeira alteração acumulada.
+  uint64_t window_ms;
+  uint64_t start_ms;
+
+  // Versão da última alteração anunciada. Como as versões são consecutivas, a
+  // primeira alteração acumulada tem a versão seguinte. É lida sem a trava,
+  // para verificar se a entrada de um usuário já foi anunciada.
+  _Atomic uint32_t announced;
+
+  // Variável de condição que acorda a thread de anúncios quando a primeira
+  // alteração da janela é acumulada.
+  pthread_cond_t wakeup;
+} presence_batch_t;
+
+presence_batch_t presence_batch;
+
+// Estado de uma conexão gerenciada por um reator. Os bytes recebidos são
+// acumulados no leitor de quadros até que um quadro completo (cabeçalho de 16
+// bits + conteúdo) esteja disponível, o que permite tratar quadros parciais. As
+// mensagens destinadas ao cliente são inseridas em "out" e enviadas pelo reator
+// quando o socket aceita mais dados, de modo que a thread nunca fica bloqueada
+// esperando um cliente lento. Apenas a thread do reator da conexão acessa os
+// campos que não são constantes após o REQ_ADD.
+typedef struct conn_t {
+  // Socket do cliente.
+  int sock;
+
+  // ID do usuário, ou NULL_ID caso ele ainda não tenha entrado no grupo.
+  int id;
+
+  // Reator ao qual a conexão pertence.
+  reactor_t* reactor;
+
+  // Leitor com os bytes recebidos e ainda não processados.
+  frame_reader_t reader;
+
+  // Fila de saída da conexão.
+  outq_t out;
+
+  // Eventos registrados atualmente na instância epoll.
+  uint32_t events;
+
+  // Posição da conexão em "members" do reator, ou -1 caso o usuário não esteja
+  // ativo.
+  long slot;
+
+  // Indica que a conexão deve ser fechada assim que a fila de saída esvaziar.
+  int closing;
+
+  // Indica que o cliente foi desconectado pelo servidor, por não consumir suas
+  // mensagens, por inatividade ou por falha no envio. A conexão só aguarda a
+  // remoção do usuário pelo tratamento da leitura.
+  int evicted;
+
+  // Temporizador de inatividade e instante, em milissegundos, em que a última
+  // mensagem foi recebida.
+  wheel_timer_t timer;
+  uint64_t last_rx;
+
+  // Limites de taxa de mensagens e de bytes da conexão.
+  bucket_t msg_bucket;
+  bucket_t byte_bucket;
+
+  // Salas em que o usuário está e sua posição nos membros de cada sala, que
+  // são alteradas apenas pela thread do reator da conexão.
+  room_t* rooms[ROOMS_PER_USER];
+  size_t room_slots[ROOMS_PER_USER];
+  int num_rooms;
+
+  // Indica que a conexão usa o formato binário, negociado no REQ_ADD.
+  int binary;
+
+  // Indica que a conexão recebe a presença compacta, negociada no REQ_ADD.
+  int presence;
+
+  // Versão de presença da entrada do usuário no grupo. As alterações até essa
+  // versão já estão refletidas na lista recebida ao entrar, e não são
+  // anunciadas a ele.
+  uint32_t presence_since;
+
+  // Formato em que as mensagens são codificadas para a conexão (FORMAT_TEXT,
+  // FORMAT_BINARY ou FORMAT_LZ), negociado no REQ_ADD.
+  int format;
+
+  // Estado da conexão no backend io_uring: recebimento multishot ativo, envio
+  // em andamento, presença na lista "dirty" do reator e encerramento do
+  // socket já solicitado.
+  int receiving;
+  int sending;
+  int dirty;
+  int shut;
+  struct conn_t* next_dirty;
+
+  // Mensagem usada pelo envio em andamento, que precisa permanecer válida até
+  // a sua conclusão.
+  struct msghdr send_hdr;
+  struct iovec send_iov[OUTQ_IOV_MAX];
+
+  // Indica que a conexão foi aceita no socket UNIX.
+  int local;
+
+  // Indica que o cliente enviou um quadro inválido e que a conexão está sendo
+  // encerrada.
+  int rejected;
+
+  // File descriptors da memória compartilhada recebidos junto com o REQ_ADD,
+  // ainda não usados.
+  int fds[SHM_NUM_FDS];
+  int num_fds;
+
+  // Anéis de memória compartilhada, usados no lugar do socket caso negociados
+  // no REQ_ADD.
+  shm_link_t shm;
+} conn_t;
+
+// Mensagem a ser enviada para vários destinatários. A mensagem é codificada sob
+// demanda, no máximo uma vez em cada formato, em buffers compartilhados por
+// todos os destinatários.
+typedef struct fanout_t {
+  // Mensagem a ser enviada.
+  const msg_view_t* msg;
+
+  // Conexões que recebem a mensagem (FANOUT_ALL, FANOUT_PRESENCE ou
+  // FANOUT_LEGACY).
+  int audience;
+
+  // Versão de presença de um anúncio de entrada ou saída, que não é enviado aos
+  // usuários que entraram no grupo nessa versão ou depois, ou 0 para as demais
+  // mensagens.
+  uint32_t version;
+
+  // Quadros codificados, indexados pelo formato, ou NULL caso o formato ainda
+  // não tenha sido usado.
+  shbuf_t* frames[NUM_FORMATS];
+} fanout_t;
+
+// Todas as conexões.
+#define FANOUT_ALL 0
+// Apenas as conexões que recebem a presença compacta.
+#define FANOUT_PRESENCE 1
+// Apenas as conexões que não recebem a presença compacta.
+#define FANOUT_LEGACY 2
+
+// Entrega feita por um reator a outro, pela caixa de mensagens do reator de
+// destino. Os quadros já estão codificados nos formatos necessários.
+typedef struct letter_t {
+  mailbox_node_t node;
+
+  // Tipo da entrega (LETTER_BROADCAST, LETTER_PRIVATE ou LETTER_ROOM).
+  int kind;
+
+  // ID (tipo) da mensagem entregue.
+  unsigned int id_msg;
+
+  // Destinatários e versão de presença do broadcast, como em "fanout_t".
+  int audience;
+  uint32_t version;
+
+  // Para um broadcast, ID do usuário que não deve recebê-lo. Para uma mensagem
+  // privada, ID do destinatário.
+  int id;
+
+  // Sala de destino de uma mensagem de sala, da qual a entrega possui uma
+  // referência.
+  room_t* room;
+
+  // Quadros da mensagem, indexados pelo formato. Uma mensagem privada usa
+  // apenas o quadro do formato do destinatário.
+  shbuf_t* frames[NUM_FORMATS];
+} letter_t;
+
+// Mensagem pública, enviada a todos os usuários do reator de destino.
+#define LETTER_BROADCAST 0
+// Mensagem privada, enviada a um único usuário.
+#define LETTER_PRIVATE 1
+// Mensagem de sala, enviada aos membros da sala que pertencem ao reator.
+#define LETTER_ROOM 2
+
+// Tabela de consulta das conexões pelo ID do usuário, lida sem travas. As
+// posições são alteradas individualmente pelas operações de escrita, e a tabela
+// só é substituída quando precisa crescer.
+typedef struct lookup_t {
+  size_t capacity;
+  _Atomic(conn_t*) slots[];
+} lookup_t;
+
+// Tabela de consulta publicada atualmente.
+_Atomic(lookup_t*) lookup;
+
+// Cria uma tabela de consulta com "capacity" posições, copiando as posições da
+// tabela "old", caso ela não seja nula.
+lookup_t* lookup_new(size_t capacity, const lookup_t* old) {
+  lookup_t* table = (lookup_t*)malloc(sizeof(lookup_t) + capacity * sizeof(conn_t*));
+  if (table == NULL) {
+    log_exit("malloc");
+  }
+
+  table->capacity = capacity;
+  for (size_t i = 0; i < capacity; i++) {
+    conn_t* conn = (old != NULL && i < old->capacity) ? atomic_load(&old->slots[i]) : NULL;
+    atomic_init(&table->slots[i], conn);
+  }
+
+  return table;
+}
+
+// Retorna a conexão do usuário de ID "id", ou NULL caso ele não esteja ativo.
+// Não usa travas, e o ponteiro retornado permanece válido até o próximo estado
+// quiescente da thread.
+conn_t* lookup_conn(int id) {
+  lookup_t* table = atomic_load(&lookup);
+  if (id < 0 || (size_t)id >= table->capacity) {
+    return NULL;
+  }
+
+  return atomic_load(&table->slots[id]);
+}
+
+// Adiciona a conexão "conn" ao registro, à tabela de consulta e aos membros do
+// seu reator. Retorna o ID do usuário, ou NULL_ID caso o limite de usuários
+// tenha sido atingido. Deve ser chamada em exclusão mútua, pela thread do
+// reator da conexão, e apenas uma vez para cada conexão.
+int add_member(conn_t* conn) {
+  assert(conn->id == NULL_ID && conn->slot < 0);
+
+  int id = registry_add(&clients, conn);
+  if (id == NULL_ID) {
+    return NULL_ID;
+  }
+  conn->id = id;
+
+  lookup_t* table = atomic_load(&lookup);
+  if ((size_t)id >= table->capacity) {
+    lookup_t* bigger = lookup_new(clients.capacity, table);
+    atomic_store(&lookup, bigger);
+    qsbr_retire(&qsbr, table, free);
+    table = bigger;
+  }
+  atomic_store(&table->slots[id], conn);
+
+  reactor_t* reactor = conn->reactor;
+  if (reactor->num_members == reactor->members_capacity) {
+    size_t capacity = reactor->members_capacity * 2;
+    conn_t** members = (conn_t**)realloc(reactor->members, capacity * sizeof(conn_t*));
+    if (members == NULL) {
+      log_exit("realloc");
+    }
+    reactor->members = members;
+    reactor->members_capacity = capacity;
+  }
+  conn->slot = reactor->num_members;
+  reactor->members[reactor->num_members++] = conn;
+  atomic_store(&reactor->active, reactor->num_members);
+  if (conn->presence) {
+    atomic_fetch_add(&reactor->active_presence, 1);
+  }
+
+  return id;
+}
+
+void leave_room(conn_t* conn, int index);
+
+// Remove o usuário da conexão "conn" do registro, da tabela de consulta, dos
+// membros do seu reator e das suas salas. Deve ser chamada em exclusão mútua,
+// pela thread do reator da conexão.
+void remove_member(conn_t* conn) {
+  if (registry_remove(&clients, conn->id) != 0) {
+    return;
+  }
+  atomic_store(&atomic_load(&lookup)->slots[conn->id], NULL);
+
+  // Os membros das salas não são avisados, já que a saída do grupo é
+  // informada a todos os usuários
+  while (conn->num_rooms > 0) {
+    leave_room(conn, conn->num_rooms - 1);
+  }
+
+  // A última conexão do array ocupa a posição da conexão removida
+  reactor_t* reactor = conn->reactor;
+  conn_t* last = reactor->members[--reactor->num_members];
+  reactor->members[conn->slot] = last;
+  last->slot = conn->slot;
+  conn->slot = -1;
+  atomic_store(&reactor->active, reactor->num_members);
+  if (conn->presence) {
+    atomic_fetch_sub(&reactor->active_presence, 1);
+  }
+}
+
+// Libera a memória de uma conexão. É chamada pelo QSBR quando nenhuma thread
+// pode mais estar acessando a conexão.
+void conn_free(void* ptr) {
+  conn_t* conn = (conn_t*)ptr;
+  outq_clear(&conn->out);
+  free(conn);
+}
+
+// Fecha os file descriptors da memória compartilhada recebidos pela conexão
+// "conn" que não foram usados.
+void conn_close_fds(conn_t* conn) {
+  for (int i = 0; i < conn->num_fds; i++) {
+    close(conn->fds[i]);
+  }
+  conn->num_fds = 0;
+}
+
+// Escreve no anel de saída da conexão "conn" o máximo possível de bytes da sua
+// fila de saída. Retorna 1 caso a fila tenha sido esvaziada, 0 caso o anel
+// esteja cheio e -1 caso o anel seja inválido.
+int conn_flush_shm(conn_t* conn) {
+  while (conn->out.head != NULL) {
+    struct iovec iov[OUTQ_IOV_MAX];
+    int iovcnt = outq_iov(&conn->out, iov, OUTQ_IOV_MAX);
+    ssize_t count = shm_writev(&conn->shm, iov, iovcnt);
+    if (count < 0) {
+      return -1;
+    } else if (count == 0) {
+      return 0;
+    }
+
+    outq_consume(&conn->out, count);
+  }
+
+  return 1;
+}
+
+// Fecha o socket da conexão "conn" e adia a liberação da sua memória, já que
+// outros reatores podem ter obtido a conexão a partir da tabela de consulta.
+void conn_release(conn_t* conn) {
+  wheel_remove(&conn->reactor->wheel, &conn->timer);
+  close(conn->sock);
+
+  // O eventfd também está aberto no cliente, então só deixa a instância epoll
+  // quando removido explicitamente
+  if (conn->shm.area != NULL) {
+    epoll_ctl(conn->reactor->epoll_fd, EPOLL_CTL_DEL, conn->shm.wait_fd, NULL);
+  }
+  shm_link_close(&conn->shm);
+  conn_close_fds(conn);
+
+  // Os eventos da conexão que ainda estão no lote atual são ignorados
+  conn->sock = -1;
+  qsbr_retire(&qsbr, conn, conn_free);
+}
+
+// Atualiza os eventos da conexão "conn" registrados na instância epoll: a
+// leitura enquanto a conexão não estiver sendo encerrada e a escrita enquanto
+// houver mensagens na fila de saída. No backend io_uring, a conexão é apenas
+// marcada para que o envio seja submetido junto com os das demais conexões.
+void conn_update_events(conn_t* conn) {
+  if (conn->reactor->backend == BACKEND_URING) {
+    if (conn->out.head != NULL && !conn->dirty) {
+      conn->dirty = 1;
+      conn->next_dirty = conn->reactor->dirty;
+      conn->reactor->dirty = conn;
+    }
+    return;
+  }
+
+  // Com memória compartilhada, a fila é escrita no anel imediatamente, e o
+  // socket só é observado para detectar o encerramento. Quando o anel está
+  // cheio, o cliente notifica o eventfd da conexão ao liberar espaço
+  if (conn->shm.area != NULL && conn->out.head != NULL && conn_flush_shm(conn) < 0) {
+    outq_clear(&conn->out);
+    if (!conn->evicted) {
+      conn->evicted = 1;
+      shutdown(conn->sock, SHUT_RDWR);
+    }
+  }
+
+  uint32_t events = (conn->closing ? 0 : EPOLLIN) |
+                    (conn->out.head != NULL && conn->shm.area == NULL ? EPOLLOUT : 0);
+  if (events == conn->events) {
+    return;
+  }
+
+  struct epoll_event ev = {.events = events, .data.ptr = conn};
+  if (epoll_ctl(conn->reactor->epoll_fd, EPOLL_CTL_MOD, conn->sock, &ev) != 0) {
+    log_exit("epoll_ctl");
+  }
+  conn->events = events;
+}
+
+// Insere na fila de saída da conexão "conn" o quadro formado pelos "n" trechos
+// de "slices", que já contêm o cabeçalho de tamanho, de uma mensagem com ID
+// "id_msg". A função nunca bloqueia: caso a fila esteja cheia, é aplicada a
+// política configurada para clientes lentos. Deve ser chamada pela thread do
+// reator da conexão.
+void conn_send(conn_t* conn, const outq_slice_t* slices, int n, unsigned int id_msg) {
+  reactor_t* reactor = conn->reactor;
+
+  if (conn->closing || conn->evicted) {
+    return;
+  }
+
+  size_t frame_len = 0;
+  for (int i = 0; i < n; i++) {
+    frame_len += slices[i].len;
+  }
+
+  if (conn->out.bytes + frame_len > reactor->max_queue_bytes) {
+    if (reactor->slow_policy == POLICY_DROP) {
+      stats_add(&reactor->stats.dropped, 1);
+      return;
+    } else if (reactor->slow_policy == POLICY_DISCONNECT) {
+      // O encerramento da leitura faz com que o reator remova o usuário do
+      // grupo ao tratar o evento de leitura, e não no meio de um broadcast. A
+      // fila é descartada na próxima tentativa de envio
+      conn->evicted = 1;
+      shutdown(conn->sock, SHUT_RDWR);
+      stats_add(&reactor->stats.evicted, 1);
+      return;
+    }
+
+    size_t dropped = outq_drop_oldest(&conn->out, reactor->max_queue_bytes - frame_len);
+    stats_add(&reactor->stats.dropped, dropped);
+  }
+
+  outq_push(&conn->out, slices, n);
+  conn_update_events(conn);
+
+  if (id_msg < STATS_MSG_TYPES) {
+    stats_add(&reactor->stats.msgs_out[id_msg], 1);
+  }
+  stats_add(&reactor->stats.bytes_out, frame_len);
+  stats_record(&reactor->stats.queue_depth, conn->out.bytes);
+}
+
+// Codifica a mensagem "msg" no formato usado pela conexão "conn" e a insere na
+// fila de saída da conexão.
+void conn_send_msg(conn_t* conn, const msg_view_t* msg) {
+  shbuf_t* frame = shbuf_msg(msg, conn->format);
+  outq_slice_t slice = {.buf = frame, .off = 0, .len = frame->len};
+  conn_send(conn, &slice, 1, msg->id_msg);
+  shbuf_unref(frame);
+}
+
+// Encerra a conexão "conn" depois que todas as mensagens da sua fila de saída
+// forem enviadas. Após a chamada, a conexão não pode mais ser acessada pelo
+// tratamento de leituras.
+void conn_close(conn_t* conn) {
+  conn->closing = 1;
+
+  // No backend io_uring, a conexão é liberada quando não houver mais operações
+  // em andamento, pelo tratamento das conclusões
+  if (conn->reactor->backend == BACKEND_URING) {
+    return;
+  }
+
+  // Caso ainda haja mensagens na fila, a conexão é liberada quando elas
+  // terminarem de ser enviadas
+  if (conn->out.head == NULL) {
+    conn_release(conn);
+  } else {
+    conn_update_events(conn);
+  }
+}
+
+// Encerra a conexão "conn", cujo cliente enviou um quadro inválido, da mesma
+// forma que a de um cliente lento: o tratamento da leitura remove o usuário do
+// grupo, e os demais clientes não são afetados. Os bytes ainda não processados
+// são descartados.
+void conn_reject(conn_t* conn) {
+  frame_reader_init(&conn->reader);
+  conn->rejected = 1;
+  if (!conn->evicted) {
+    log_printf(LOG_ERROR, "Error while parsing incoming message from user %d", conn->id);
+    conn->evicted = 1;
+    shutdown(conn->sock, SHUT_RDWR);
+  }
+}
+
+// Retorna 1 caso o conteúdo da mensagem "msg" contenha a palavra "cap", que
+// representa uma capacidade solicitada pelo cliente no REQ_ADD.
+int has_capability(const msg_view_t* msg, const char* cap) {
+  size_t cap_len = strlen(cap);
+  size_t i = 0;
+  while (i < msg->len) {
+    // As palavras do conteúdo são separadas por espaços
+    size_t j = i;
+    while (j < msg->len && msg->message[j] != ' ') {
+      j++;
+    }
+
+    if (j - i == cap_len && memcmp(msg->message + i, cap, cap_len) == 0) {
+      return 1;
+    }
+    i = j + 1;
+  }
+
+  return 0;
+}
+
+// Função auxiliar para obter uma representação em string da lista de usuários
+// ativos no momento. Os IDs são lidos do array denso do registro a partir da
+// posição "*pos", até que a string atinja "max_len" bytes. Ao final, "*pos"
+// indica a posição do primeiro ID que não foi incluído. Retorna o tamanho da
+// string. Como essa função precisa percorrer o registro, ela precisa ser
+// executada em exclusão mútua para evitar possíveis condições de corrida.
+size_t get_user_list(char* buffer, size_t max_len, size_t* pos) {
+  size_t len = 0;
+  char temp[16];
+  for (; *pos < registry_count(&clients); (*pos)++) {
+    int temp_len = sprintf(temp, "%d,", registry_id_at(&clients, *pos));
+    if (len + temp_len > max_len) {
+      break;
+    }
+
+    memcpy(buffer + len, temp, temp_len);
+    len += temp_len;
+  }
+
+  // Remove a última vírgula
+  buffer[len - 1] = '\0';
+  return len - 1;
+}
+
+// Retorna o quadro da mensagem de "fanout" no formato "format", codificando-o
+// caso seja a primeira vez que esse formato é solicitado. A compactação é feita
+// uma única vez para todos os destinatários que a usam.
+shbuf_t* fanout_frame(fanout_t* fanout, int format) {
+  if (fanout->frames[format] != NULL) {
+    return fanout->frames[format];
+  }
+
+  if (format == FORMAT_LZ && fanout->msg->len < LZ_MIN_SIZE) {
+    // Mensagens curtas não são compactadas, então o quadro binário é
+    // compartilhado pelos dois formatos
+    fanout->frames[format] = fanout_frame(fanout, FORMAT_BINARY);
+    shbuf_ref(fanout->frames[format]);
+  } else {
+    fanout->frames[format] = shbuf_msg(fanout->msg, format);
+  }
+
+  return fanout->frames[format];
+}
+
+// Libera as referências aos quadros codificados de "fanout". Os quadros
+// continuam válidos enquanto estiverem em alguma fila de saída.
+void fanout_release(fanout_t* fanout) {
+  for (int i = 0; i < NUM_FORMATS; i++) {
+    if (fanout->frames[i] != NULL) {
+      shbuf_unref(fanout->frames[i]);
+      fanout->frames[i] = NULL;
+    }
+  }
+}
+
+// Retorna 1 caso a conexão "conn" seja uma das destinatárias de "fanout".
+int fanout_accepts(const fanout_t* fanout, const conn_t* conn) {
+  if (fanout->audience != FANOUT_ALL && conn->presence != (fanout->audience == FANOUT_PRESENCE)) {
+    return 0;
+  }
+
+  return fanout->version == 0 || (int32_t)(fanout->version - conn->presence_since) > 0;
+}
+
+// Envia a mensagem de "fanout" a todos os usuários do reator "reactor", exceto
+// o usuário de ID "skip_id". Retorna o número de destinatários.
+size_t broadcast_local(reactor_t* reactor, fanout_t* fanout, int skip_id) {
+  size_t count = 0;
+  for (size_t i = 0; i < reactor->num_members; i++) {
+    conn_t* conn = reactor->members[i];
+    if (conn->id == skip_id || !fanout_accepts(fanout, conn)) {
+      continue;
+    }
+
+    shbuf_t* frame = fanout_frame(fanout, conn->format);
+    outq_slice_t slice = {.buf = frame, .off = 0, .len = frame->len};
+    conn_send(conn, &slice, 1, fanout->msg->id_msg);
+    count++;
+  }
+
+  return count;
+}
+
+// Cria uma entrega do tipo "kind", da mensagem de "fanout", e a insere na caixa
+// de mensagens do reator "target". A entrega recebe uma referência a cada
+// quadro já codificado de "fanout" e à sala "room", caso ela não seja nula.
+void post_letter(reactor_t* target, int kind, const fanout_t* fanout, int id, room_t* room) {
+  letter_t* letter = (letter_t*)pool_alloc(sizeof(letter_t));
+
+  letter->kind = kind;
+  letter->id_msg = fanout->msg->id_msg;
+  letter->audience = fanout->audience;
+  letter->version = fanout->version;
+  letter->id = id;
+  letter->room = room;
+  if (room != NULL) {
+    room_ref(room);
+  }
+  for (int i = 0; i < NUM_FORMATS; i++) {
+    letter->frames[i] = fanout->frames[i];
+    if (fanout->frames[i] != NULL) {
+      shbuf_ref(fanout->frames[i]);
+    }
+  }
+
+  mailbox_post(&target->mailbox, &letter->node);
+}
+
+// Função usada para enviar mensagem pública a todos os usuários ativos no
+// momento. O usuário de ID "skip_id" é ignorado, o que pode ser útil, por
+// exemplo, para enviar uma versão alterada da mensagem para ele. Todos os
+// destinatários que usam o mesmo formato compartilham o mesmo quadro, inclusive
+// os usuários dos demais reatores, que recebem uma única entrega cada. Fora da
+// thread de um reator, "reactor" é NULL e todos os reatores recebem entregas.
+void broadcast(reactor_t* reactor, fanout_t* fanout, int skip_id) {
+  size_t recipients = reactor != NULL ? broadcast_local(reactor, fanout, skip_id) : 0;
+
+  for (int i = 0; i < num_reactors; i++) {
+    reactor_t* target = &reactors[i];
+    size_t active = atomic_load(&target->active);
+    size_t active_presence = atomic_load(&target->active_presence);
+    if (fanout->audience == FANOUT_PRESENCE) {
+      active = active_presence;
+    } else if (fanout->audience == FANOUT_LEGACY) {
+      active = active > active_presence ? active - active_presence : 0;
+    }
+    if (target == reactor || active == 0) {
+      continue;
+    }
+
+    // O conteúdo de "fanout" não permanece válido após o retorno, então todos
+    // os formatos são codificados antes da entrega. A presença compacta exige
+    // o formato binário
+    for (int format = 0; format < NUM_FORMATS; format++) {
+      if (format != FORMAT_TEXT || fanout->audience != FANOUT_PRESENCE) {
+        fanout_frame(fanout, format);
+      }
+    }
+    post_letter(target, LETTER_BROADCAST, fanout, skip_id, NULL);
+    recipients += active;
+  }
+
+  if (reactor != NULL) {
+    stats_record(&reactor->stats.fanout, recipients);
+  }
+}
+
+// Envia a mensagem privada "msg" ao usuário da conexão "receiver", diretamente
+// caso ele pertença ao reator "reactor" ou pela caixa de mensagens do seu
+// reator caso contrário.
+void send_private(reactor_t* reactor, conn_t* receiver, const msg_view_t* msg) {
+  if (receiver->reactor == reactor) {
+    conn_send_msg(receiver, msg);
+    return;
+  }
+
+  fanout_t fanout = {.msg = msg};
+  fanout.frames[receiver->format] = shbuf_msg(msg, receiver->format);
+  post_letter(receiver->reactor, LETTER_PRIVATE, &fanout, msg->id_receiver, NULL);
+  fanout_release(&fanout);
+}
+
+// Retorna o índice do reator "reactor", que também indexa os membros de cada
+// sala que pertencem a ele.
+int reactor_index(const reactor_t* reactor) {
+  return reactor - reactors;
+}
+
+// Envia a mensagem de "fanout" aos membros da sala "room" que pertencem ao
+// reator "reactor". Retorna o número de destinatários.
+size_t room_broadcast_local(reactor_t* reactor, room_t* room, fanout_t* fanout) {
+  room_local_t* set = &room->local[reactor_index(reactor)];
+  for (size_t i = 0; i < set->num; i++) {
+    conn_t* conn = (conn_t*)set->members[i];
+    shbuf_t* frame = fanout_frame(fanout, conn->format);
+    outq_slice_t slice = {.buf = frame, .off = 0, .len = frame->len};
+    conn_send(conn, &slice, 1, fanout->msg->id_msg);
+  }
+
+  return set->num;
+}
+
+// Envia a mensagem de "fanout" a todos os membros da sala "room", inclusive ao
+// remetente. Apenas os membros da sala são percorridos, e os reatores sem
+// membros da sala não recebem entregas, de modo que o custo não depende do
+// número total de usuários.
+void room_broadcast(reactor_t* reactor, room_t* room, fanout_t* fanout) {
+  size_t recipients = room_broadcast_local(reactor, room, fanout);
+
+  for (int i = 0; i < num_reactors; i++) {
+    size_t active = atomic_load(&room->local[i].active);
+    if (i == reactor_index(reactor) || active == 0) {
+      continue;
+    }
+
+    for (int format = 0; format < NUM_FORMATS; format++) {
+      fanout_frame(fanout, format);
+    }
+    post_letter(&reactors[i], LETTER_ROOM, fanout, NULL_ID, room);
+    recipients += active;
+  }
+
+  stats_record(&reactor->stats.fanout, recipients);
+}
+
+// Retorna a posição da sala de nome "name", de tamanho "len", entre as salas do
+// usuário da conexão "conn", ou -1 caso ele não esteja na sala. O nome precisa
+// ter sido verificado por "room_name_valid", já que "len" limita a comparação.
+int conn_room(const conn_t* conn, const char* name, size_t len) {
+  for (int i = 0; i < conn->num_rooms; i++) {
+    const char* room_name = conn->rooms[i]->name;
+    if (strncmp(room_name, name, len) == 0 && room_name[len] == '\0') {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Adiciona o usuário da conexão "conn" à sala de nome "name", de tamanho "len",
+// criando a sala caso ela não exista. O usuário não pode estar na sala.
+// Retorna a sala. Deve ser chamada em exclusão mútua, pela thread do reator da
+// conexão.
+room_t* join_room(conn_t* conn, const char* name, size_t len) {
+  room_t* room = room_find(&room_table, name, len);
+  if (room == NULL) {
+    room = room_create(&room_table, name, len);
+  }
+
+  room->count++;
+  conn->rooms[conn->num_rooms] = room;
+  conn->room_slots[conn->num_rooms] =
+      room_local_add(room, reactor_index(conn->reactor), conn);
+  conn->num_rooms++;
+
+  return room;
+}
+
+// Remove o usuário da conexão "conn" da sala na posição "index" das suas
+// salas, removendo a sala caso ela fique vazia. Deve ser chamada em exclusão
+// mútua, pela thread do reator da conexão.
+void leave_room(conn_t* conn, int index) {
+  room_t* room = conn->rooms[index];
+
+  // O membro que ocupa a posição do usuário na sala tem sua posição atualizada
+  conn_t* moved =
+      (conn_t*)room_local_remove(room, reactor_index(conn->reactor), conn->room_slots[index]);
+  if (moved != NULL) {
+    moved->room_slots[conn_room(moved, room->name, strlen(room->name))] =
+        conn->room_slots[index];
+  }
+
+  conn->num_rooms--;
+  conn->rooms[index] = conn->rooms[conn->num_rooms];
+  conn->room_slots[index] = conn->room_slots[conn->num_rooms];
+
+  if (--room->count == 0) {
+    room_drop(&room_table, room);
+  }
+}
+
+// Processa as entregas pendentes na caixa de mensagens do reator "reactor".
+void handle_letters(reactor_t* reactor) {
+  mailbox_ack(&reactor->mailbox);
+
+  mailbox_node_t* node;
+  while ((node = mailbox_pop(&reactor->mailbox)) != NULL) {
+    letter_t* letter = (letter_t*)node;
+
+    // Os quadros já estão codificados, então a mensagem só informa o seu ID
+    msg_view_t msg = {.id_msg = letter->id_msg};
+    fanout_t fanout = {.msg = &msg, .audience = letter->audience, .version = letter->version};
+    memcpy(fanout.frames, letter->frames, sizeof(fanout.frames));
+
+    if (letter->kind == LETTER_BROADCAST) {
+      broadcast_local(reactor, &fanout, letter->id);
+    } else if (letter->kind == LETTER_ROOM) {
+      // Os membros da sala são os atuais, e não os do momento do envio
+      room_broadcast_local(reactor, letter->room, &fanout);
+      room_unref(letter->room);
+    } else {
+      // O destinatário pode ter saído do grupo, e seu ID pode ter sido
+      // reaproveitado por um usuário de outro reator ou de outro formato
+      conn_t* conn = lookup_conn(letter->id);
+      if (conn != NULL && conn->reactor == reactor && fanout.frames[conn->format] != NULL) {
+        shbuf_t* frame = fanout.frames[conn->format];
+        outq_slice_t slice = {.buf = frame, .off = 0, .len = frame->len};
+        conn_send(conn, &slice, 1, letter->id_msg);
+      }
+    }
+
+    fanout_release(&fanout);
+    pool_free(letter);
+  }
+}
+
+// Envia para o remetente de uma mensagem pública a sua cópia da mensagem, com o
+// prefixo "-> all ". Apenas o cabeçalho é codificado novamente: o conteúdo é
+// referenciado diretamente no quadro compartilhado do broadcast, sempre sem
+// compactação.
+void send_echo(conn_t* conn, fanout_t* fanout) {
+  const char* prefix = "-> all ";
+  size_t prefix_len = strlen(prefix);
+
+  shbuf_t* frame = fanout_frame(fanout, conn->binary);
+
+  // Posição e tamanho do conteúdo dentro do quadro compartilhado
+  char scratch[64];
+  size_t hdr_len = conn->binary ? encode_bin_header(fanout->msg, scratch)
+                                : encode_view_header(fanout->msg, scratch);
+  size_t payload_off = sizeof(uint16_t) + hdr_len;
+  size_t payload_len = frame->len - payload_off;
+
+  // A cópia precisa caber no buffer de recebimento do cliente
+  size_t max_len = BUFFER_SIZE - 1 - hdr_len;
+  if (prefix_len + payload_len > max_len) {
+    payload_len = max_len - prefix_len;
+  }
+
+  msg_view_t echo = *fanout->msg;
+  echo.len = prefix_len + payload_len;
+
+  shbuf_t* head = shbuf_new(sizeof(uint16_t) + hdr_len + prefix_len);
+  uint16_t msg_size = htons(hdr_len + echo.len);
+  memcpy(head->data, &msg_size, sizeof(uint16_t));
+  if (conn->binary) {
+    encode_bin_header(&echo, head->data + sizeof(uint16_t));
+  } else {
+    encode_view_header(&echo, head->data + sizeof(uint16_t));
+  }
+  memcpy(head->data + sizeof(uint16_t) + hdr_len, prefix, prefix_len);
+
+  outq_slice_t slices[2] = {{.buf = head, .off = 0, .len = head->len},
+                            {.buf = frame, .off = payload_off, .len = payload_len}};
+  conn_send(conn, slices, 2, echo.id_msg);
+  shbuf_unref(head);
+}
+
+// Envia uma mensagem do tipo ERROR na conexão "conn", para o destinatário de ID
+// "id_receiver" e com a mensagem de código "error_code", em resposta à
+// requisição de ID "req_id".
+void error_msg(conn_t* conn, int id_receiver, int error_code, uint32_t req_id) {
+  msg_view_t msg = {
+      .id_msg = ERROR, .id_sender = NULL_ID, .id_receiver = id_receiver, .req_id = req_id};
+
+  switch (error_code) {
+  case 1:
+    msg.message = "User limit exceeded";
+    break;
+  case 2:
+    msg.message = "User not found";
+    break;
+  case 3:
+    msg.message = "Receiver not found";
+    break;
+  case 4:
+    msg.message = "Invalid room name";
+    break;
+  case 5:
+    msg.message = "Room limit exceeded";
+    break;
+  case 6:
+    msg.message = "Not a member of the room";
+    break;
+  case 7:
+    msg.message = "Rate limit exceeded";
+    break;
+  case 8:
+    msg.message = "Already in the group";
+    break;
+  }
+  msg.len = strlen(msg.message);
+
+  conn_send_msg(conn, &msg);
+}
+
+// Envia uma mensagem do tipo OK na conexão "conn", para o destinatário de ID
+// "id_receiver", em resposta à requisição de ID "req_id".
+void ok_msg(conn_t* conn, int id_receiver, int ok_code, uint32_t req_id) {
+  msg_view_t msg = {
+      .id_msg = OK, .id_sender = NULL_ID, .id_receiver = id_receiver, .req_id = req_id};
+
+  switch (ok_code) {
+  case 1:
+    msg.message = "Removed Successfully";
+    break;
+  case 2:
+    msg.message = "OK";
+    break;
+  }
+  msg.len = strlen(msg.message);
+
+  conn_send_msg(conn, &msg);
+}
+
+// Informa ao remetente da mensagem STREAM "msg", recebida na conexão "conn",
+// que o stream foi abortado, já que o destinatário não pode recebê-lo. Os
+// trechos restantes do stream também são abortados quando chegarem.
+void abort_stream(conn_t* conn, const msg_view_t* msg) {
+  uint32_t stream_id;
+  int kind;
+  if (decode_stream(msg, &stream_id, &kind) == 0) {
+    conn_reject(conn);
+    return;
+  }
+
+  // Um aviso de aborto ou de cancelamento não gera outro aviso
+  if (kind == STREAM_ABORT || kind == STREAM_CANCEL || !conn->binary) {
+    return;
+  }
+
+  char content[STREAM_HDR_SIZE];
+  msg_view_t ret_msg = {
+      .id_msg = STREAM, .id_sender = msg->id_receiver, .id_receiver = msg->id_sender};
+  ret_msg.message = content;
+  ret_msg.len = encode_stream_header(content, stream_id, STREAM_ABORT);
+  conn_send_msg(conn, &ret_msg);
+}
+
+// Obtém a trava "mutex" para a thread do reator "reactor", registrando o tempo
+// de espera nas estatísticas do reator. O relógio só é consultado quando a
+// trava já está em uso.
+void lock_group(reactor_t* reactor, pthread_mutex_t* mutex) {
+  if (pthread_mutex_trylock(mutex) == 0) {
+    stats_record(&reactor->stats.lock_wait, 0);
+    return;
+  }
+
+  uint64_t start = now_ns();
+  pthread_mutex_lock(mutex);
+  stats_record(&reactor->stats.lock_wait, now_ns() - start);
+}
+
+// Envia ao usuário da conexão "conn" as mensagens do histórico. Os quadros já
+// codificados do histórico são inseridos diretamente na fila de saída, sem
+// cópias, e são enviados juntos na próxima escrita da conexão.
+void send_history(conn_t* conn) {
+  if (history.capacity == 0) {
+    return;
+  }
+
+  shbuf_t** frames = (shbuf_t**)malloc(history.capacity * sizeof(shbuf_t*));
+  if (frames == NULL) {
+    log_exit("malloc");
+  }
+
+  size_t count = history_snapshot(&history, conn->format, frames);
+  for (size_t i = 0; i < count; i++) {
+    outq_slice_t slice = {.buf = frames[i], .off = 0, .len = frames[i]->len};
+    conn_send(conn, &slice, 1, HISTORY);
+    shbuf_unref(frames[i]);
+  }
+
+  free(frames);
+}
+
+// Verifica se o reator "reactor" ainda pode fazer "recipients" entregas no
+// segundo atual. Um broadcast maior do que o limite só é admitido quando a
+// parcela do reator está completa.
+int fanout_admit(reactor_t* reactor, size_t recipients) {
+  bucket_t* budget = &reactor->fanout_budget;
+  double cost = recipients < budget->burst ? recipients : budget->burst;
+  if (bucket_take(budget, cost, reactor->now_ms)) {
+    return 1;
+  }
+
+  stats_add(&reactor->stats.fanout_throttled, 1);
+  return 0;
+}
+
+// Retorna o número de usuários ativos em todos os reatores.
+size_t group_size() {
+  size_t count = 0;
+  for (int i = 0; i < num_reactors; i++) {
+    count += atomic_load(&reactors[i].active);
+  }
+  return count;
+}
+
+// Retorna o número de membros da sala "room" em todos os reatores.
+size_t room_size(room_t* room) {
+  size_t count = 0;
+  for (int i = 0; i < room->num_locals; i++) {
+    count += atomic_load(&room->local[i].active);
+  }
+  return count;
+}
+
+void presence_sync(conn_t* conn, pthread_mutex_t* mutex);
+
+// Realiza o processamento da mensagem de sala "msg" (ROOM_JOIN, ROOM_LEAVE ou
+// ROOM_MSG) recebida na conexão "conn", cujo usuário está no grupo.
+void handle_room_msg(conn_t* conn, pthread_mutex_t* mutex, const msg_view_t* msg) {
+  msg_view_t relay = *msg;
+  relay.req_id = 0;
+
+  // Os membros das salas recebem o anúncio da entrada do remetente antes das
+  // suas mensagens
+  presence_sync(conn, mutex);
+
+  if (msg->id_msg == ROOM_MSG) {
+    // O nome da sala é a primeira palavra do conteúdo. O envio é feito sem
+    // travas, já que as salas do usuário só são alteradas por esta thread
+    const char* space = memchr(msg->message, ' ', msg->len);
+    size_t name_len = space != NULL ? (size_t)(space - msg->message) : msg->len;
+    if (!room_name_valid(msg->message, name_len)) {
+      error_msg(conn, msg->id_sender, 4, msg->req_id);
+      return;
+    }
+    int index = conn_room(conn, msg->message, name_len);
+    if (index < 0) {
+      error_msg(conn, msg->id_sender, 6, msg->req_id);
+      return;
+    }
+    if (!fanout_admit(conn->reactor, room_size(conn->rooms[index]))) {
+      error_msg(conn, msg->id_sender, 7, msg->req_id);
+      return;
+    }
+
+    fanout_t fanout = {.msg = &relay};
+    room_broadcast(conn->reactor, conn->rooms[index], &fanout);
+    fanout_release(&fanout);
+    if (wal != NULL) {
+      wal_append(wal, &relay);
+    }
+    return;
+  }
+
+  if (!room_name_valid(msg->message, msg->len)) {
+    error_msg(conn, msg->id_sender, 4, msg->req_id);
+    return;
+  }
+
+  // A tabela e os membros das salas são alterados em exclusão mútua
+  lock_group(conn->reactor, mutex);
+
+  int index = conn_room(conn, msg->message, msg->len);
+  if (msg->id_msg == ROOM_JOIN) {
+    if (index >= 0) {
+      // Uma nova entrada na mesma sala é apenas confirmada ao usuário
+      conn_send_msg(conn, &relay);
+    } else if (conn->num_rooms == ROOMS_PER_USER) {
+      error_msg(conn, msg->id_sender, 5, msg->req_id);
+    } else {
+      room_t* room = join_room(conn, msg->message, msg->len);
+
+      fanout_t fanout = {.msg = &relay};
+      room_broadcast(conn->reactor, room, &fanout);
+      fanout_release(&fanout);
+    }
+  } else {
+    if (index < 0) {
+      error_msg(conn, msg->id_sender, 6, msg->req_id);
+    } else {
+      // A saída é informada antes da remoção, de modo que o próprio usuário
+      // também a recebe
+      fanout_t fanout = {.msg = &relay};
+      room_broadcast(conn->reactor, conn->rooms[index], &fanout);
+      fanout_release(&fanout);
+
+      leave_room(conn, index);
+    }
+  }
+
+  pthread_mutex_unlock(mutex);
+}
+
+// Envia ao usuário da conexão "conn" o snapshot de presença, com os IDs ativos
+// em ordem crescente, em uma ou mais mensagens PRESENCE. Deve ser chamada em
+// exclusão mútua.
+void send_snapshot(conn_t* conn) {
+  int* ids = (int*)malloc(registry_count(&clients) * sizeof(int));
+  if (ids == NULL) {
+    log_exit("malloc");
+  }
+
+  size_t count = 0;
+  for (int id = registry_next(&clients, 0); id != NULL_ID; id = registry_next(&clients, id + 1)) {
+    ids[count++] = id;
+  }
+
+  char payload[WIRE_MAX_PAYLOAD];
+  msg_view_t msg = {.id_msg = PRESENCE, .id_sender = NULL_ID, .id_receiver = NULL_ID};
+  msg.message = payload;
+
+  size_t pos = 0;
+  while (pos < count) {
+    msg.len =
+        presence_encode_snapshot(payload, WIRE_MAX_PAYLOAD, presence_version, ids, count, &pos);
+    conn_send_msg(conn, &msg);
+  }
+
+  free(ids);
+}
+
+// Anuncia as alterações de presença acumuladas. Os usuários com presença
+// compacta recebem todas elas em mensagens PRESENCE, e os demais recebem, para
+// cada alteração, o MSG "User N joined the group!" ou o REQ_REM do usuário,
+// como se ela tivesse sido anunciada individualmente. Deve ser chamada em
+// exclusão mútua, pela thread do reator "reactor" ou, com "reactor" NULL, por
+// outra thread.
+void presence_flush(reactor_t* reactor) {
+  presence_batch_t* batch = &presence_batch;
+  uint32_t first = atomic_load(&batch->announced) + 1;
+
+  // Os grupos de destinatários sem usuários são ignorados, já que cada
+  // anúncio percorreria os membros dos reatores mesmo sem enviar nada
+  size_t active = 0, active_presence = 0;
+  for (int i = 0; i < num_reactors; i++) {
+    active += atomic_load(&reactors[i].active);
+    active_presence += atomic_load(&reactors[i].active_presence);
+  }
+
+  char payload[WIRE_MAX_PAYLOAD];
+  msg_view_t delta = {.id_msg = PRESENCE, .id_sender = NULL_ID, .id_receiver = NULL_ID};
+  delta.message = payload;
+
+  size_t pos = 0;
+  while (active_presence > 0 && pos < batch->count) {
+    delta.len =
+        presence_encode_delta(payload, WIRE_MAX_PAYLOAD, first, batch->changes, batch->count, &pos);
+
+    fanout_t fanout = {.msg = &delta, .audience = FANOUT_PRESENCE, .version = first + pos - 1};
+    broadcast(reactor, &fanout, NULL_ID);
+    fanout_release(&fanout);
+  }
+
+  for (size_t i = 0; active > active_presence && i < batch->count; i++) {
+    const presence_change_t* change = &batch->changes[i];
+
+    char text[BUFFER_SIZE];
+    msg_view_t msg = {.id_sender = change->id, .id_receiver = NULL_ID};
+    if (change->present) {
+      msg.id_msg = MSG;
+      msg.message = text;
+      msg.len = sprintf(text, "User %d joined the group!", change->id);
+    } else {
+      msg.id_msg = REQ_REM;
+      msg.message = "REQ_REM";
+      msg.len = strlen("REQ_REM");
+    }
+
+    fanout_t fanout = {.msg = &msg, .audience = FANOUT_LEGACY, .version = first + i};
+    broadcast(reactor, &fanout, NULL_ID);
+    fanout_release(&fanout);
+  }
+
+  atomic_store(&batch->announced, first + batch->count - 1);
+  batch->count = 0;
+}
+
+// Registra a entrada (present = 1) ou a saída (present = 0) do usuário da
+// conexão "conn", que é anunciada a todos os usuários ao final da janela de
+// presença. Na entrada, a conexão passa a ignorar as alterações até a sua.
+// Deve ser chamada em exclusão mútua, pela thread do reator "reactor".
+void presence_change(reactor_t* reactor, conn_t* conn, int present) {
+  presence_batch_t* batch = &presence_batch;
+
+  batch->changes[batch->count].id = conn->id;
+  batch->changes[batch->count].present = present;
+  batch->count++;
+  presence_version++;
+  if (present) {
+    conn->presence_since = presence_version;
+  }
+
+  if (batch->window_ms == 0 || batch->count == PRESENCE_BATCH_SIZE) {
+    presence_flush(reactor);
+  } else if (batch->count == 1) {
+    batch->start_ms = reactor->now_ms;
+    pthread_cond_signal(&batch->wakeup);
+  }
+}
+
+// Anuncia a entrada do usuário da conexão "conn" caso ela ainda esteja
+// acumulada, de modo que os demais usuários sempre conhecem o remetente antes
+// de receberem as suas mensagens.
+void presence_sync(conn_t* conn, pthread_mutex_t* mutex) {
+  if ((int32_t)(conn->presence_since - atomic_load(&presence_batch.announced)) <= 0) {
+    return;
+  }
+
+  lock_group(conn->reactor, mutex);
+  if (presence_batch.count > 0) {
+    presence_flush(conn->reactor);
+  }
+  pthread_mutex_unlock(mutex);
+}
+
+// Função executada pela thread que anuncia as alterações de presença ao final
+// de cada janela, mesmo que nenhum reator tenha atividade.
+void* presence_thread(void* args) {
+  presence_batch_t* batch = &presence_batch;
+
+  pthread_mutex_lock(&mutex);
+  while (1) {
+    if (batch->count == 0) {
+      pthread_cond_wait(&batch->wakeup, &mutex);
+      continue;
+    }
+
+    uint64_t deadline_ms = batch->start_ms + batch->window_ms;
+    if (now_ns() / 1000000 >= deadline_ms) {
+      presence_flush(NULL);
+      continue;
+    }
+
+    struct timespec deadline = {.tv_sec = deadline_ms / 1000,
+                                .tv_nsec = (deadline_ms % 1000) * 1000000};
+    pthread_cond_timedwait(&batch->wakeup, &mutex, &deadline);
+  }
+
+  pthread_exit(NULL);
+}
+
+// Passa a usar, na conexão "conn", os anéis de memória compartilhada cujos file
+// descriptors foram recebidos junto com o REQ_ADD. O transporte só é oferecido
+// no backend epoll, já que os recebimentos do io_uring não trazem file
+// descriptors. Caso não seja possível usá-lo, a conexão continua no socket.
+void conn_attach_shm(conn_t* conn) {
+  if (conn->reactor->backend != BACKEND_EPOLL || conn->num_fds != SHM_NUM_FDS ||
+      conn->shm.area != NULL) {
+    conn_close_fds(conn);
+    return;
+  }
+
+  conn->num_fds = 0;
+  if (shm_link_attach(&conn->shm, conn->fds) != 0) {
+    return;
+  }
+
+  struct epoll_event ev = {.events = EPOLLIN, .data.u64 = (uintptr_t)conn | EPOLL_TAG_SHM};
+  if (epoll_ctl(conn->reactor->epoll_fd, EPOLL_CTL_ADD, conn->shm.wait_fd, &ev) != 0) {
+    log_exit("epoll_ctl");
+  }
+
+  // O reator aguarda desde já os quadros do cliente
+  shm_idle(&conn->shm);
+}
+
+// Realiza o processamento da mensagem "msg" recebida na conexão "conn". Retorna
+// 1 caso a conexão deva continuar aberta e 0 caso ela deva ser encerrada.
+int handle_msg(conn_t* conn, pthread_mutex_t* mutex, const msg_view_t* msg) {
+  if (msg->id_msg == REQ_ADD) {
+    // Uma conexão entra no grupo apenas uma vez, e mantém o ID e o formato
+    // definidos no primeiro REQ_ADD
+    if (conn->id != NULL_ID) {
+      error_msg(conn, conn->id, 8, msg->req_id);
+      return 1;
+    }
+
+    // O formato binário passa a ser usado já na resposta ao REQ_ADD
+    conn->binary = has_capability(msg, CAP_BINARY);
+    conn->format = FORMAT_TEXT;
+    if (conn->binary) {
+      conn->format = has_capability(msg, CAP_LZ) ? FORMAT_LZ : FORMAT_BINARY;
+    }
+    conn->presence = conn->binary && has_capability(msg, CAP_PRESENCE);
+
+    // Um cliente local passa a usar os anéis de memória compartilhada também
+    // já na resposta
+    if (has_capability(msg, CAP_SHM)) {
+      conn_attach_shm(conn);
+    }
+
+    lock_group(conn->reactor, mutex);
+
+    // Define um identificador para o usuário
+    int new_id = add_member(conn);
+    if (new_id == NULL_ID) {
+      pthread_mutex_unlock(mutex);
+      // id_receiver precisa ser nulo nesse caso, pois o usuário não possui um
+      // ID
+      error_msg(conn, NULL_ID, 1, msg->req_id);
+
+      // Como o limite de usuários já foi excedido, a conexão é encerrada
+      return 0;
+    }
+    log_event(LOG_INFO, LOG_EVENT_ADDED, new_id);
+
+    // A mensagem informando que o novo usuário entrou no grupo é a resposta ao
+    // REQ_ADD, e é anunciada aos demais usuários ao final da janela de presença
+    char text[BUFFER_SIZE];
+    msg_view_t ret_msg = {.id_msg = MSG, .id_sender = new_id, .id_receiver = NULL_ID};
+    ret_msg.message = text;
+    ret_msg.len = sprintf(text, "User %d joined the group!", new_id);
+
+    conn_send_msg(conn, &ret_msg);
+    presence_change(conn->reactor, conn, 1);
+
+    if (conn->presence) {
+      send_snapshot(conn);
+    } else {
+      // Envia a lista dos atuais integrantes do grupo para o novo usuário. Caso
+      // a lista não caiba em uma única mensagem, ela é dividida em várias
+      // mensagens do tipo RES_LIST
+      ret_msg.id_msg = RES_LIST;
+      ret_msg.id_sender = NULL_ID;
+      ret_msg.id_receiver = NULL_ID;
+
+      size_t pos = 0;
+      while (pos < registry_count(&clients)) {
+        ret_msg.len = get_user_list(text, WIRE_MAX_PAYLOAD, &pos);
+        conn_send_msg(conn, &ret_msg);
+      }
+    }
+
+    send_history(conn);
+
+    pthread_mutex_unlock(mutex);
+  } else if (msg->id_msg == REQ_REM) {
+    // As operações precisam ser feitas em exclusão mútua devido à atualização
+    // do registro de clientes
+    lock_group(conn->reactor, mutex);
+
+    // Verifica se o usuário que solicitou o fechamento da conexão está na
+    // lista de conexões ativas. Um usuário só pode remover a si mesmo, já que
+    // apenas o reator de cada conexão pode alterar seus membros
+    if (msg->id_sender != conn->id || registry_get(&clients, conn->id) != conn) {
+      error_msg(conn, msg->id_sender, 2, msg->req_id);
+    } else {
+      log_event(LOG_INFO, LOG_EVENT_REMOVED, msg->id_sender);
+
+      // Envia mensagem de confirmação para o usuário
+      ok_msg(conn, msg->id_sender, 1, msg->req_id);
+      remove_member(conn);
+
+      presence_change(conn->reactor, conn, 0);
+    }
+
+    pthread_mutex_unlock(mutex);
+
+    return 0;
+  } else if (msg->id_msg == MSG) {
+    // O ID de requisição só é repetido na confirmação ao remetente, e não é
+    // repassado aos destinatários
+    msg_view_t relay = *msg;
+    relay.req_id = 0;
+
+    // Os destinatários recebem o anúncio da entrada do remetente antes das suas
+    // mensagens
+    presence_sync(conn, mutex);
+
+    if (msg->id_receiver == NULL_ID) { // Mensagem pública
+      // A mensagem é recusada antes de ser registrada caso o reator tenha
+      // excedido o seu limite de entregas
+      if (!fanout_admit(conn->reactor, group_size())) {
+        error_msg(conn, msg->id_sender, 7, msg->req_id);
+        return 1;
+      }
+
+      char time_str[TIME_STR_SIZE];
+      logger_time_str(time_str);
+      // Registra a mensagem recebida, com o timestamp
+      log_chat(time_str, msg->id_sender, msg->message, msg->len);
+
+      history_push(&history, &relay, time_str);
+      if (wal != NULL) {
+        wal_append(wal, &relay);
+      }
+
+      // Faz o broadcast da mensagem. Não é necessário travar, já que a lista de
+      // membros é lida sem travas
+      fanout_t fanout = {.msg = &relay};
+      broadcast(conn->reactor, &fanout, msg->id_sender);
+
+      // Envia a mensagem alterada para o usuário remetente
+      send_echo(conn, &fanout);
+      fanout_release(&fanout);
+    } else { // Mensagem privada
+      // A consulta ao destinatário é feita sem travas. Caso ele saia do grupo
+      // simultaneamente, a conexão continua válida até o próximo estado
+      // quiescente desta thread, e a entrega é descartada pelo seu reator
+
+      // Verifica se o ID do destinatário existe
+      conn_t* receiver = lookup_conn(msg->id_receiver);
+      if (receiver == NULL) {
+        log_event(LOG_INFO, LOG_EVENT_NOT_FOUND, msg->id_receiver);
+        error_msg(conn, msg->id_sender, 3, msg->req_id);
+      } else {
+        // Envia a mensagem para o destinatário
+        send_private(conn->reactor, receiver, &relay);
+        if (wal != NULL) {
+          wal_append(wal, &relay);
+        }
+
+        // Envia a mensagem de confirmação para o remetente
+        ok_msg(conn, msg->id_sender, 2, msg->req_id);
+      }
+    }
+  } else if (msg->id_msg == STREAM || msg->id_msg == CREDIT) {
+    // Os trechos e créditos de um stream são repassados como mensagens
+    // privadas, sem que o servidor mantenha estado sobre o stream. O controle
+    // de fluxo entre remetente e destinatário limita os trechos em trânsito.
+    // Um trecho ou crédito inválido, ou enviado em nome de outro usuário,
+    // encerra a conexão do remetente, e nunca chega ao destinatário
+    uint32_t stream_id, value;
+    int kind;
+    int valid = msg->id_msg == STREAM ? decode_stream(msg, &stream_id, &kind)
+                                      : decode_credit(msg, &stream_id, &value);
+    if (msg->id_sender != conn->id || conn->slot < 0 || !valid) {
+      conn_reject(conn);
+      return 1;
+    }
+
+    msg_view_t relay = *msg;
+    relay.req_id = 0;
+
+    // Assim como nas mensagens privadas, o destinatário recebe o anúncio da
+    // entrada do remetente antes dos trechos do stream
+    presence_sync(conn, mutex);
+
+    conn_t* receiver = lookup_conn(msg->id_receiver);
+    if (receiver != NULL && receiver->binary && conn->binary) {
+      send_private(conn->reactor, receiver, &relay);
+    } else if (msg->id_msg == STREAM) {
+      abort_stream(conn, msg);
+    }
+  } else if (msg->id_msg == HEARTBEAT) {
+    // A resposta a um HEARTBEAT não é repassada. A atividade da conexão já foi
+    // registrada no recebimento
+  } else if (msg->id_msg == ROOM_JOIN || msg->id_msg == ROOM_LEAVE || msg->id_msg == ROOM_MSG) {
+    // Apenas usuários do grupo podem usar as salas, e somente em seu nome
+    if (msg->id_sender != conn->id || conn->slot < 0) {
+      error_msg(conn, msg->id_sender, 2, msg->req_id);
+    } else {
+      handle_room_msg(conn, mutex, msg);
+    }
+  } else {
+    // Uma mensagem malformada, com um ID inválido, encerra apenas a conexão
+    // do remetente
+    conn_reject(conn);
+  }
+
+  return 1;
+}
+
+// Registra o file descriptor "fd" na instância epoll do reator, com interesse
+// de leitura.
+void reactor_add(reactor_t* reactor, int fd, void* ptr) {
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = ptr};
+  if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    log_exit("epoll_ctl");
+  }
+}
+
+// Insere o temporizador da conexão "conn" na roda do seu reator, com prazo no
+// instante "deadline_ms".
+void conn_arm(conn_t* conn, uint64_t deadline_ms) {
+  uint64_t ticks = (deadline_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+  wheel_add(&conn->reactor->wheel, &conn->timer, ticks);
+}
+
+// Trata a expiração do temporizador de uma conexão. Caso o cliente não tenha
+// enviado mensagens desde o último HEARTBEAT, a conexão é encerrada da mesma
+// forma que a de um cliente lento, e o tratamento da leitura remove o usuário
+// do grupo. Caso contrário, um HEARTBEAT é enviado quando a conexão está
+// inativa, e o temporizador é reinserido com o próximo prazo.
+void conn_timeout(wheel_timer_t* timer, void* arg) {
+  conn_t* conn = (conn_t*)((char*)timer - offsetof(conn_t, timer));
+  reactor_t* reactor = (reactor_t*)arg;
+  if (conn->evicted) {
+    return;
+  }
+
+  uint64_t idle = reactor->now_ms - conn->last_rx;
+  if (idle >= reactor->idle_ms) {
+    conn->evicted = 1;
+    shutdown(conn->sock, SHUT_RDWR);
+    stats_add(&reactor->stats.timeouts, 1);
+  } else if (idle >= reactor->heartbeat_ms) {
+    // Apenas os usuários do grupo recebem HEARTBEAT. As demais conexões só
+    // são encerradas ao fim do prazo
+    if (conn->id != NULL_ID) {
+      msg_view_t msg = {.id_msg = HEARTBEAT,
+                        .id_sender = NULL_ID,
+                        .id_receiver = conn->id,
+                        .message = "HEARTBEAT",
+                        .len = strlen("HEARTBEAT")};
+      conn_send_msg(conn, &msg);
+    }
+    conn_arm(conn, conn->last_rx + reactor->idle_ms);
+  } else {
+    conn_arm(conn, conn->last_rx + reactor->heartbeat_ms);
+  }
+}
+
+// Consome a notificação do timerfd do reator e avança a sua roda de
+// temporizadores até o instante atual.
+void handle_timers(reactor_t* reactor) {
+  uint64_t expirations;
+  if (read(reactor->timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+    log_exit("read");
+  }
+
+  reactor->now_ms = now_ns() / 1000000;
+  wheel_advance(&reactor->wheel, reactor->now_ms / TIMER_TICK_MS, conn_timeout, reactor);
+}
+
+// Cria o estado da conexão do socket "sock", aceita pelo reator "reactor" no
+// socket TCP ou, caso "local" seja 1, no socket UNIX.
+conn_t* conn_new(reactor_t* reactor, int sock, int local) {
+  conn_t* conn = (conn_t*)calloc(1, sizeof(conn_t));
+  if (conn == NULL) {
+    log_exit("calloc");
+  }
+
+  // As mensagens são enviadas em lote pela fila de saída, então o algoritmo
+  // de Nagle apenas atrasaria os envios até a confirmação dos anteriores
+  int enable = 1;
+  if (!local && setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(int)) != 0) {
+    log_exit("setsockopt");
+  }
+
+  conn->sock = sock;
+  conn->local = local;
+  conn->shm.wait_fd = -1;
+  conn->shm.wake_fd = -1;
+  conn->id = NULL_ID;
+  conn->reactor = reactor;
+  frame_reader_init(&conn->reader);
+  outq_init(&conn->out);
+  conn->slot = -1;
+
+  conn->last_rx = reactor->now_ms;
+  wheel_timer_init(&conn->timer);
+
+  // A capacidade de cada balde corresponde a um segundo de mensagens, e
+  // comporta ao menos uma mensagem de tamanho máximo
+  double msg_burst = reactor->msg_rate > 1 ? reactor->msg_rate : 1;
+  double byte_burst = reactor->byte_rate > BUFFER_SIZE ? reactor->byte_rate : BUFFER_SIZE;
+  bucket_init(&conn->msg_bucket, reactor->msg_rate, msg_burst, reactor->now_ms);
+  bucket_init(&conn->byte_bucket, reactor->byte_rate, byte_burst, reactor->now_ms);
+  if (reactor->heartbeat_ms > 0) {
+    conn_arm(conn, conn->last_rx + reactor->heartbeat_ms);
+  }
+
+  return conn;
+}
+
+// Aceita todas as conexões pendentes no socket "listen_sock", que é o socket
+// UNIX caso "local" seja 1, e as registra na instância epoll do reator.
+void accept_clients(reactor_t* reactor, int listen_sock, int local) {
+  while (1) {
+    struct sockaddr_storage client_storage;
+    struct sockaddr* client_addr = (struct sockaddr*)(&client_storage);
+    socklen_t client_addrlen = sizeof(client_storage);
+
+    // Os sockets dos clientes são não bloqueantes, já que os envios são feitos
+    // a partir da fila de saída de cada conexão
+    int client_sock =
+        accept4(listen_sock, client_addr, &client_addrlen, SOCK_NONBLOCK);
+    if (client_sock == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        break;
+      }
+      log_exit("accept");
+    }
+
+    conn_t* conn = conn_new(reactor, client_sock, local);
+    conn->events = EPOLLIN;
+    reactor_add(reactor, client_sock, conn);
+  }
+}
+
+// Remove do grupo o usuário da conexão "conn", caso ele ainda esteja ativo, e
+// informa a saída aos demais usuários da mesma forma que uma mensagem REQ_REM.
+void drop_client(reactor_t* reactor, conn_t* conn) {
+  lock_group(reactor, &mutex);
+
+  if (conn->id != NULL_ID && registry_get(&clients, conn->id) == conn) {
+    log_event(LOG_INFO, LOG_EVENT_REMOVED, conn->id);
+    remove_member(conn);
+    presence_change(reactor, conn, 0);
+  }
+
+  pthread_mutex_unlock(&mutex);
+}
+
+// Verifica os limites de taxa da conexão "conn" para uma mensagem com "len"
+// bytes. Retorna 1 caso a mensagem seja admitida.
+int conn_admit(conn_t* conn, size_t len) {
+  reactor_t* reactor = conn->reactor;
+  if (bucket_take(&conn->msg_bucket, 1, reactor->now_ms) &&
+      bucket_take(&conn->byte_bucket, len, reactor->now_ms)) {
+    return 1;
+  }
+
+  stats_add(&reactor->stats.throttled, 1);
+  return 0;
+}
+
+// Verifica os limites de taxa da conexão "conn" para a mensagem "msg", recebida
+// em um quadro de "len" bytes, respondendo com um ERROR caso ela seja recusada.
+// Retorna 1 caso a mensagem seja admitida.
+int frame_admit(conn_t* conn, const msg_view_t* msg, size_t len) {
+  if ((msg->id_msg == MSG || msg->id_msg == ROOM_MSG) && !conn_admit(conn, len)) {
+    error_msg(conn, conn->id, 7, msg->req_id);
+    return 0;
+  }
+  return 1;
+}
+
+// Processa a mensagem "msg", já admitida pelos limites de taxa da conexão
+// "conn". Retorna 1 caso a conexão deva continuar aberta e 0 caso contrário.
+int dispatch_frame(conn_t* conn, msg_view_t* msg) {
+  reactor_t* reactor = conn->reactor;
+  if (msg->id_msg < STATS_MSG_TYPES) {
+    stats_add(&reactor->stats.msgs_in[msg->id_msg], 1);
+  }
+
+  uint64_t start = now_ns();
+  int ret = handle_msg(conn, &mutex, msg);
+  stats_record(&reactor->stats.latency, now_ns() - start);
+  return ret;
+}
+
+// Processa a mensagem "msg", recebida em um quadro de "len" bytes pela conexão
+// "conn". Retorna 1 caso a conexão deva continuar aberta e 0 caso contrário.
+int handle_frame(conn_t* conn, msg_view_t* msg, size_t len) {
+  // Os limites de taxa da conexão são verificados antes do repasse da mensagem
+  if (!frame_admit(conn, msg, len)) {
+    return 1;
+  }
+  return dispatch_frame(conn, msg);
+}
+
+// Processa, em lote, cada quadro completo presente no leitor da conexão
+// "conn". Os bytes de um quadro incompleto permanecem no leitor. Retorna 1 caso
+// a conexão deva continuar aberta e 0 caso contrário.
+int handle_frames(conn_t* conn) {
+  frame_view_t frames[FRAME_BATCH_SIZE];
+  char buffer[BUFFER_SIZE];
+  while (!conn->rejected) {
+    // Os quadros são decodificados em lote, e o conteúdo das mensagens é lido
+    // diretamente do buffer de recebimento, nos dois formatos
+    size_t count = frame_reader_batch(&conn->reader, frames, FRAME_BATCH_SIZE, conn->binary);
+    for (size_t i = 0; i < count && !conn->rejected; i++) {
+      if (handle_frame(conn, &frames[i].msg, frames[i].len) == 0) {
+        return 0;
+      }
+    }
+    if (conn->rejected) {
+      break;
+    }
+    if (count == FRAME_BATCH_SIZE || (count > 0 && frames[count - 1].msg.id_msg == REQ_ADD)) {
+      continue;
+    }
+
+    // O lote terminou em um quadro incompleto ou em um quadro que precisa ser
+    // tratado individualmente. Uma mensagem compactada é descompactada para o
+    // buffer antes da decodificação
+    char* frame;
+    size_t len;
+    int ret = frame_reader_next(&conn->reader, &frame, &len);
+    if (ret == 0) {
+      return 1;
+    }
+
+    // Um quadro inválido encerra apenas a conexão do remetente
+    msg_view_t msg;
+    if (ret < 0 || conn->format != FORMAT_LZ || !is_compressed_msg(frame, len) ||
+        lz_peek_msg(&msg, frame, len) == 0) {
+      conn_reject(conn);
+      return 1;
+    }
+
+    // Os limites de taxa são cobrados pelo tamanho sem compactação, lido do
+    // cabeçalho, de modo que uma mensagem recusada não chega a ser
+    // descompactada
+    size_t hdr_len = WIRE_HDR_SIZE + (frame[1] & WIRE_FLAG_REQ_ID ? WIRE_REQ_ID_SIZE : 0);
+    if (!frame_admit(conn, &msg, hdr_len + msg.len)) {
+      continue;
+    }
+
+    if (lz_inflate_msg(frame, len, buffer, &len) == 0 || decode_bin(&msg, buffer, len) == 0) {
+      conn_reject(conn);
+      return 1;
+    }
+
+    if (dispatch_frame(conn, &msg) == 0) {
+      return 0;
+    }
+  }
+
+  // Os bytes recebidos após um quadro inválido são descartados até que a
+  // leitura detecte o encerramento
+  frame_reader_init(&conn->reader);
+  return 1;
+}
+
+// Lê todos os bytes disponíveis na conexão "conn" e processa os quadros
+// completos recebidos. Retorna 1 caso a conexão deva continuar aberta e 0 caso
+// contrário.
+int handle_readable(reactor_t* reactor, conn_t* conn) {
+  while (1) {
+    size_t space = frame_reader_space(&conn->reader);
+    ssize_t count;
+    if (conn->local && conn->id == NULL_ID) {
+      // Antes do REQ_ADD, um cliente local pode enviar os file descriptors da
+      // memória compartilhada, que só são mantidos caso venham completos
+      int fds[FRAME_READER_MAX_FDS];
+      int num_fds;
+      count = frame_reader_fill_fds(&conn->reader, conn->sock, MSG_DONTWAIT, fds,
+                                    FRAME_READER_MAX_FDS, &num_fds);
+      if (num_fds == SHM_NUM_FDS && conn->num_fds == 0 && conn->shm.area == NULL) {
+        memcpy(conn->fds, fds, sizeof(conn->fds));
+        conn->num_fds = num_fds;
+      } else {
+        for (int i = 0; i < num_fds; i++) {
+          close(fds[i]);
+        }
+      }
+    } else {
+      count = frame_reader_fill(&conn->reader, conn->sock, MSG_DONTWAIT);
+    }
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return 1;
+    } else if (count <= 0) {
+      // O cliente fechou a conexão sem um REQ_REM, a conexão falhou ou foi
+      // encerrada pelo servidor. O usuário é removido do grupo, e a saída é
+      // informada aos demais
+      drop_client(reactor, conn);
+      return 0;
+    }
 
-  return id;
-}
+    conn->last_rx = reactor->now_ms;
+    stats_add(&reactor->stats.bytes_in, count);
+    if (handle_frames(conn) == 0) {
+      return 0;
+    }
 
-// Função auxiliar para obter uma representação em string da lista de usuários
-// ativos no momento. Como essa função precisa percorrer o array
-// "active_sockets", ela precisa ser executada em exclusão mútua para evitar
-// possíveis condições de corrida.
-void get_user_list(char* buffer) {
-  char temp[5];
-  for (int i = 0; i < MAX_CLIENTS; i++) {
-    if (active_sockets[i] != -1) {
-      sprintf(temp, "%d,", i);
-      strcat(buffer, temp);
+    // Se a leitura não preencheu todo o espaço livre, não havia mais bytes
+    // disponíveis no socket, e uma nova chamada de recv seria desnecessária
+    if ((size_t)count < space) {
+      return 1;
     }
   }
-
-  // Remove a última vírgula
-  buffer[strlen(buffer) - 1] = '\0';
 }
 
-// Função usada para enviar mensagem pública a todos os usuários ativos no
-// momento. O usuário de ID "skip_id" é ignorado, o que pode ser útil, por
-// exemplo, para enviar uma versão alterada da mensagem para ele.
-void broadcast(msg_t* msg, int skip_id) {
-  char buffer[BUFFER_SIZE];
-  memset(buffer, 0, BUFFER_SIZE);
-  encode(msg, buffer);
-
-  for (int i = 0; i < MAX_CLIENTS; i++) {
-    if (active_sockets[i] == -1 || i == skip_id) {
+// Lê os bytes disponíveis no anel de entrada da conexão "conn", que usa memória
+// compartilhada, e processa os quadros completos recebidos. Retorna 1 caso a
+// conexão deva continuar aberta e 0 caso contrário.
+int handle_shm(reactor_t* reactor, conn_t* conn) {
+  // Um cliente que escreve continuamente não impede o atendimento das demais
+  // conexões: após SHM_RING_SIZE bytes, o eventfd é notificado novamente e a
+  // leitura continua no próximo lote de eventos
+  size_t budget = SHM_RING_SIZE;
+  while (!conn->rejected) {
+    // Um anel corrompido, assim como um quadro inválido, encerra apenas a
+    // conexão do cliente, que não é mais lida
+    const char* data;
+    ssize_t available = shm_peek(&conn->shm, &data);
+    if (available < 0) {
+      conn_reject(conn);
+      return 1;
+    } else if (available == 0) {
+      if (shm_idle(&conn->shm)) {
+        return 1;
+      }
       continue;
+    } else if (budget == 0) {
+      shm_rearm(&conn->shm);
+      return 1;
+    }
+
+    size_t count = frame_reader_append(&conn->reader, data, available);
+    if (count == 0) {
+      conn_reject(conn);
+      return 1;
     }
+    shm_consume(&conn->shm, count);
+    budget = count < budget ? budget - count : 0;
 
-    if (send_msg(active_sockets[i], buffer) != 0) {
-      log_exit("send");
+    conn->last_rx = reactor->now_ms;
+    stats_add(&reactor->stats.bytes_in, count);
+    if (handle_frames(conn) == 0) {
+      return 0;
     }
   }
+
+  return 1;
 }
 
-// Envia uma mensagem do tipo ERROR no socket "socket", para o destinatário de
-// ID "id_receiver" e com a mensagem de código "error_code".
-void error_msg(int socket, int id_receiver, int error_code) {
-  msg_t msg = {.id_msg = ERROR, .id_sender = NULL_ID, .id_receiver = id_receiver};
+// Envia o máximo possível de mensagens da fila de saída da conexão "conn".
+// Caso a fila seja esvaziada e a conexão esteja sendo encerrada, ela é
+// liberada. Retorna 1 caso a conexão continue aberta e 0 caso contrário.
+int handle_writable(conn_t* conn) {
+  int ret = conn->shm.area != NULL ? conn_flush_shm(conn) : outq_flush(&conn->out, conn->sock);
+  if (ret < 0) {
+    // As mensagens de um cliente desconectado são descartadas. Uma falha no
+    // envio encerra a conexão, e o usuário é removido pelo tratamento da
+    // leitura
+    outq_clear(&conn->out);
+    if (!conn->evicted) {
+      conn->evicted = 1;
+      shutdown(conn->sock, SHUT_RDWR);
+    }
+    ret = 1;
+  }
 
-  memset(msg.message, 0, BUFFER_SIZE);
-  switch (error_code) {
-  case 1:
-    strcpy(msg.message, "User limit exceeded");
-    break;
-  case 2:
-    strcpy(msg.message, "User not found");
-    break;
-  case 3:
-    strcpy(msg.message, "Receiver not found");
-    break;
+  if (ret == 1 && conn->closing) {
+    conn_release(conn);
+    return 0;
   }
 
-  char buffer[BUFFER_SIZE];
-  memset(buffer, 0, BUFFER_SIZE);
-  encode(&msg, buffer);
+  conn_update_events(conn);
+  return 1;
+}
+
+// Função a ser executada pela thread de cada reator. A thread aguarda eventos
+// na instância epoll do reator e processa as conexões que estão prontas, as
+// novas conexões e as entregas feitas pelos demais reatores.
+void* reactor_thread(void* args) {
+  reactor_t* reactor = (reactor_t*)args;
+  struct epoll_event events[MAX_EVENTS];
+
+  qsbr_register(&qsbr);
+
+  while (1) {
+    // A thread não mantém referências a estruturas compartilhadas entre um
+    // lote de eventos e outro, e fica inativa enquanto aguarda novos eventos
+    qsbr_quiescent(&qsbr);
+    qsbr_offline(&qsbr);
+    int n = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, -1);
+    qsbr_online(&qsbr);
+    reactor->now_ms = now_ns() / 1000000;
+
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      log_exit("epoll_wait");
+    }
+
+    for (int i = 0; i < n; i++) {
+      conn_t* conn = (conn_t*)events[i].data.ptr;
+
+      // O socket do servidor é registrado com ponteiro nulo, o socket UNIX com
+      // o ponteiro da variável que o armazena, a caixa de mensagens com o
+      // ponteiro do próprio reator e o timerfd com o ponteiro da roda de
+      // temporizadores
+      if (conn == NULL) {
+        accept_clients(reactor, reactor->server_sock, 0);
+        continue;
+      } else if (events[i].data.ptr == &local_sock) {
+        accept_clients(reactor, local_sock, 1);
+        continue;
+      } else if (events[i].data.ptr == reactor) {
+        handle_letters(reactor);
+        continue;
+      } else if (events[i].data.ptr == &reactor->wheel) {
+        handle_timers(reactor);
+        continue;
+      }
+
+      // O eventfd de uma conexão com memória compartilhada indica que o
+      // cliente escreveu no anel de entrada ou liberou espaço no de saída. Os
+      // eventos de uma conexão liberada no mesmo lote são ignorados
+      if (events[i].data.u64 & EPOLL_TAG_SHM) {
+        conn = (conn_t*)(uintptr_t)(events[i].data.u64 & ~(uint64_t)EPOLL_TAG_SHM);
+        if (conn->sock == -1) {
+          continue;
+        }
+
+        shm_ack(&conn->shm);
+        if (conn->out.head != NULL && handle_writable(conn) == 0) {
+          continue;
+        }
+        if (!conn->closing && handle_shm(reactor, conn) == 0) {
+          conn_close(conn);
+        }
+        continue;
+      } else if (conn->sock == -1) {
+        continue;
+      }
+
+      // Uma conexão com memória compartilhada sendo encerrada não recebe mais
+      // notificações do cliente depois que ele fecha o socket, então a fila
+      // restante é descartada
+      if (conn->closing && conn->shm.area != NULL &&
+          (events[i].events & (EPOLLHUP | EPOLLERR))) {
+        outq_clear(&conn->out);
+      }
 
-  if (send_msg(socket, buffer) != 0) {
-    log_exit("send");
+      // Uma conexão sendo encerrada só aguarda a escrita, mas erros também são
+      // reportados para ela
+      int writable = (events[i].events & EPOLLOUT) ||
+                     (conn->closing && (events[i].events & (EPOLLHUP | EPOLLERR)));
+      if (writable && handle_writable(conn) == 0) {
+        continue;
+      }
+
+      // Erros e desconexões são detectados pela leitura
+      if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !conn->closing) {
+        if (handle_readable(reactor, conn) == 0) {
+          conn_close(conn);
+        }
+      }
+    }
   }
+
+  pthread_exit(NULL);
 }
 
-// Envia uma mensagem do tipo OK no socket "socket", para o destinatário de ID
-// "id_receiver".
-void ok_msg(int socket, int id_receiver, int ok_code) {
-  msg_t msg = {.id_msg = OK, .id_sender = NULL_ID, .id_receiver = id_receiver};
+// Monta o "user_data" de uma SQE a partir do ponteiro "ptr" e do tipo "op" da
+// operação.
+uint64_t uring_data(void* ptr, int op) {
+  return (uint64_t)(uintptr_t)ptr | op;
+}
 
-  memset(msg.message, 0, BUFFER_SIZE);
-  switch (ok_code) {
-  case 1:
-    strcpy(msg.message, "Removed Successfully");
-    break;
-  case 2:
-    strcpy(msg.message, "OK");
-    break;
-  }
+// Submete o aceite multishot de conexões no socket do reator ou, caso "local"
+// seja 1, no socket UNIX, que gera uma conclusão para cada nova conexão.
+void uring_arm_accept(reactor_t* reactor, int local) {
+  struct io_uring_sqe* sqe = uring_get_sqe(&reactor->ring);
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = local ? local_sock : reactor->server_sock;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->user_data = uring_data(reactor, local ? URING_OP_ACCEPT_LOCAL : URING_OP_ACCEPT);
+}
 
-  char buffer[BUFFER_SIZE];
-  memset(buffer, 0, BUFFER_SIZE);
-  encode(&msg, buffer);
+// Submete a espera multishot pelas notificações da caixa de mensagens.
+void uring_arm_mailbox(reactor_t* reactor) {
+  struct io_uring_sqe* sqe = uring_get_sqe(&reactor->ring);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = reactor->mailbox.event_fd;
+  sqe->poll32_events = POLLIN;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = uring_data(reactor, URING_OP_MAILBOX);
+}
 
-  if (send_msg(socket, buffer) != 0) {
-    log_exit("send");
-  }
+// Submete a espera multishot pelos ticks do timerfd do reator.
+void uring_arm_timer(reactor_t* reactor) {
+  struct io_uring_sqe* sqe = uring_get_sqe(&reactor->ring);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = reactor->timer_fd;
+  sqe->poll32_events = POLLIN;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = uring_data(reactor, URING_OP_TIMER);
 }
 
-// Função a ser executada pelas threads que realizam o processamento de cada
-// cliente.
-void* client_thread(void* args) {
-  server_thread_args* cdata = (server_thread_args*)args;
+// Submete o recebimento multishot da conexão "conn". Cada conclusão traz os
+// bytes recebidos em um buffer escolhido pelo kernel no anel do reator.
+void uring_arm_recv(conn_t* conn) {
+  struct io_uring_sqe* sqe = uring_get_sqe(&conn->reactor->ring);
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = conn->sock;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = conn->reactor->bufs.bgid;
+  sqe->user_data = uring_data(conn, URING_OP_RECV);
+  conn->receiving = 1;
+}
 
-  msg_t msg;
-  char buffer[BUFFER_SIZE];
+// Libera a conexão "conn" caso ela esteja sendo encerrada e não haja mais
+// operações em andamento. Quando só resta o recebimento, o socket é encerrado
+// para que o recebimento seja concluído.
+void uring_conn_check(conn_t* conn) {
+  if (!conn->closing || conn->out.head != NULL || conn->sending || conn->dirty) {
+    return;
+  }
 
-  // Recebe mensagens continuamente e realiza o processamento adequado
-  while (1) {
-    memset(buffer, 0, BUFFER_SIZE);
-    if (recv_msg(cdata->client_sock, buffer) <= 0) {
-      log_exit("recv");
+  if (conn->receiving) {
+    if (!conn->shut) {
+      shutdown(conn->sock, SHUT_RDWR);
+      conn->shut = 1;
     }
+    return;
+  }
+
+  conn_release(conn);
+}
+
+// Submete, em lote, o envio das filas de saída das conexões marcadas desde a
+// última submissão. Cada conexão tem no máximo um envio em andamento.
+void uring_flush_sends(reactor_t* reactor) {
+  while (reactor->dirty != NULL) {
+    conn_t* conn = reactor->dirty;
+    reactor->dirty = conn->next_dirty;
+    conn->dirty = 0;
 
-    if (decode(&msg, buffer) == 0) {
-      parse_error();
+    if (conn->sending || conn->out.head == NULL) {
+      uring_conn_check(conn);
+      continue;
     }
 
-    if (msg.id_msg == REQ_ADD) {
-      pthread_mutex_lock(cdata->mutex);
+    int iovcnt = outq_iov(&conn->out, conn->send_iov, OUTQ_IOV_MAX);
+    memset(&conn->send_hdr, 0, sizeof(conn->send_hdr));
+    conn->send_hdr.msg_iov = conn->send_iov;
+    conn->send_hdr.msg_iovlen = iovcnt;
+
+    // MSG_NOSIGNAL evita que o processo receba SIGPIPE caso o cliente tenha
+    // fechado a conexão
+    struct io_uring_sqe* sqe = uring_get_sqe(&reactor->ring);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->sock;
+    sqe->addr = (uint64_t)(uintptr_t)&conn->send_hdr;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = uring_data(conn, URING_OP_SEND);
+    conn->sending = 1;
+  }
+}
+
+// Trata a conclusão de um aceite no socket do reator ou, caso "local" seja 1,
+// no socket UNIX, que traz em "res" o socket da nova conexão. A memória
+// compartilhada não é oferecida a essas conexões, que continuam no socket.
+void uring_handle_accept(reactor_t* reactor, int res, unsigned flags, int local) {
+  if (res >= 0) {
+    conn_t* conn = conn_new(reactor, res, local);
+    uring_arm_recv(conn);
+  } else if (res != -EINTR && res != -EAGAIN && res != -ECONNABORTED) {
+    errno = -res;
+    log_exit("accept");
+  }
+
+  if (!(flags & IORING_CQE_F_MORE)) {
+    uring_arm_accept(reactor, local);
+  }
+}
 
-      if (user_count == 15) {
-        pthread_mutex_unlock(cdata->mutex);
-        // id_receiver precisa ser nulo nesse caso, pois o usuário não possui um
-        // ID
-        error_msg(cdata->client_sock, NULL_ID, 1);
+// Trata a conclusão de um recebimento da conexão "conn", que traz em "res" o
+// número de bytes recebidos no buffer indicado em "flags".
+void uring_handle_recv(reactor_t* reactor, conn_t* conn, int res, unsigned flags) {
+  if (!(flags & IORING_CQE_F_MORE)) {
+    conn->receiving = 0;
+  }
 
-        // Como o limite de usuários já foi excedido, o loop é finalizado e a
-        // thread para de executar
-        break;
+  if (res > 0) {
+    unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    const char* data = uring_buf_data(&reactor->bufs, bid);
+    conn->last_rx = reactor->now_ms;
+    stats_add(&reactor->stats.bytes_in, res);
+
+    // Os bytes são copiados para o leitor da conexão, já que um quadro pode
+    // estar dividido entre vários buffers
+    size_t off = 0;
+    while (off < (size_t)res && !conn->closing) {
+      off += frame_reader_append(&conn->reader, data + off, res - off);
+      if (handle_frames(conn) == 0) {
+        conn_close(conn);
       }
+    }
 
-      // Define um identificador para o usuário
-      int new_id = get_id(cdata->client_sock);
-      printf("User %d added\n", new_id);
+    uring_buf_recycle(&reactor->bufs, bid);
+  } else if (res != -ENOBUFS && !conn->closing) {
+    // O cliente fechou a conexão sem um REQ_REM, a conexão falhou ou foi
+    // encerrada pelo servidor. O usuário é removido do grupo, e a saída é
+    // informada aos demais
+    drop_client(reactor, conn);
+    conn_close(conn);
+  }
 
-      // Envia a mensagem informando que o novo usuário entrou no grupo por
-      // broadcast para todos os usuários
-      msg_t ret_msg;
-      memset(ret_msg.message, 0, BUFFER_SIZE);
+  // O recebimento multishot é encerrado pelo kernel quando não há buffers
+  // livres no anel, e precisa ser submetido novamente
+  if (!conn->receiving && !conn->closing) {
+    uring_arm_recv(conn);
+  }
 
-      ret_msg.id_msg = MSG;
-      ret_msg.id_sender = new_id;
-      ret_msg.id_receiver = NULL_ID;
-      sprintf(ret_msg.message, "User %d joined the group!", new_id);
-      broadcast(&ret_msg, NULL_ID);
+  uring_conn_check(conn);
+}
+
+// Trata a conclusão de um envio da conexão "conn", que traz em "res" o número
+// de bytes enviados.
+void uring_handle_send(conn_t* conn, int res) {
+  conn->sending = 0;
+
+  if (res < 0) {
+    // As mensagens de um cliente desconectado são descartadas. Uma falha no
+    // envio encerra a conexão, e o usuário é removido pelo tratamento do
+    // recebimento
+    outq_clear(&conn->out);
+    if (!conn->evicted) {
+      conn->evicted = 1;
+      shutdown(conn->sock, SHUT_RDWR);
+    }
+  } else {
+    outq_consume(&conn->out, res);
+  }
 
-      // Aloca uma string que representa a lista de integrantes do grupo para o
-      // conteúdo da mensagem
-      memset(ret_msg.message, 0, strlen(ret_msg.message));
-      get_user_list(ret_msg.message);
+  // O restante da fila é enviado na próxima submissão
+  conn_update_events(conn);
+  uring_conn_check(conn);
+}
 
-      pthread_mutex_unlock(cdata->mutex);
+// Função a ser executada pela thread de cada reator no backend io_uring. Em
+// cada iteração, todas as operações pendentes (envios, novos recebimentos e
+// aceites) são submetidas e as conclusões são aguardadas em uma única chamada
+// de sistema.
+void* uring_reactor_thread(void* args) {
+  reactor_t* reactor = (reactor_t*)args;
 
-      // Envia a mensagem com a lista dos atuais integrantes do grupo para o
-      // novo usuário
-      ret_msg.id_msg = RES_LIST;
-      ret_msg.id_sender = NULL_ID;
-      ret_msg.id_receiver = NULL_ID;
+  qsbr_register(&qsbr);
 
-      memset(buffer, 0, BUFFER_SIZE);
-      encode(&ret_msg, buffer);
+  uring_arm_accept(reactor, 0);
+  if (local_sock >= 0) {
+    uring_arm_accept(reactor, 1);
+  }
+  uring_arm_mailbox(reactor);
+  if (reactor->timer_fd >= 0) {
+    uring_arm_timer(reactor);
+  }
 
-      if (send_msg(cdata->client_sock, buffer) != 0) {
-        log_exit("send");
+  while (1) {
+    uring_flush_sends(reactor);
+
+    // A thread não mantém referências a estruturas compartilhadas entre um
+    // lote de conclusões e outro, e fica inativa enquanto aguarda
+    qsbr_quiescent(&qsbr);
+    qsbr_offline(&qsbr);
+    uring_submit(&reactor->ring, 1);
+    qsbr_online(&qsbr);
+    reactor->now_ms = now_ns() / 1000000;
+
+    struct io_uring_cqe* cqe;
+    while ((cqe = uring_peek_cqe(&reactor->ring)) != NULL) {
+      uint64_t data = cqe->user_data;
+      int res = cqe->res;
+      unsigned flags = cqe->flags;
+      uring_cqe_seen(&reactor->ring);
+
+      void* ptr = (void*)(uintptr_t)(data & ~(uint64_t)URING_OP_MASK);
+      switch (data & URING_OP_MASK) {
+      case URING_OP_RECV:
+        uring_handle_recv(reactor, (conn_t*)ptr, res, flags);
+        break;
+      case URING_OP_SEND:
+        uring_handle_send((conn_t*)ptr, res);
+        break;
+      case URING_OP_ACCEPT:
+        uring_handle_accept(reactor, res, flags, 0);
+        break;
+      case URING_OP_ACCEPT_LOCAL:
+        uring_handle_accept(reactor, res, flags, 1);
+        break;
+      case URING_OP_MAILBOX:
+        handle_letters(reactor);
+        if (!(flags & IORING_CQE_F_MORE)) {
+          uring_arm_mailbox(reactor);
+        }
+        break;
+      case URING_OP_TIMER:
+        handle_timers(reactor);
+        if (!(flags & IORING_CQE_F_MORE)) {
+          uring_arm_timer(reactor);
+        }
+        break;
       }
-    } else if (msg.id_msg == REQ_REM) {
-      // As operações precisam ser feitas em exclusão mútua devido à atualização
-      // das variáveis "active_sockets" e "user_count"
-      pthread_mutex_lock(cdata->mutex);
+    }
+  }
 
-      // Verifica se o usuário que solicitou o fechamento da conexão está na
-      // lista de conexões ativas
-      if (active_sockets[msg.id_sender] == -1) {
-        error_msg(cdata->client_sock, msg.id_sender, 2);
-      } else {
-        printf("User %d removed\n", msg.id_sender);
+  pthread_exit(NULL);
+}
 
-        // Envia mensagem de confirmação para o usuário
-        ok_msg(cdata->client_sock, msg.id_sender, 1);
-        active_sockets[msg.id_sender] = -1;
-        user_count--;
+// Inicializa o io_uring do reator "reactor". Retorna 0 em caso de sucesso e -1
+// caso o kernel não suporte as operações necessárias.
+int uring_reactor_init(reactor_t* reactor) {
+  if (uring_init(&reactor->ring, URING_ENTRIES) != 0) {
+    return -1;
+  }
 
-        broadcast(&msg, NULL_ID);
-      }
+  if (uring_bufs_init(&reactor->ring, &reactor->bufs, 0, URING_BUF_COUNT, URING_BUF_SIZE) != 0) {
+    uring_destroy(&reactor->ring);
+    return -1;
+  }
+
+  return 0;
+}
 
-      pthread_mutex_unlock(cdata->mutex);
+// Função executada pela thread que atende o socket de estatísticas, cujo file
+// descriptor é passado em "args". A cada conexão, as estatísticas de todos os
+// reatores são combinadas e enviadas em texto, e a conexão é fechada.
+void* stats_thread(void* args) {
+  int stats_sock = (int)(intptr_t)args;
 
-      break;
-    } else if (msg.id_msg == MSG) {
-      if (msg.id_receiver == NULL_ID) { // Mensagem pública
-        char time_str[7];
-        set_time_str(time_str);
-        // Imprime a mensagem recebida, com o timestamp
-        printf("%s %d: %s\n", time_str, msg.id_sender, msg.message);
-
-        // Faz o broadcast da mensagem
-        pthread_mutex_lock(cdata->mutex);
-        broadcast(&msg, msg.id_sender);
-        pthread_mutex_unlock(cdata->mutex);
-
-        // Altera a mensagem para ser enviada para o remetente
-        char temp[BUFFER_SIZE] = "-> all ";
-        strcat(temp, msg.message);
-        strcpy(msg.message, temp);
-
-        memset(buffer, 0, strlen(buffer));
-        encode(&msg, buffer);
-
-        // Envia a mensagem alterada para o usuário remetente
-        if (send_msg(cdata->client_sock, buffer) != 0) {
-          log_exit("recv");
-        }
-      } else { // Mensagem privada
-        // Todo o tratamento da mensagem privada é feio em exclusão mútua para
-        // garantir que o destinatário não possa ser marcado como inativo por
-        // outra thread enquanto o tratamento é feito aqui
-        pthread_mutex_lock(cdata->mutex);
-
-        // Verifica se o ID do destinatário existe
-        if (msg.id_receiver >= MAX_CLIENTS || msg.id_receiver < 0 ||
-            active_sockets[msg.id_receiver] == -1) {
-          printf("User %d not found\n", msg.id_receiver);
-          error_msg(cdata->client_sock, msg.id_sender, 3);
-        } else {
-          memset(buffer, 0, strlen(buffer));
-          encode(&msg, buffer);
-
-          // Envia a mensagem para o destinatário
-          if (send_msg(active_sockets[msg.id_receiver], buffer) != 0) {
-            log_exit("recv");
-          }
-
-          // Envia a mensagem de confirmação para o remetente
-          ok_msg(cdata->client_sock, msg.id_sender, 2);
-        }
+  stats_t** stats = (stats_t**)malloc(num_reactors * sizeof(stats_t*));
+  if (stats == NULL) {
+    log_exit("malloc");
+  }
+  for (int i = 0; i < num_reactors; i++) {
+    stats[i] = &reactors[i].stats;
+  }
 
-        pthread_mutex_unlock(cdata->mutex);
+  while (1) {
+    int sock = accept(stats_sock, NULL, NULL);
+    if (sock == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
       }
-    } else {
-      // Caso para tratar uma mensagem malformada que tenha um ID inválido
-      eprintf("Unknown message ID.");
-      exit(EXIT_FAILURE);
+      log_exit("accept");
+    }
+
+    uint64_t users = 0;
+    for (int i = 0; i < num_reactors; i++) {
+      users += atomic_load(&reactors[i].active);
     }
+
+    stats_report(sock, stats, num_reactors, users);
+    close(sock);
   }
 
-  close(cdata->client_sock);
-  free(cdata);
+  free(stats);
   pthread_exit(NULL);
 }
 
+// Mensagens públicas recuperadas do log, da mais recente para a mais antiga.
+typedef struct recovery_t {
+  msg_t* msgs;
+  time_t* times;
+  size_t count;
+} recovery_t;
+
+// Copia a mensagem pública "msg" do log, até que o histórico esteja completo.
+int recover_msg(const msg_view_t* msg, time_t time, void* arg) {
+  recovery_t* recovery = (recovery_t*)arg;
+  if (msg->id_msg != MSG || msg->id_receiver != NULL_ID) {
+    return 1;
+  }
+
+  msg_t* copy = &recovery->msgs[recovery->count];
+  copy->id_msg = msg->id_msg;
+  copy->id_sender = msg->id_sender;
+  copy->id_receiver = msg->id_receiver;
+  copy->req_id = 0;
+  memcpy(copy->message, msg->message, msg->len);
+  copy->message[msg->len] = '\0';
+  recovery->times[recovery->count] = time;
+
+  return ++recovery->count < history.capacity;
+}
+
+// Reconstrói o histórico a partir das últimas mensagens públicas do log no
+// diretório "dir". Apenas os segmentos mais recentes são lidos, até que o
+// histórico esteja completo.
+void recover_history(const char* dir) {
+  if (history.capacity == 0) {
+    return;
+  }
+
+  recovery_t recovery = {.count = 0};
+  recovery.msgs = (msg_t*)malloc(history.capacity * sizeof(msg_t));
+  recovery.times = (time_t*)malloc(history.capacity * sizeof(time_t));
+  if (recovery.msgs == NULL || recovery.times == NULL) {
+    log_exit("malloc");
+  }
+
+  size_t records = wal_recover(dir, recover_msg, &recovery);
+
+  // As mensagens são inseridas no histórico da mais antiga para a mais recente
+  for (size_t i = recovery.count; i > 0; i--) {
+    msg_t* msg = &recovery.msgs[i - 1];
+    msg_view_t view = {.id_msg = msg->id_msg,
+                       .id_sender = msg->id_sender,
+                       .id_receiver = msg->id_receiver,
+                       .message = msg->message,
+                       .len = strlen(msg->message)};
+
+    char time_str[TIME_STR_SIZE];
+    struct tm local_time;
+    localtime_r(&recovery.times[i - 1], &local_time);
+    strftime(time_str, TIME_STR_SIZE, "[%H:%M]", &local_time);
+    history_push(&history, &view, time_str);
+  }
+
+  log_printf(LOG_INFO, "Recovered %zu messages from %zu log records", recovery.count, records);
+  free(recovery.msgs);
+  free(recovery.times);
+}
+
 // Retirado das aulas do professor Ítalo.
 void usage(const char* bin) {
-  eprintf("Usage: %s <v4|v6> <server port>\n", bin);
+  eprintf("Usage: %s [-t threads] [-m max users] [-q queue bytes] "
+          "[-p drop|disconnect|coalesce] [-b epoll|uring] [-s stats socket path] "
+          "[-H history msgs[:bytes]] [-w log dir] [-W commit ms[:bytes]] "
+          "[-l error|info|chat] [-k heartbeat ms[:idle ms]] [-r msgs/s[:bytes/s]] "
+          "[-f deliveries/s] [-a presence window ms] [-u local socket path] "
+          "<v4|v6> <server port>\n",
+          bin);
   eprintf("Example: %s v4 51511\n", bin);
   exit(EXIT_FAILURE);
 }
@@ -318,19 +2533,11 @@ int sockaddr_init(const char* protocol, const char* port_str,
   return 0;
 }
 
-int main(int argc, const char* argv[]) {
-  if (argc < 3)
-    usage(argv[0]);
-
-  // Inicializa o objeto sockaddr_storage para dar bind em todos os endereços
-  // IP associados à interface
-  struct sockaddr_storage storage;
-  if (sockaddr_init(argv[1], argv[2], &storage) != 0) {
-    usage(argv[0]);
-  }
-
-  int server_sock;
-  server_sock = socket(storage.ss_family, SOCK_STREAM, 0);
+// Cria um socket não bloqueante que aguarda novas conexões no endereço
+// "storage". A opção SO_REUSEPORT permite que cada reator tenha seu próprio
+// socket na mesma porta, e o kernel distribui as conexões entre eles.
+int listen_socket(const struct sockaddr_storage* storage) {
+  int server_sock = socket(storage->ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
   if (server_sock == -1) {
     log_exit("socket");
   }
@@ -340,43 +2547,394 @@ int main(int argc, const char* argv[]) {
   if (setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) != 0) {
     log_exit("setsockopt");
   }
+  if (setsockopt(server_sock, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)) != 0) {
+    log_exit("setsockopt");
+  }
+
+  struct sockaddr* addr = (struct sockaddr*)storage;
+  if (bind(server_sock, addr, sizeof(*storage)) != 0) {
+    log_exit("bind");
+  }
+
+  if (listen(server_sock, SOMAXCONN) != 0) {
+    log_exit("listen");
+  }
+
+  return server_sock;
+}
+
+// Cria um socket UNIX não bloqueante que aguarda conexões de clientes na mesma
+// máquina no caminho "path". Diferente do socket TCP, ele é compartilhado por
+// todos os reatores.
+int listen_local_socket(const char* path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    eprintf("Local socket path is too long.\n");
+    exit(EXIT_FAILURE);
+  }
+  strcpy(addr.sun_path, path);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (sock == -1) {
+    log_exit("socket");
+  }
 
-  struct sockaddr* addr = (struct sockaddr*)(&storage);
-  if (bind(server_sock, addr, sizeof(storage)) != 0) {
+  // Um socket deixado por uma execução anterior impediria o bind
+  unlink(path);
+  if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
     log_exit("bind");
   }
 
-  if (listen(server_sock, MAX_CLIENTS) != 0) {
+  if (listen(sock, SOMAXCONN) != 0) {
     log_exit("listen");
   }
 
-  pthread_mutex_t mutex;
+  return sock;
+}
+
+// Cria um timerfd não bloqueante que expira a cada TIMER_TICK_MS
+// milissegundos.
+int timer_fd_new() {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  if (fd == -1) {
+    log_exit("timerfd_create");
+  }
+
+  struct itimerspec spec = {.it_interval = {.tv_nsec = TIMER_TICK_MS * 1000000},
+                            .it_value = {.tv_nsec = TIMER_TICK_MS * 1000000}};
+  if (timerfd_settime(fd, 0, &spec, NULL) != 0) {
+    log_exit("timerfd_settime");
+  }
+
+  return fd;
+}
+
+int main(int argc, char* argv[]) {
+  int num_threads = DEFAULT_THREADS;
+  // Limite de usuários ativos. O valor 0 indica que não há limite
+  int max_users = 0;
+  // Limite da fila de saída de cada conexão e política para clientes lentos
+  long max_queue_bytes = DEFAULT_QUEUE_BYTES;
+  int slow_policy = POLICY_DISCONNECT;
+  // Mecanismo de E/S dos reatores
+  int backend = BACKEND_EPOLL;
+  // Caminho do socket UNIX de estatísticas, que só é criado caso informado
+  const char* stats_path = NULL;
+  // Limites do histórico de mensagens públicas. O valor 0 o desativa
+  long history_msgs = HISTORY_DEFAULT_MSGS;
+  long history_bytes = HISTORY_DEFAULT_BYTES;
+  // Diretório do log durável, que só é usado caso informado, e sua política de
+  // group commit
+  const char* wal_dir = NULL;
+  long commit_ms = WAL_DEFAULT_COMMIT_MS;
+  long commit_bytes = WAL_DEFAULT_COMMIT_BYTES;
+  // Nível do log do console. O conteúdo das mensagens só é registrado no nível
+  // "chat"
+  int log_level = LOG_CHAT;
+  // Intervalo dos HEARTBEATs e prazo de inatividade. O valor 0 os desativa
+  long heartbeat_ms = DEFAULT_HEARTBEAT_MS;
+  long idle_ms = 0;
+  // Limites de taxa de cada conexão e limite global de entregas por segundo.
+  // O valor 0 indica que não há limite
+  double msg_rate = 0, byte_rate = 0, fanout_rate = 0;
+  // Janela de acúmulo das entradas e saídas. O valor 0 anuncia cada uma
+  // imediatamente
+  long presence_window_ms = DEFAULT_PRESENCE_WINDOW_MS;
+  // Caminho do socket UNIX para clientes na mesma máquina, que só é criado
+  // caso informado
+  const char* local_path = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:m:q:p:b:s:H:w:W:l:k:r:f:a:u:")) != -1) {
+    switch (opt) {
+    case 'u':
+      local_path = optarg;
+      break;
+    case 'a':
+      presence_window_ms = atol(optarg);
+      if (presence_window_ms < 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 'r':
+      if (sscanf(optarg, "%lf:%lf", &msg_rate, &byte_rate) < 1 || msg_rate < 0 || byte_rate < 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 'f':
+      fanout_rate = atof(optarg);
+      if (fanout_rate < 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 'k':
+      if (sscanf(optarg, "%ld:%ld", &heartbeat_ms, &idle_ms) < 1 || heartbeat_ms < 0 ||
+          (idle_ms != 0 && idle_ms <= heartbeat_ms)) {
+        usage(argv[0]);
+      }
+      break;
+    case 'l':
+      if (strcmp(optarg, "error") == 0) {
+        log_level = LOG_ERROR;
+      } else if (strcmp(optarg, "info") == 0) {
+        log_level = LOG_INFO;
+      } else if (strcmp(optarg, "chat") == 0) {
+        log_level = LOG_CHAT;
+      } else {
+        usage(argv[0]);
+      }
+      break;
+    case 'w':
+      wal_dir = optarg;
+      break;
+    case 'W':
+      if (sscanf(optarg, "%ld:%ld", &commit_ms, &commit_bytes) < 1 || commit_ms < 0 ||
+          commit_bytes <= 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 'H':
+      if (sscanf(optarg, "%ld:%ld", &history_msgs, &history_bytes) < 1 || history_msgs < 0 ||
+          history_bytes <= 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 's':
+      stats_path = optarg;
+      break;
+    case 'b':
+      if (strcmp(optarg, "epoll") == 0) {
+        backend = BACKEND_EPOLL;
+      } else if (strcmp(optarg, "uring") == 0) {
+        backend = BACKEND_URING;
+      } else {
+        usage(argv[0]);
+      }
+      break;
+    case 'q':
+      max_queue_bytes = atol(optarg);
+      // A fila precisa comportar ao menos uma mensagem de tamanho máximo
+      if (max_queue_bytes < (long)(sizeof(uint16_t) + BUFFER_SIZE)) {
+        usage(argv[0]);
+      }
+      break;
+    case 'p':
+      if (strcmp(optarg, "drop") == 0) {
+        slow_policy = POLICY_DROP;
+      } else if (strcmp(optarg, "disconnect") == 0) {
+        slow_policy = POLICY_DISCONNECT;
+      } else if (strcmp(optarg, "coalesce") == 0) {
+        slow_policy = POLICY_COALESCE;
+      } else {
+        usage(argv[0]);
+      }
+      break;
+    case 'm':
+      max_users = atoi(optarg);
+      if (max_users < 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 't':
+      num_threads = atoi(optarg);
+      if (num_threads <= 0) {
+        usage(argv[0]);
+      }
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if (argc - optind < 2)
+    usage(argv[0]);
+
+  // Inicializa o objeto sockaddr_storage para dar bind em todos os endereços
+  // IP associados à interface
+  struct sockaddr_storage storage;
+  if (sockaddr_init(argv[optind], argv[optind + 1], &storage) != 0) {
+    usage(argv[0]);
+  }
+
+  // Um cliente que fecha a conexão durante um envio não deve encerrar o
+  // processo, então as falhas de escrita são tratadas pelos erros retornados
+  signal(SIGPIPE, SIG_IGN);
+
+  logger_init(log_level);
   pthread_mutex_init(&mutex, NULL);
-  memset(active_sockets, -1, sizeof(active_sockets));
 
-  // A thread principal do programa continuamente aguarda por novas conexões
-  while (1) {
-    struct sockaddr_storage client_storage;
-    struct sockaddr* client_addr = (struct sockaddr*)(&client_storage);
-    socklen_t client_addrlen = sizeof(client_storage);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&presence_batch.wakeup, &attr);
+  pthread_condattr_destroy(&attr);
+  presence_batch.window_ms = presence_window_ms;
+  registry_init(&clients, REGISTRY_INITIAL_CAPACITY, max_users);
+  qsbr_init(&qsbr);
+  atomic_init(&lookup, lookup_new(clients.capacity, NULL));
+
+  num_reactors = num_threads;
+  room_table_init(&room_table, num_reactors);
+  history_init(&history, history_msgs, history_bytes);
+  if (wal_dir != NULL) {
+    recover_history(wal_dir);
+
+    wal = (wal_t*)malloc(sizeof(wal_t));
+    if (wal_open(wal, wal_dir, commit_ms, commit_bytes) != 0) {
+      log_exit(wal_dir);
+    }
+  }
+  if (local_path != NULL) {
+    local_sock = listen_local_socket(local_path);
+  }
 
-    int client_sock = accept(server_sock, client_addr, &client_addrlen);
-    if (client_sock == -1) {
-      log_exit("accept");
+  reactors = (reactor_t*)calloc(num_reactors, sizeof(reactor_t));
+  for (int i = 0; i < num_reactors; i++) {
+    reactor_t* reactor = &reactors[i];
+    reactor->server_sock = listen_socket(&storage);
+    reactor->max_queue_bytes = max_queue_bytes;
+    reactor->slow_policy = slow_policy;
+    reactor->members_capacity = REGISTRY_INITIAL_CAPACITY;
+    reactor->members = (conn_t**)malloc(reactor->members_capacity * sizeof(conn_t*));
+    atomic_init(&reactor->active, 0);
+    atomic_init(&reactor->active_presence, 0);
+    mailbox_init(&reactor->mailbox);
+    stats_init(&reactor->stats);
+
+    reactor->now_ms = now_ns() / 1000000;
+    reactor->heartbeat_ms = heartbeat_ms;
+    reactor->idle_ms = idle_ms != 0 ? idle_ms : IDLE_FACTOR * heartbeat_ms;
+    wheel_init(&reactor->wheel, reactor->now_ms / TIMER_TICK_MS);
+    reactor->timer_fd = heartbeat_ms > 0 ? timer_fd_new() : -1;
+
+    // O limite global de entregas é dividido igualmente entre os reatores, de
+    // modo que cada um o aplica sem sincronização
+    reactor->msg_rate = msg_rate;
+    reactor->byte_rate = byte_rate;
+    double share = fanout_rate / num_reactors;
+    bucket_init(&reactor->fanout_budget, share, share > 1 ? share : 1, reactor->now_ms);
+  }
+
+  // O io_uring só é usado caso o kernel suporte todas as operações
+  // necessárias em todos os reatores. Caso contrário, é usado o epoll
+  if (backend == BACKEND_URING) {
+    for (int i = 0; i < num_reactors; i++) {
+      if (uring_reactor_init(&reactors[i]) != 0) {
+        eprintf("io_uring is not supported, falling back to epoll.\n");
+        for (int j = 0; j < i; j++) {
+          uring_bufs_destroy(&reactors[j].ring, &reactors[j].bufs);
+          uring_destroy(&reactors[j].ring);
+        }
+        backend = BACKEND_EPOLL;
+        break;
+      }
+    }
+  }
+
+  if (backend == BACKEND_URING && local_sock >= 0) {
+    int flags = fcntl(local_sock, F_GETFL);
+    if (flags == -1 || fcntl(local_sock, F_SETFL, flags & ~O_NONBLOCK) != 0) {
+      log_exit("fcntl");
+    }
+  }
+
+  for (int i = 0; i < num_reactors; i++) {
+    reactor_t* reactor = &reactors[i];
+    reactor->backend = backend;
+
+    if (backend == BACKEND_URING) {
+      // Os sockets são usados em modo bloqueante, já que o io_uring aguarda a
+      // prontidão internamente
+      int flags = fcntl(reactor->server_sock, F_GETFL);
+      if (flags == -1 || fcntl(reactor->server_sock, F_SETFL, flags & ~O_NONBLOCK) != 0) {
+        log_exit("fcntl");
+      }
+      continue;
+    }
+
+    reactor->epoll_fd = epoll_create1(0);
+    if (reactor->epoll_fd == -1) {
+      log_exit("epoll_create1");
     }
 
-    // Quando uma nova conexão é aceita, é criada uma nova thread para realizar
-    // o processamento das mensagens associadas ao cliente dessa conexão
-    server_thread_args* cdata = (server_thread_args*)malloc(sizeof(server_thread_args));
-    cdata->client_sock = client_sock;
-    cdata->mutex = &mutex;
+    // O socket do servidor é registrado com ponteiro nulo e a caixa de
+    // mensagens com o ponteiro do reator, o que permite que a thread os
+    // diferencie das conexões dos clientes
+    reactor_add(reactor, reactor->server_sock, NULL);
+    reactor_add(reactor, reactor->mailbox.event_fd, reactor);
+    if (reactor->timer_fd >= 0) {
+      reactor_add(reactor, reactor->timer_fd, &reactor->wheel);
+    }
+    if (local_sock >= 0) {
+      // O socket UNIX é compartilhado, e cada conexão acorda apenas um dos
+      // reatores
+      struct epoll_event ev = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = &local_sock};
+      if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, local_sock, &ev) != 0) {
+        log_exit("epoll_ctl");
+      }
+    }
+  }
+
+  // Cada reator é executado por uma thread, que processa apenas as suas
+  // próprias conexões
+  pthread_t* threads = (pthread_t*)malloc(num_reactors * sizeof(pthread_t));
+  for (int i = 0; i < num_reactors; i++) {
+    void* (*thread_fn)(void*) = backend == BACKEND_URING ? uring_reactor_thread : reactor_thread;
+    pthread_create(&threads[i], NULL, thread_fn, &reactors[i]);
+  }
+
+  // As alterações de presença acumuladas são anunciadas ao final da janela
+  // por uma thread própria
+  if (presence_window_ms > 0) {
+    pthread_t presence_tid;
+    pthread_create(&presence_tid, NULL, presence_thread, NULL);
+    pthread_detach(presence_tid);
+  }
 
-    pthread_t thread_id;
-    pthread_create(&thread_id, NULL, client_thread, (void*)cdata);
+  // As estatísticas são lidas por uma thread própria, para que a leitura não
+  // interfira no processamento das mensagens
+  if (stats_path != NULL) {
+    int stats_sock = stats_listen(stats_path);
+    pthread_t stats_tid;
+    pthread_create(&stats_tid, NULL, stats_thread, (void*)(intptr_t)stats_sock);
+    pthread_detach(stats_tid);
   }
 
+  for (int i = 0; i < num_reactors; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (int i = 0; i < num_reactors; i++) {
+    mailbox_destroy(&reactors[i].mailbox);
+    if (reactors[i].timer_fd >= 0) {
+      close(reactors[i].timer_fd);
+    }
+    free(reactors[i].members);
+    if (backend == BACKEND_URING) {
+      uring_bufs_destroy(&reactors[i].ring, &reactors[i].bufs);
+      uring_destroy(&reactors[i].ring);
+    } else {
+      close(reactors[i].epoll_fd);
+    }
+    close(reactors[i].server_sock);
+  }
+  if (local_sock >= 0) {
+    close(local_sock);
+    unlink(local_path);
+  }
+  free(reactors);
+  free(threads);
+  registry_destroy(&clients);
+  room_table_destroy(&room_table);
+  history_destroy(&history);
+  if (wal != NULL) {
+    wal_close(wal);
+    free(wal);
+  }
+  logger_destroy();
   pthread_mutex_destroy(&mutex);
-  close(server_sock);
 
   exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,255 @@
+#define _GNU_SOURCE
+#include "shm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHM_RING_MASK (SHM_RING_SIZE - 1)
+
+// Escreve uma notificação no eventfd "fd". O eventfd é não bloqueante, e uma
+// notificação que não cabe no contador é desnecessária, já que o outro lado
+// ainda não consumiu as anteriores.
+static void notify(int fd) {
+  uint64_t value = 1;
+  while (write(fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+  }
+}
+
+// Retorna 1 caso "fd" seja um eventfd.
+static int is_eventfd(int fd) {
+  char path[64];
+  char target[64];
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+  ssize_t len = readlink(path, target, sizeof(target) - 1);
+  if (len < 0) {
+    return 0;
+  }
+  target[len] = '\0';
+  return strcmp(target, "anon_inode:[eventfd]") == 0;
+}
+
+// Torna o file descriptor "fd" não bloqueante. Retorna 0 em caso de sucesso e
+// -1 caso contrário.
+static int set_nonblock(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  return flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0 ? -1 : 0;
+}
+
+int shm_link_create(shm_link_t* link, int fds[SHM_NUM_FDS]) {
+  memset(link, 0, sizeof(*link));
+  link->wait_fd = -1;
+  link->wake_fd = -1;
+
+  // A região é selada com o tamanho final, o que garante ao servidor que o
+  // mapeamento continua válido
+  int mem_fd = memfd_create("chat-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (mem_fd == -1) {
+    return -1;
+  }
+  if (ftruncate(mem_fd, sizeof(shm_area_t)) != 0 ||
+      fcntl(mem_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+    close(mem_fd);
+    return -1;
+  }
+
+  void* area = mmap(NULL, sizeof(shm_area_t), PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+  int server_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  int client_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (area == MAP_FAILED || server_fd == -1 || client_fd == -1) {
+    if (area != MAP_FAILED) {
+      munmap(area, sizeof(shm_area_t));
+    }
+    if (server_fd != -1) {
+      close(server_fd);
+    }
+    if (client_fd != -1) {
+      close(client_fd);
+    }
+    close(mem_fd);
+    return -1;
+  }
+
+  // O memfd começa zerado: os anéis estão vazios e ninguém aguarda
+  link->area = (shm_area_t*)area;
+  link->rx = &link->area->to_client;
+  link->tx = &link->area->to_server;
+  link->wait_fd = client_fd;
+  link->wake_fd = dup(server_fd);
+  if (link->wake_fd == -1) {
+    close(mem_fd);
+    close(server_fd);
+    shm_link_close(link);
+    return -1;
+  }
+
+  fds[SHM_FD_MEM] = mem_fd;
+  fds[SHM_FD_SERVER] = server_fd;
+  fds[SHM_FD_CLIENT] = dup(client_fd);
+  if (fds[SHM_FD_CLIENT] == -1) {
+    close(mem_fd);
+    close(server_fd);
+    shm_link_close(link);
+    return -1;
+  }
+
+  return 0;
+}
+
+int shm_link_attach(shm_link_t* link, const int fds[SHM_NUM_FDS]) {
+  memset(link, 0, sizeof(*link));
+  link->wait_fd = fds[SHM_FD_SERVER];
+  link->wake_fd = fds[SHM_FD_CLIENT];
+
+  // Uma região que pudesse ser reduzida pelo cliente faria os acessos do
+  // servidor gerarem SIGBUS
+  struct stat st;
+  int seals = fcntl(fds[SHM_FD_MEM], F_GET_SEALS);
+  int valid = fstat(fds[SHM_FD_MEM], &st) == 0 && st.st_size == sizeof(shm_area_t) &&
+              seals != -1 && (seals & F_SEAL_SHRINK) && is_eventfd(link->wait_fd) &&
+              is_eventfd(link->wake_fd) && set_nonblock(link->wait_fd) == 0 &&
+              set_nonblock(link->wake_fd) == 0;
+
+  void* area = MAP_FAILED;
+  if (valid) {
+    area = mmap(NULL, sizeof(shm_area_t), PROT_READ | PROT_WRITE, MAP_SHARED, fds[SHM_FD_MEM], 0);
+  }
+  close(fds[SHM_FD_MEM]);
+
+  if (area == MAP_FAILED) {
+    shm_link_close(link);
+    return -1;
+  }
+
+  // As posições próprias começam nas posições atuais dos anéis
+  link->area = (shm_area_t*)area;
+  link->rx = &link->area->to_server;
+  link->tx = &link->area->to_client;
+  link->rx_tail = atomic_load(&link->rx->tail);
+  link->tx_head = atomic_load(&link->tx->head);
+
+  return 0;
+}
+
+void shm_link_close(shm_link_t* link) {
+  if (link->area != NULL) {
+    munmap(link->area, sizeof(shm_area_t));
+    link->area = NULL;
+  }
+  if (link->wait_fd != -1) {
+    close(link->wait_fd);
+    link->wait_fd = -1;
+  }
+  if (link->wake_fd != -1) {
+    close(link->wake_fd);
+    link->wake_fd = -1;
+  }
+}
+
+ssize_t shm_writev(shm_link_t* link, const struct iovec* iov, int iovcnt) {
+  shm_ring_t* ring = link->tx;
+  size_t total = 0;
+  size_t skip = 0;
+  int waiting = 0;
+
+  while (iovcnt > 0) {
+    uint32_t used = link->tx_head - atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (used > SHM_RING_SIZE) {
+      return -1;
+    }
+
+    size_t space = SHM_RING_SIZE - used;
+    if (space == 0) {
+      // O anel cheio é verificado novamente após a marcação, já que o
+      // consumidor pode ter liberado espaço antes de vê-la
+      if (waiting) {
+        break;
+      }
+      atomic_store(&ring->writer_waiting, 1);
+      atomic_thread_fence(memory_order_seq_cst);
+      waiting = 1;
+      continue;
+    }
+
+    // Copia o trecho do segmento atual que cabe no anel, em até duas partes
+    // quando ele passa pelo final do buffer
+    size_t len = iov->iov_len - skip;
+    if (len > space) {
+      len = space;
+    }
+    const char* src = (const char*)iov->iov_base + skip;
+    size_t pos = link->tx_head & SHM_RING_MASK;
+    size_t first = len < SHM_RING_SIZE - pos ? len : SHM_RING_SIZE - pos;
+    memcpy(ring->data + pos, src, first);
+    memcpy(ring->data, src + first, len - first);
+
+    link->tx_head += len;
+    total += len;
+    skip += len;
+    if (skip == iov->iov_len) {
+      iov++;
+      iovcnt--;
+      skip = 0;
+    }
+  }
+
+  if (waiting && iovcnt == 0) {
+    atomic_store(&ring->writer_waiting, 0);
+  }
+
+  // Os bytes são publicados antes da verificação de que o consumidor aguarda,
+  // e ele verifica o anel novamente após marcar que aguarda
+  if (total > 0) {
+    atomic_store_explicit(&ring->head, link->tx_head, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->reader_waiting, memory_order_relaxed) &&
+        atomic_exchange(&ring->reader_waiting, 0)) {
+      notify(link->wake_fd);
+    }
+  }
+
+  return total;
+}
+
+ssize_t shm_peek(shm_link_t* link, const char** data) {
+  uint32_t available = atomic_load_explicit(&link->rx->head, memory_order_acquire) - link->rx_tail;
+  if (available > SHM_RING_SIZE) {
+    return -1;
+  }
+
+  size_t pos = link->rx_tail & SHM_RING_MASK;
+  *data = link->rx->data + pos;
+  return available < SHM_RING_SIZE - pos ? available : SHM_RING_SIZE - pos;
+}
+
+void shm_consume(shm_link_t* link, size_t len) {
+  shm_ring_t* ring = link->rx;
+  link->rx_tail += len;
+  atomic_store_explicit(&ring->tail, link->rx_tail, memory_order_release);
+
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&ring->writer_waiting, memory_order_relaxed) &&
+      atomic_exchange(&ring->writer_waiting, 0)) {
+    notify(link->wake_fd);
+  }
+}
+
+int shm_idle(shm_link_t* link) {
+  atomic_store(&link->rx->reader_waiting, 1);
+  atomic_thread_fence(memory_order_seq_cst);
+  return atomic_load_explicit(&link->rx->head, memory_order_acquire) == link->rx_tail;
+}
+
+void shm_ack(shm_link_t* link) {
+  uint64_t value;
+  while (read(link->wait_fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+  }
+}
+
+void shm_rearm(shm_link_t* link) {
+  notify(link->wait_fd);
+}
@@ -0,0 +1,129 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Transporte por memória compartilhada, para clientes na mesma máquina que o
+// servidor. O cliente conectado pelo socket UNIX do servidor cria uma região
+// de memória (memfd) com dois anéis de bytes, um para cada sentido, e dois
+// eventfds, e os envia junto com o REQ_ADD (SCM_RIGHTS), incluindo a
+// capacidade CAP_SHM. Caso o servidor aceite, a resposta ao REQ_ADD e todos os
+// quadros seguintes, nos dois sentidos, passam pelos anéis, com os mesmos bytes
+// que seriam enviados no socket (tamanho de 16 bits seguido do conteúdo), e o
+// socket passa a ser usado apenas para detectar o encerramento da conexão.
+// Caso contrário, a conexão continua usando o socket.
+//
+// Cada anel tem um único produtor e um único consumidor, que avançam as suas
+// posições sem travas. Cada lado aguarda no seu próprio eventfd, que o outro
+// lado só escreve quando ele indicou que vai aguardar: o consumidor que
+// encontra o anel vazio e o produtor que encontra o anel cheio. Assim, não há
+// chamadas de sistema enquanto os dois lados estão ativos.
+#define CAP_SHM "SHM1"
+
+// Capacidade de cada anel, em bytes. Precisa ser uma potência de 2.
+#define SHM_RING_SIZE (128 * 1024)
+
+// File descriptors enviados pelo cliente, nesta ordem: a memória
+// compartilhada, o eventfd em que o servidor aguarda e o eventfd em que o
+// cliente aguarda.
+#define SHM_FD_MEM 0
+#define SHM_FD_SERVER 1
+#define SHM_FD_CLIENT 2
+#define SHM_NUM_FDS 3
+
+// Anel de bytes na memória compartilhada. As posições são contadores de 32
+// bits do total de bytes escritos e lidos, e cada campo alterado por um lado
+// diferente fica em uma linha de cache própria.
+typedef struct shm_ring_t {
+  // Total de bytes escritos, alterado pelo produtor.
+  _Atomic uint32_t head;
+  char pad_head[60];
+
+  // Total de bytes lidos, alterado pelo consumidor.
+  _Atomic uint32_t tail;
+  char pad_tail[60];
+
+  // Indicam que o consumidor aguarda novos bytes e que o produtor aguarda
+  // espaço livre. São marcados por quem aguarda e desmarcados por quem o acorda.
+  _Atomic uint32_t reader_waiting;
+  _Atomic uint32_t writer_waiting;
+  char pad_waiting[56];
+
+  char data[SHM_RING_SIZE];
+} shm_ring_t;
+
+// Região compartilhada: o anel do cliente para o servidor e o do servidor para
+// o cliente.
+typedef struct shm_area_t {
+  shm_ring_t to_server;
+  shm_ring_t to_client;
+} shm_area_t;
+
+// Extremidade de um dos lados. As posições de escrita e de leitura próprias
+// são mantidas fora da memória compartilhada, e as do outro lado são
+// validadas a cada leitura, de modo que um lado não pode corromper o outro.
+typedef struct shm_link_t {
+  // Região mapeada, ou NULL caso o transporte não esteja em uso.
+  shm_area_t* area;
+
+  // Anéis em que este lado lê e escreve.
+  shm_ring_t* rx;
+  shm_ring_t* tx;
+
+  // Posição de leitura de "rx" e de escrita de "tx".
+  uint32_t rx_tail;
+  uint32_t tx_head;
+
+  // Eventfd em que este lado aguarda e eventfd do outro lado.
+  int wait_fd;
+  int wake_fd;
+} shm_link_t;
+
+// Cria a região compartilhada e os eventfds do lado do cliente. Os file
+// descriptors a serem enviados ao servidor são armazenados em "fds", e devem
+// ser fechados pelo chamador após o envio. Retorna 0 em caso de sucesso e -1
+// caso contrário.
+int shm_link_create(shm_link_t* link, int fds[SHM_NUM_FDS]);
+
+// Mapeia, do lado do servidor, a região e os eventfds recebidos em "fds",
+// verificando que a região tem o tamanho esperado e não pode ser reduzida e
+// que os demais são eventfds. Os file descriptors passam a pertencer à
+// extremidade, mesmo em caso de erro. Retorna 0 em caso de sucesso e -1 caso
+// contrário.
+int shm_link_attach(shm_link_t* link, const int fds[SHM_NUM_FDS]);
+
+// Libera a região e os eventfds da extremidade.
+void shm_link_close(shm_link_t* link);
+
+// Escreve em "tx" o máximo possível dos bytes dos "iovcnt" segmentos de "iov"
+// e acorda o outro lado, caso ele aguarde novos bytes. Caso o anel fique cheio,
+// o produtor passa a aguardar espaço livre, e é acordado quando o outro lado
+// consumir bytes. Retorna o número de bytes escritos ou -1 caso as posições do
+// anel sejam inválidas.
+ssize_t shm_writev(shm_link_t* link, const struct iovec* iov, int iovcnt);
+
+// Armazena em "data" um ponteiro para os bytes disponíveis em "rx" que são
+// contíguos na memória. Retorna o número desses bytes, 0 caso o anel esteja
+// vazio ou -1 caso as posições do anel sejam inválidas.
+ssize_t shm_peek(shm_link_t* link, const char** data);
+
+// Libera os "len" primeiros bytes disponíveis em "rx" e acorda o outro lado,
+// caso ele aguarde espaço livre.
+void shm_consume(shm_link_t* link, size_t len);
+
+// Indica que este lado vai aguardar novos bytes em "rx". Retorna 1 caso o anel
+// continue vazio, quando é seguro aguardar no eventfd, e 0 caso contrário.
+int shm_idle(shm_link_t* link);
+
+// Consome as notificações pendentes no eventfd deste lado, sem bloquear.
+void shm_ack(shm_link_t* link);
+
+// Notifica o próprio eventfd, para que a espera seguinte retorne
+// imediatamente.
+void shm_rearm(shm_link_t* link);
+
+#endif
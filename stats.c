@@ -0,0 +1,159 @@
+#include "stats.h"
+#include "common.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Nomes dos tipos de mensagem, indexados pelo ID.
+static const char* msg_names[STATS_MSG_TYPES] = {
+    NULL, "REQ_ADD", "REQ_REM", NULL, "RES_LIST", NULL, "MSG", "ERROR", "OK", "STREAM", "CREDIT",
+    "ROOM_JOIN", "ROOM_LEAVE", "ROOM_MSG", "HISTORY", "HEARTBEAT", "PRESENCE"};
+
+static void stats_hist_init(stats_hist_t* hist) {
+  for (int i = 0; i < HIST_SIZE; i++) {
+    atomic_init(&hist->counts[i], 0);
+  }
+  atomic_init(&hist->count, 0);
+  atomic_init(&hist->sum, 0);
+  atomic_init(&hist->min, UINT64_MAX);
+  atomic_init(&hist->max, 0);
+}
+
+void stats_init(stats_t* stats) {
+  for (int i = 0; i < STATS_MSG_TYPES; i++) {
+    atomic_init(&stats->msgs_in[i], 0);
+    atomic_init(&stats->msgs_out[i], 0);
+  }
+  atomic_init(&stats->bytes_in, 0);
+  atomic_init(&stats->bytes_out, 0);
+  atomic_init(&stats->dropped, 0);
+  atomic_init(&stats->evicted, 0);
+  atomic_init(&stats->timeouts, 0);
+  atomic_init(&stats->throttled, 0);
+  atomic_init(&stats->fanout_throttled, 0);
+
+  stats_hist_init(&stats->fanout);
+  stats_hist_init(&stats->lock_wait);
+  stats_hist_init(&stats->queue_depth);
+  stats_hist_init(&stats->latency);
+}
+
+void stats_record(stats_hist_t* hist, uint64_t value) {
+  stats_add(&hist->counts[hist_index(value)], 1);
+  stats_add(&hist->count, 1);
+  stats_add(&hist->sum, value);
+  if (value < atomic_load_explicit(&hist->min, memory_order_relaxed)) {
+    atomic_store_explicit(&hist->min, value, memory_order_relaxed);
+  }
+  if (value > atomic_load_explicit(&hist->max, memory_order_relaxed)) {
+    atomic_store_explicit(&hist->max, value, memory_order_relaxed);
+  }
+}
+
+void stats_hist_merge(hist_t* dst, const stats_hist_t* src) {
+  hist_t copy;
+  hist_init(&copy);
+
+  // A contagem total é recalculada a partir das posições, para que os
+  // percentis sejam consistentes mesmo com registros simultâneos
+  for (int i = 0; i < HIST_SIZE; i++) {
+    copy.counts[i] = atomic_load_explicit(&src->counts[i], memory_order_relaxed);
+    copy.count += copy.counts[i];
+  }
+  copy.sum = atomic_load_explicit(&src->sum, memory_order_relaxed);
+  copy.min = atomic_load_explicit(&src->min, memory_order_relaxed);
+  copy.max = atomic_load_explicit(&src->max, memory_order_relaxed);
+
+  hist_merge(dst, &copy);
+}
+
+// Escreve no file descriptor "fd" a linha de resumo do histograma de nome
+// "name", combinando os histogramas "offset" bytes após o início de cada
+// estatística.
+static void report_hist(int fd, const char* name, stats_t* const* stats, int n, size_t offset) {
+  hist_t hist;
+  hist_init(&hist);
+  for (int i = 0; i < n; i++) {
+    stats_hist_merge(&hist, (const stats_hist_t*)((const char*)stats[i] + offset));
+  }
+
+  dprintf(fd,
+          "%s count=%" PRIu64 " mean=%.1f p50=%" PRIu64 " p99=%" PRIu64 " p999=%" PRIu64
+          " max=%" PRIu64 "\n",
+          name, hist.count, hist_mean(&hist), hist_percentile(&hist, 50),
+          hist_percentile(&hist, 99), hist_percentile(&hist, 99.9), hist.max);
+}
+
+// Soma o contador "offset" bytes após o início de cada estatística.
+static uint64_t sum_counter(stats_t* const* stats, int n, size_t offset) {
+  uint64_t total = 0;
+  for (int i = 0; i < n; i++) {
+    total += atomic_load_explicit((_Atomic uint64_t*)((char*)stats[i] + offset),
+                                  memory_order_relaxed);
+  }
+  return total;
+}
+
+void stats_report(int fd, stats_t* const* stats, int n, uint64_t users) {
+  dprintf(fd, "users %" PRIu64 "\n", users);
+
+  const char* dirs[2] = {"msgs_in", "msgs_out"};
+  size_t dir_offsets[2] = {offsetof(stats_t, msgs_in), offsetof(stats_t, msgs_out)};
+  for (int d = 0; d < 2; d++) {
+    dprintf(fd, "%s", dirs[d]);
+    for (int type = 0; type < STATS_MSG_TYPES; type++) {
+      if (msg_names[type] != NULL) {
+        size_t offset = dir_offsets[d] + type * sizeof(_Atomic uint64_t);
+        dprintf(fd, " %s=%" PRIu64, msg_names[type], sum_counter(stats, n, offset));
+      }
+    }
+    dprintf(fd, "\n");
+  }
+
+  dprintf(fd, "bytes_in %" PRIu64 "\n", sum_counter(stats, n, offsetof(stats_t, bytes_in)));
+  dprintf(fd, "bytes_out %" PRIu64 "\n", sum_counter(stats, n, offsetof(stats_t, bytes_out)));
+  dprintf(fd, "dropped %" PRIu64 "\n", sum_counter(stats, n, offsetof(stats_t, dropped)));
+  dprintf(fd, "evicted %" PRIu64 "\n", sum_counter(stats, n, offsetof(stats_t, evicted)));
+  dprintf(fd, "timeouts %" PRIu64 "\n", sum_counter(stats, n, offsetof(stats_t, timeouts)));
+  dprintf(fd, "throttled %" PRIu64 "\n", sum_counter(stats, n, offsetof(stats_t, throttled)));
+  dprintf(fd, "fanout_throttled %" PRIu64 "\n",
+          sum_counter(stats, n, offsetof(stats_t, fanout_throttled)));
+
+  report_hist(fd, "fanout", stats, n, offsetof(stats_t, fanout));
+  report_hist(fd, "lock_wait_ns", stats, n, offsetof(stats_t, lock_wait));
+  report_hist(fd, "queue_depth_bytes", stats, n, offsetof(stats_t, queue_depth));
+  report_hist(fd, "latency_ns", stats, n, offsetof(stats_t, latency));
+}
+
+int stats_listen(const char* path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    eprintf("Stats socket path is too long.\n");
+    exit(EXIT_FAILURE);
+  }
+  strcpy(addr.sun_path, path);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock == -1) {
+    log_exit("socket");
+  }
+
+  // Um socket deixado por uma execução anterior impediria o bind
+  unlink(path);
+  if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    log_exit("bind");
+  }
+
+  if (listen(sock, SOMAXCONN) != 0) {
+    log_exit("listen");
+  }
+
+  return sock;
+}
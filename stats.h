@@ -0,0 +1,88 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "hist.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Número de tipos de mensagem contabilizados, indexados pelo próprio ID da
+// mensagem (de REQ_ADD a PRESENCE).
+#define STATS_MSG_TYPES 17
+
+// Histograma atualizado por uma única thread e lido por outras. Cada campo é
+// escrito com uma leitura seguida de uma escrita relaxadas, sem instruções
+// atômicas de leitura-modificação-escrita, de modo que o registro de um valor
+// custa o mesmo que em um "hist_t". Uma leitura simultânea pode observar um
+// valor registrado em apenas alguns dos campos, o que é aceitável para
+// estatísticas.
+typedef struct stats_hist_t {
+  _Atomic uint64_t counts[HIST_SIZE];
+  _Atomic uint64_t count;
+  _Atomic uint64_t sum;
+  _Atomic uint64_t min;
+  _Atomic uint64_t max;
+} stats_hist_t;
+
+// Estatísticas de uma thread do servidor. Cada reator atualiza apenas as suas
+// próprias estatísticas, sem travas, e as estatísticas de todos os reatores são
+// combinadas somente quando são lidas.
+typedef struct stats_t {
+  // Mensagens recebidas e enviadas, por tipo.
+  _Atomic uint64_t msgs_in[STATS_MSG_TYPES];
+  _Atomic uint64_t msgs_out[STATS_MSG_TYPES];
+
+  // Bytes recebidos e bytes inseridos nas filas de saída.
+  _Atomic uint64_t bytes_in;
+  _Atomic uint64_t bytes_out;
+
+  // Quadros descartados e clientes desconectados por filas de saída cheias.
+  _Atomic uint64_t dropped;
+  _Atomic uint64_t evicted;
+
+  // Conexões encerradas por inatividade.
+  _Atomic uint64_t timeouts;
+
+  // Mensagens recusadas pelos limites de taxa de cada conexão e pelo limite de
+  // entregas do reator.
+  _Atomic uint64_t throttled;
+  _Atomic uint64_t fanout_throttled;
+
+  // Número de destinatários de cada broadcast.
+  stats_hist_t fanout;
+
+  // Tempo de espera pela trava do grupo, em nanossegundos.
+  stats_hist_t lock_wait;
+
+  // Bytes na fila de saída de uma conexão após cada inserção.
+  stats_hist_t queue_depth;
+
+  // Tempo de processamento de cada mensagem recebida, em nanossegundos.
+  stats_hist_t latency;
+} stats_t;
+
+// Inicializa estatísticas zeradas.
+void stats_init(stats_t* stats);
+
+// Adiciona "value" ao contador "counter". Deve ser chamada apenas pela thread
+// dona do contador.
+static inline void stats_add(_Atomic uint64_t* counter, uint64_t value) {
+  uint64_t current = atomic_load_explicit(counter, memory_order_relaxed);
+  atomic_store_explicit(counter, current + value, memory_order_relaxed);
+}
+
+// Registra o valor "value" no histograma "hist". Deve ser chamada apenas pela
+// thread dona do histograma.
+void stats_record(stats_hist_t* hist, uint64_t value);
+
+// Adiciona ao histograma "dst" os valores registrados até o momento em "src".
+void stats_hist_merge(hist_t* dst, const stats_hist_t* src);
+
+// Escreve no file descriptor "fd" um relatório em texto com a combinação das
+// "n" estatísticas de "stats" e o número de usuários ativos "users".
+void stats_report(int fd, stats_t* const* stats, int n, uint64_t users);
+
+// Cria um socket UNIX no caminho "path", substituindo um arquivo que já exista
+// nele, que aguarda conexões de leitura das estatísticas. Retorna o socket.
+int stats_listen(const char* path);
+
+#endif
@@ -0,0 +1,314 @@
+#include "transfer.h"
+#include "lz.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Envia ao usuário "peer" um trecho do tipo "kind" do stream "stream_id", com
+// os "len" bytes de "data".
+static void send_stream(transfers_t* transfers, int peer, uint32_t stream_id, int kind,
+                        const char* data, size_t len) {
+  char content[WIRE_MAX_PAYLOAD];
+  size_t hdr_len = encode_stream_header(content, stream_id, kind);
+  if (len > 0) {
+    memcpy(content + hdr_len, data, len);
+  }
+
+  msg_view_t msg = {.id_msg = STREAM, .id_sender = transfers->my_id, .id_receiver = peer};
+  msg.message = content;
+  msg.len = hdr_len + len;
+
+  // Trechos que não se beneficiam da compactação são enviados sem ela
+  char buffer[BUFFER_SIZE];
+  int buffer_len = encode_lz(&msg, buffer);
+
+  pthread_mutex_lock(transfers->send_mutex);
+  int ret = send_frame(transfers->socket, buffer, buffer_len);
+  pthread_mutex_unlock(transfers->send_mutex);
+  if (ret != 0) {
+    log_exit("send");
+  }
+}
+
+// Devolve "credits" créditos do stream "stream_id" ao remetente "peer".
+static void send_credit(transfers_t* transfers, int peer, uint32_t stream_id, uint32_t credits) {
+  char content[CREDIT_SIZE];
+  msg_view_t msg = {.id_msg = CREDIT, .id_sender = transfers->my_id, .id_receiver = peer};
+  msg.message = content;
+  msg.len = encode_credit(content, stream_id, credits);
+
+  char buffer[BUFFER_SIZE];
+  int buffer_len = encode_bin(&msg, buffer);
+
+  pthread_mutex_lock(transfers->send_mutex);
+  int ret = send_frame(transfers->socket, buffer, buffer_len);
+  pthread_mutex_unlock(transfers->send_mutex);
+  if (ret != 0) {
+    log_exit("send");
+  }
+}
+
+// Retorna a transferência da lista "list" com o stream "stream_id" e o usuário
+// "peer", armazenando em "link" o ponteiro que aponta para ela, ou NULL caso
+// ela não exista.
+static transfer_t* find(transfer_t** list, int peer, uint32_t stream_id, transfer_t*** link) {
+  for (transfer_t** ptr = list; *ptr != NULL; ptr = &(*ptr)->next) {
+    if ((*ptr)->peer == peer && (*ptr)->stream_id == stream_id) {
+      if (link != NULL) {
+        *link = ptr;
+      }
+      return *ptr;
+    }
+  }
+
+  return NULL;
+}
+
+// Remove da lista a transferência apontada por "link" e libera sua memória,
+// fechando o arquivo.
+static void remove_transfer(transfer_t** link) {
+  transfer_t* transfer = *link;
+  *link = transfer->next;
+
+  if (transfer->file != NULL) {
+    fclose(transfer->file);
+  }
+  pthread_cond_destroy(&transfer->wakeup);
+  free(transfer);
+}
+
+// Função executada pela thread de cada envio. Cada trecho de dados consome um
+// crédito, e a thread aguarda novos créditos quando eles acabam.
+static void* transfer_thread(void* args) {
+  transfer_t* transfer = (transfer_t*)args;
+  transfers_t* transfers = transfer->owner;
+  int peer = transfer->peer;
+  uint32_t stream_id = transfer->stream_id;
+
+  send_stream(transfers, peer, stream_id, STREAM_OPEN, transfer->name, strlen(transfer->name));
+
+  char data[STREAM_CHUNK_SIZE];
+  int result = STREAM_END;
+  while (1) {
+    pthread_mutex_lock(&transfers->mutex);
+    while (transfer->credits == 0 && !transfer->aborted) {
+      pthread_cond_wait(&transfer->wakeup, &transfers->mutex);
+    }
+    int aborted = transfer->aborted;
+    if (!aborted) {
+      transfer->credits--;
+    }
+    pthread_mutex_unlock(&transfers->mutex);
+
+    if (aborted) {
+      result = STREAM_ABORT;
+      break;
+    }
+
+    size_t len = fread(data, 1, sizeof(data), transfer->file);
+    if (len == 0) {
+      result = ferror(transfer->file) ? STREAM_CANCEL : STREAM_END;
+      break;
+    }
+
+    send_stream(transfers, peer, stream_id, STREAM_DATA, data, len);
+    transfer->bytes += len;
+  }
+
+  // Um stream abortado pelo destinatário não precisa de aviso
+  if (result != STREAM_ABORT) {
+    send_stream(transfers, peer, stream_id, result, NULL, 0);
+  }
+
+  if (result == STREAM_END) {
+    printf("File %s sent to %d (%zu bytes)\n", transfer->name, peer, transfer->bytes);
+  } else {
+    printf("Transfer of %s to %d aborted\n", transfer->name, peer);
+  }
+
+  pthread_mutex_lock(&transfers->mutex);
+  transfer_t** link;
+  if (find(&transfers->out, peer, stream_id, &link) != NULL) {
+    remove_transfer(link);
+  }
+  pthread_mutex_unlock(&transfers->mutex);
+
+  pthread_exit(NULL);
+}
+
+void transfers_init(transfers_t* transfers, int socket, int my_id, pthread_mutex_t* send_mutex) {
+  pthread_mutex_init(&transfers->mutex, NULL);
+  transfers->out = NULL;
+  transfers->in = NULL;
+  transfers->next_id = 1;
+  transfers->socket = socket;
+  transfers->my_id = my_id;
+  transfers->send_mutex = send_mutex;
+}
+
+// Cria uma transferência com o stream "stream_id", o usuário "peer", o arquivo
+// "file" e o nome "name".
+static transfer_t* transfer_new(uint32_t stream_id, int peer, FILE* file, const char* name) {
+  transfer_t* transfer = (transfer_t*)calloc(1, sizeof(transfer_t));
+  if (transfer == NULL) {
+    log_exit("calloc");
+  }
+
+  transfer->stream_id = stream_id;
+  transfer->peer = peer;
+  transfer->file = file;
+  snprintf(transfer->name, sizeof(transfer->name), "%s", name);
+  pthread_cond_init(&transfer->wakeup, NULL);
+
+  return transfer;
+}
+
+int transfer_start(transfers_t* transfers, int receiver, const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return -1;
+  }
+
+  // Apenas o nome do arquivo, sem os diretórios, é enviado ao destinatário
+  const char* name = strrchr(path, '/');
+  name = name == NULL ? path : name + 1;
+
+  pthread_mutex_lock(&transfers->mutex);
+  transfer_t* transfer = transfer_new(transfers->next_id++, receiver, file, name);
+  transfer->credits = STREAM_WINDOW;
+  transfer->owner = transfers;
+  transfer->next = transfers->out;
+  transfers->out = transfer;
+  pthread_mutex_unlock(&transfers->mutex);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, transfer_thread, transfer);
+  pthread_detach(thread);
+
+  return 0;
+}
+
+// Inicia o recebimento do stream "stream_id" do usuário "peer", com o nome
+// "name" de tamanho "len". O arquivo é salvo no diretório atual, com o ID do
+// remetente como prefixo. Deve ser chamada em exclusão mútua.
+static void receive_open(transfers_t* transfers, int peer, uint32_t stream_id, const char* name,
+                         size_t len) {
+  // Nomes que poderiam apontar para outro diretório são ignorados
+  char safe_name[256];
+  snprintf(safe_name, sizeof(safe_name), "%.*s", (int)len, name);
+  if (safe_name[0] == '\0' || safe_name[0] == '.' || strchr(safe_name, '/') != NULL) {
+    strcpy(safe_name, "file");
+  }
+
+  char path[300];
+  snprintf(path, sizeof(path), "%d-%s", peer, safe_name);
+
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    printf("Could not save %s from %d\n", safe_name, peer);
+    send_stream(transfers, peer, stream_id, STREAM_ABORT, NULL, 0);
+    return;
+  }
+
+  transfer_t* transfer = transfer_new(stream_id, peer, file, path);
+  transfer->owner = transfers;
+  transfer->next = transfers->in;
+  transfers->in = transfer;
+
+  printf("Receiving %s from %d\n", safe_name, peer);
+}
+
+void transfer_handle_stream(transfers_t* transfers, const msg_view_t* msg) {
+  uint32_t stream_id;
+  int kind;
+  if (decode_stream(msg, &stream_id, &kind) == 0) {
+    // Um trecho malformado não pertence a nenhuma transferência e é descartado
+    return;
+  }
+
+  const char* data = msg->message + STREAM_HDR_SIZE;
+  size_t len = msg->len - STREAM_HDR_SIZE;
+  int peer = msg->id_sender;
+
+  pthread_mutex_lock(&transfers->mutex);
+
+  if (kind == STREAM_OPEN) {
+    receive_open(transfers, peer, stream_id, data, len);
+  } else if (kind == STREAM_ABORT) {
+    // O destinatário, ou o servidor em seu nome, abortou um envio
+    transfer_t* transfer = find(&transfers->out, peer, stream_id, NULL);
+    if (transfer != NULL) {
+      transfer->aborted = 1;
+      pthread_cond_signal(&transfer->wakeup);
+    }
+  } else {
+    transfer_t** link;
+    transfer_t* transfer = find(&transfers->in, peer, stream_id, &link);
+    if (transfer == NULL) {
+      // Trechos de um stream que não pôde ser aberto são descartados
+    } else if (kind == STREAM_DATA) {
+      if (fwrite(data, 1, len, transfer->file) != len) {
+        printf("Could not save %s from %d\n", transfer->name, peer);
+        send_stream(transfers, peer, stream_id, STREAM_ABORT, NULL, 0);
+        remove_transfer(link);
+      } else {
+        transfer->bytes += len;
+
+        // Os créditos são devolvidos em lotes de meia janela, o que evita uma
+        // mensagem CREDIT por trecho sem que o remetente fique sem créditos
+        if (++transfer->credits >= STREAM_WINDOW / 2) {
+          send_credit(transfers, peer, stream_id, transfer->credits);
+          transfer->credits = 0;
+        }
+      }
+    } else if (kind == STREAM_END) {
+      printf("File from %d saved as %s (%zu bytes)\n", peer, transfer->name, transfer->bytes);
+      remove_transfer(link);
+    } else if (kind == STREAM_CANCEL) {
+      printf("Transfer of %s from %d aborted\n", transfer->name, peer);
+      remove_transfer(link);
+    }
+  }
+
+  pthread_mutex_unlock(&transfers->mutex);
+}
+
+void transfer_handle_credit(transfers_t* transfers, const msg_view_t* msg) {
+  uint32_t stream_id;
+  uint32_t credits;
+  if (decode_credit(msg, &stream_id, &credits) == 0) {
+    // Um crédito malformado é descartado
+    return;
+  }
+
+  pthread_mutex_lock(&transfers->mutex);
+  transfer_t* transfer = find(&transfers->out, msg->id_sender, stream_id, NULL);
+  if (transfer != NULL) {
+    transfer->credits += credits;
+    pthread_cond_signal(&transfer->wakeup);
+  }
+  pthread_mutex_unlock(&transfers->mutex);
+}
+
+void transfer_peer_left(transfers_t* transfers, int peer) {
+  pthread_mutex_lock(&transfers->mutex);
+
+  // Os envios são encerrados pelas suas próprias threads
+  for (transfer_t* transfer = transfers->out; transfer != NULL; transfer = transfer->next) {
+    if (transfer->peer == peer) {
+      transfer->aborted = 1;
+      pthread_cond_signal(&transfer->wakeup);
+    }
+  }
+
+  transfer_t** link = &transfers->in;
+  while (*link != NULL) {
+    if ((*link)->peer == peer) {
+      printf("Transfer of %s from %d aborted\n", (*link)->name, peer);
+      remove_transfer(link);
+    } else {
+      link = &(*link)->next;
+    }
+  }
+
+  pthread_mutex_unlock(&transfers->mutex);
+}
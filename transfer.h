@@ -0,0 +1,89 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include "common.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Transferência de arquivo em andamento, enviada ou recebida pelo usuário.
+typedef struct transfer_t {
+  // ID do stream, escolhido pelo remetente.
+  uint32_t stream_id;
+
+  // ID do outro usuário: o destinatário de um envio ou o remetente de um
+  // recebimento.
+  int peer;
+
+  // Arquivo lido (envio) ou escrito (recebimento).
+  FILE* file;
+
+  // Nome do arquivo, como informado no primeiro trecho do stream.
+  char name[256];
+
+  // Bytes transferidos até o momento.
+  size_t bytes;
+
+  // Em um envio, créditos disponíveis. Em um recebimento, trechos consumidos
+  // desde a última devolução de créditos.
+  uint32_t credits;
+
+  // Indica que o envio foi abortado.
+  int aborted;
+
+  // Variável de condição sinalizada quando o envio recebe créditos ou é
+  // abortado.
+  pthread_cond_t wakeup;
+
+  // Próxima transferência da mesma lista.
+  struct transfer_t* next;
+
+  // Conjunto ao qual a transferência pertence.
+  struct transfers_t* owner;
+} transfer_t;
+
+// Transferências de um usuário. Cada envio é feito por uma thread própria, que
+// só envia um trecho quando possui créditos, de modo que as mensagens de chat
+// continuam sendo enviadas entre os trechos. Os recebimentos são tratados pela
+// thread de recebimento de mensagens.
+typedef struct transfers_t {
+  // Trava que protege as listas e o estado das transferências.
+  pthread_mutex_t mutex;
+
+  // Envios e recebimentos em andamento.
+  transfer_t* out;
+  transfer_t* in;
+
+  // ID do próximo stream enviado.
+  uint32_t next_id;
+
+  // Socket da conexão com o servidor e ID do usuário.
+  int socket;
+  int my_id;
+
+  // Trava que serializa os envios no socket, compartilhada com as demais
+  // threads que enviam mensagens.
+  pthread_mutex_t* send_mutex;
+} transfers_t;
+
+// Inicializa um conjunto vazio de transferências do usuário "my_id", cujas
+// mensagens são enviadas no socket "socket" (no formato binário) sob a trava
+// "send_mutex".
+void transfers_init(transfers_t* transfers, int socket, int my_id, pthread_mutex_t* send_mutex);
+
+// Inicia o envio do arquivo no caminho "path" para o usuário "receiver", em uma
+// nova thread. Retorna 0 em caso de sucesso e -1 caso o arquivo não possa ser
+// aberto.
+int transfer_start(transfers_t* transfers, int receiver, const char* path);
+
+// Trata a mensagem STREAM "msg", que pode ser um trecho de um recebimento ou o
+// aborto de um envio.
+void transfer_handle_stream(transfers_t* transfers, const msg_view_t* msg);
+
+// Trata a mensagem CREDIT "msg", que devolve créditos a um envio.
+void transfer_handle_credit(transfers_t* transfers, const msg_view_t* msg);
+
+// Aborta as transferências com o usuário "peer", que saiu do grupo.
+void transfer_peer_left(transfers_t* transfers, int peer);
+
+#endif
@@ -0,0 +1,242 @@
+#include "uring.h"
+#include "common.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Operações que o kernel precisa suportar para que o io_uring seja usado.
+static const int required_ops[] = {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG,
+                                   IORING_OP_POLL_ADD};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                              unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// Retorna 1 caso o kernel suporte todas as operações de "required_ops".
+static int probe_ops(uring_t* ring) {
+  size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, size);
+  if (probe == NULL) {
+    log_exit("calloc");
+  }
+
+  int supported = sys_io_uring_register(ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+  for (size_t i = 0; supported && i < sizeof(required_ops) / sizeof(required_ops[0]); i++) {
+    int op = required_ops[i];
+    supported = op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  free(probe);
+  return supported;
+}
+
+int uring_init(uring_t* ring, unsigned entries) {
+  memset(ring, 0, sizeof(*ring));
+
+  // COOP_TASKRUN evita interrupções da thread para processar conclusões, já
+  // que ela só as consome ao entrar no kernel. Kernels antigos não suportam a
+  // opção
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_COOP_TASKRUN;
+  ring->fd = sys_io_uring_setup(entries, &params);
+  if (ring->fd < 0 && errno == EINVAL) {
+    memset(&params, 0, sizeof(params));
+    ring->fd = sys_io_uring_setup(entries, &params);
+  }
+  if (ring->fd < 0) {
+    return -1;
+  }
+
+  // As filas de submissão e conclusão são mapeadas em uma única região
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+    close(ring->fd);
+    return -1;
+  }
+
+  ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (ring->cq_size > ring->sq_size) {
+    ring->sq_size = ring->cq_size;
+  }
+
+  ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sq_ptr == MAP_FAILED) {
+    close(ring->fd);
+    return -1;
+  }
+  ring->cq_ptr = ring->sq_ptr;
+
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->fd);
+    return -1;
+  }
+
+  char* sq = (char*)ring->sq_ptr;
+  ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+  ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+  ring->sq_entries = params.sq_entries;
+  ring->sqe_tail = *ring->sq_tail;
+  ring->submitted = ring->sqe_tail;
+
+  // Cada posição da fila de submissão aponta sempre para a SQE de mesmo índice
+  unsigned* array = (unsigned*)(sq + params.sq_off.array);
+  for (unsigned i = 0; i < params.sq_entries; i++) {
+    array[i] = i;
+  }
+
+  char* cq = (char*)ring->cq_ptr;
+  ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+  ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+  if (!probe_ops(ring)) {
+    uring_destroy(ring);
+    return -1;
+  }
+
+  return 0;
+}
+
+void uring_destroy(uring_t* ring) {
+  munmap(ring->sqes, ring->sqes_size);
+  munmap(ring->sq_ptr, ring->sq_size);
+  close(ring->fd);
+}
+
+struct io_uring_sqe* uring_get_sqe(uring_t* ring) {
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  if (ring->sqe_tail - head >= ring->sq_entries) {
+    uring_submit(ring, 0);
+
+    // Caso o kernel não tenha aceitado as SQEs, não há posição livre
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head >= ring->sq_entries) {
+      log_exit("io_uring_enter");
+    }
+  }
+
+  struct io_uring_sqe* sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+  ring->sqe_tail++;
+  memset(sqe, 0, sizeof(*sqe));
+
+  return sqe;
+}
+
+void uring_submit(uring_t* ring, unsigned wait_nr) {
+  __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+  unsigned to_submit = ring->sqe_tail - ring->submitted;
+  unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+  while (1) {
+    int ret = sys_io_uring_enter(ring->fd, to_submit, wait_nr, flags);
+    if (ret >= 0) {
+      ring->submitted += ret;
+      break;
+    } else if (errno == EINTR) {
+      // As SQEs podem ter sido consumidas antes da interrupção
+      to_submit = ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+      ring->submitted = ring->sqe_tail - to_submit;
+      continue;
+    } else if (errno == EBUSY || errno == EAGAIN) {
+      // A fila de conclusão está cheia: as conclusões precisam ser consumidas
+      // antes de novas submissões
+      break;
+    }
+    log_exit("io_uring_enter");
+  }
+}
+
+struct io_uring_cqe* uring_peek_cqe(uring_t* ring) {
+  unsigned head = *ring->cq_head;
+  if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+
+  return &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_cqe_seen(uring_t* ring) {
+  __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int uring_bufs_init(uring_t* ring, uring_bufs_t* bufs, unsigned short bgid, unsigned entries,
+                    unsigned size) {
+  bufs->entries = entries;
+  bufs->size = size;
+  bufs->bgid = bgid;
+
+  // O anel precisa estar alinhado ao tamanho de página
+  size_t ring_size = entries * sizeof(struct io_uring_buf);
+  bufs->ring = (struct io_uring_buf_ring*)mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+                                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (bufs->ring == MAP_FAILED) {
+    log_exit("mmap");
+  }
+
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (unsigned long)bufs->ring;
+  reg.ring_entries = entries;
+  reg.bgid = bgid;
+  if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+    munmap(bufs->ring, ring_size);
+    return -1;
+  }
+
+  bufs->base = (char*)malloc((size_t)entries * size);
+  if (bufs->base == NULL) {
+    log_exit("malloc");
+  }
+
+  for (unsigned bid = 0; bid < entries; bid++) {
+    uring_buf_recycle(bufs, bid);
+  }
+
+  return 0;
+}
+
+void uring_bufs_destroy(uring_t* ring, uring_bufs_t* bufs) {
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.bgid = bufs->bgid;
+  sys_io_uring_register(ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+
+  munmap(bufs->ring, bufs->entries * sizeof(struct io_uring_buf));
+  free(bufs->base);
+}
+
+char* uring_buf_data(const uring_bufs_t* bufs, unsigned bid) {
+  return bufs->base + (size_t)bid * bufs->size;
+}
+
+void uring_buf_recycle(uring_bufs_t* bufs, unsigned bid) {
+  // Apenas a thread do reator insere buffers no anel, então a posição final
+  // pode ser lida sem sincronização
+  unsigned short tail = bufs->ring->tail;
+  struct io_uring_buf* buf = &bufs->ring->bufs[tail & (bufs->entries - 1)];
+  buf->addr = (unsigned long)uring_buf_data(bufs, bid);
+  buf->len = bufs->size;
+  buf->bid = bid;
+
+  __atomic_store_n(&bufs->ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
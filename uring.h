@@ -0,0 +1,96 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+// Instância io_uring acessada diretamente pelas chamadas de sistema, sem o uso
+// da liburing. As entradas de submissão (SQEs) são preenchidas localmente e só
+// são entregues ao kernel em "uring_submit", de modo que várias operações são
+// submetidas em uma única chamada de sistema.
+typedef struct uring_t {
+  // File descriptor da instância.
+  int fd;
+
+  // Fila de submissão, compartilhada com o kernel.
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  struct io_uring_sqe* sqes;
+
+  // Próxima posição livre da fila de submissão e última posição já entregue
+  // ao kernel.
+  unsigned sqe_tail;
+  unsigned submitted;
+
+  // Fila de conclusão, compartilhada com o kernel.
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe* cqes;
+
+  // Regiões mapeadas, liberadas em "uring_destroy".
+  void* sq_ptr;
+  size_t sq_size;
+  void* cq_ptr;
+  size_t cq_size;
+  size_t sqes_size;
+} uring_t;
+
+// Anel de buffers fornecidos ao kernel (provided buffers). Os recebimentos
+// escolhem um buffer livre do anel no momento em que os dados chegam, de modo
+// que nenhuma memória fica reservada para conexões ociosas.
+typedef struct uring_bufs_t {
+  // Anel compartilhado com o kernel.
+  struct io_uring_buf_ring* ring;
+
+  // Memória dos buffers, que possuem "size" bytes cada.
+  char* base;
+  unsigned entries;
+  unsigned size;
+
+  // Identificador do grupo de buffers, usado nas SQEs.
+  unsigned short bgid;
+} uring_bufs_t;
+
+// Cria uma instância io_uring com "entries" entradas de submissão e verifica se
+// o kernel suporta as operações usadas pelo servidor. Retorna 0 em caso de
+// sucesso e -1 caso o io_uring não esteja disponível.
+int uring_init(uring_t* ring, unsigned entries);
+
+// Libera os recursos da instância.
+void uring_destroy(uring_t* ring);
+
+// Retorna uma SQE zerada, submetendo as SQEs pendentes caso a fila de
+// submissão esteja cheia.
+struct io_uring_sqe* uring_get_sqe(uring_t* ring);
+
+// Entrega ao kernel as SQEs pendentes e aguarda até que haja ao menos
+// "wait_nr" conclusões disponíveis.
+void uring_submit(uring_t* ring, unsigned wait_nr);
+
+// Retorna a próxima conclusão disponível, ou NULL caso não haja nenhuma. A
+// conclusão deve ser liberada com "uring_cqe_seen" após ser lida.
+struct io_uring_cqe* uring_peek_cqe(uring_t* ring);
+
+// Libera a conclusão retornada por "uring_peek_cqe".
+void uring_cqe_seen(uring_t* ring);
+
+// Registra um anel com "entries" buffers de "size" bytes no grupo "bgid".
+// "entries" precisa ser uma potência de 2. Retorna 0 em caso de sucesso e -1
+// caso o kernel não suporte anéis de buffers.
+int uring_bufs_init(uring_t* ring, uring_bufs_t* bufs, unsigned short bgid, unsigned entries,
+                    unsigned size);
+
+// Libera o anel de buffers.
+void uring_bufs_destroy(uring_t* ring, uring_bufs_t* bufs);
+
+// Retorna o buffer de identificador "bid".
+char* uring_buf_data(const uring_bufs_t* bufs, unsigned bid);
+
+// Devolve ao kernel o buffer de identificador "bid", depois que seus dados
+// foram consumidos.
+void uring_buf_recycle(uring_bufs_t* bufs, unsigned bid);
+
+#endif
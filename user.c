@@ -1,4 +1,7 @@
 #include "common.h"
+#include "lz.h"
+#include "presence.h"
+#include "transfer.h"
 #include <arpa/inet.h>
 #include <inttypes.h>
 #include <pthread.h>
@@ -7,8 +10,59 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+// Lista de usuários conhecidos, indexada pelo ID de cada usuário. A lista cresce
+// conforme são recebidos IDs maiores do que o seu tamanho atual.
+typedef struct user_list_t {
+  // Indica, para cada ID, se o usuário está ativo (1) ou não (0).
+  int* present;
+
+  // Número de posições alocadas em "present".
+  size_t size;
+
+  // No caso da presença compacta, versão do snapshot e versão da última
+  // alteração aplicada a cada ID (0 caso nenhuma tenha sido aplicada).
+  uint32_t snapshot;
+  uint32_t* versions;
+} user_list_t;
+
+// Número máximo de mensagens privadas enviadas que podem estar aguardando a
+// confirmação do servidor ao mesmo tempo.
+#define PRIVATE_WINDOW 64
+
+// Mensagem privada enviada que aguarda a confirmação (OK ou ERROR) do servidor.
+typedef struct pending_t {
+  // ID de requisição da mensagem.
+  uint32_t req_id;
+
+  // ID do destinatário.
+  int id_receiver;
+
+  // Cópia do conteúdo, impressa quando a confirmação chega.
+  char* message;
+} pending_t;
+
+// Janela de mensagens privadas aguardando confirmação, em uma fila circular na
+// ordem de envio. Como o servidor responde na mesma ordem, cada confirmação
+// corresponde sempre à mensagem mais antiga da janela, e o ID de requisição
+// (no formato binário) apenas confirma essa correspondência.
+typedef struct pending_window_t {
+  pending_t items[PRIVATE_WINDOW];
+
+  // Posição da mensagem mais antiga e número de mensagens na janela.
+  size_t head;
+  size_t count;
+
+  // ID de requisição da próxima mensagem. O valor 0 não é usado, já que
+  // indica a ausência de ID.
+  uint32_t next_id;
+
+  // Variável de condição sinalizada quando uma posição da janela é liberada.
+  pthread_cond_t space;
+} pending_window_t;
+
 // Struct que é usado para a passagem de argumentos às threads
 typedef struct user_thread_args {
   // Socket da conexão com o servidor.
@@ -17,57 +71,286 @@ typedef struct user_thread_args {
   // ID do usuário
   int my_id;
 
-  // Array de usuários ativos.
-  int* user_list;
+  // Lista de usuários ativos.
+  user_list_t* user_list;
 
   // Trava mutex a ser usada pelas threads
   pthread_mutex_t* mutex;
 
-  // Variável de condição que é usada para que a thread de recebimento de
-  // mensagens possa informar a thread de envio quando é recebida uma confirmação
-  // do tipo OK para o envio de uma mensagem privada
-  pthread_cond_t* confirmation_arrived;
+  // Mensagens privadas enviadas que aguardam confirmação. A thread de envio
+  // insere as mensagens e a thread de recebimento as remove quando as
+  // confirmações chegam
+  pending_window_t* pending;
+
+  // Indica se as mensagens são trocadas no formato binário
+  int binary;
+
+  // Transferências de arquivos em andamento
+  transfers_t* transfers;
 
-  // Variável que indica se a confirmação recebida foi positiva ou negativa
-  int* confirmed;
+  // Leitor de quadros do socket, usado somente pela thread de recebimento
+  frame_reader_t* reader;
 } user_thread_args;
 
-// Atualiza o array "user_list" para ter os usuários passados na lista da
+// Retorna 1 caso o usuário de ID "id" esteja marcado como ativo na lista e 0
+// caso contrário.
+int user_list_get(const user_list_t* user_list, int id) {
+  if (id < 0 || (size_t)id >= user_list->size) {
+    return 0;
+  }
+
+  return user_list->present[id];
+}
+
+// Marca o usuário de ID "id" como ativo (1) ou inativo (0), aumentando a lista
+// caso necessário.
+void user_list_set(user_list_t* user_list, int id, int value) {
+  if (id < 0) {
+    return;
+  }
+
+  if ((size_t)id >= user_list->size) {
+    size_t new_size = user_list->size == 0 ? 16 : user_list->size;
+    while (new_size <= (size_t)id) {
+      new_size *= 2;
+    }
+
+    user_list->present = (int*)realloc(user_list->present, new_size * sizeof(int));
+    user_list->versions =
+        (uint32_t*)realloc(user_list->versions, new_size * sizeof(uint32_t));
+    if (user_list->present == NULL || user_list->versions == NULL) {
+      log_exit("realloc");
+    }
+    memset(user_list->present + user_list->size, 0,
+           (new_size - user_list->size) * sizeof(int));
+    memset(user_list->versions + user_list->size, 0,
+           (new_size - user_list->size) * sizeof(uint32_t));
+    user_list->size = new_size;
+  }
+
+  user_list->present[id] = value;
+}
+
+// Atualiza a lista "user_list" para ter os usuários passados na lista da
 // mensagem do tipo RES_LIST
-void set_user_list(int* user_list, char* message) {
+void set_user_list(user_list_t* user_list, char* message) {
   char delim[] = ",";
-  char* token = strtok(message, delim);
+  char* saveptr;
+  char* token = strtok_r(message, delim, &saveptr);
   while (token != NULL) {
     int id = atoi(token);
-    user_list[id] = 1;
-    token = strtok(NULL, delim);
+    user_list_set(user_list, id, 1);
+    token = strtok_r(NULL, delim, &saveptr);
+  }
+}
+
+// Argumentos usados na aplicação de uma mensagem PRESENCE.
+typedef struct presence_args_t {
+  user_list_t* user_list;
+  pthread_mutex_t* mutex;
+  transfers_t* transfers;
+} presence_args_t;
+
+// Aplica à lista de usuários um ID de uma mensagem PRESENCE. Os IDs do snapshot
+// apenas marcam os usuários como ativos, enquanto as alterações posteriores ao
+// snapshot são impressas da mesma forma que os anúncios de entrada e saída. As
+// alterações de usuários de reatores diferentes do servidor podem chegar fora
+// de ordem, então uma alteração só é descartada caso o snapshot ou uma
+// alteração do mesmo ID com versão maior já tenha sido aplicada.
+void apply_presence(int kind, int id, int present, uint32_t version, void* arg) {
+  presence_args_t* args = (presence_args_t*)arg;
+  user_list_t* user_list = args->user_list;
+
+  if (args->mutex != NULL) {
+    pthread_mutex_lock(args->mutex);
+  }
+  int stale = 0;
+  if (kind == PRESENCE_DELTA) {
+    uint32_t last = user_list->snapshot;
+    if ((size_t)id < user_list->size && user_list->versions[id] != 0) {
+      last = user_list->versions[id];
+    }
+    stale = (int32_t)(version - last) <= 0;
+  } else {
+    user_list->snapshot = version;
+  }
+  if (!stale) {
+    user_list_set(user_list, id, present);
+    user_list->versions[id] = version;
+  }
+  if (args->mutex != NULL) {
+    pthread_mutex_unlock(args->mutex);
+  }
+
+  if (stale || kind != PRESENCE_DELTA) {
+    return;
   }
+
+  if (present) {
+    printf("User %d joined the group!\n", id);
+  } else {
+    printf("User %d left the group!\n", id);
+    transfer_peer_left(args->transfers, id);
+  }
+}
+
+// Insere na janela "window" a mensagem privada para o usuário "id_receiver",
+// com o conteúdo "message", aguardando enquanto a janela estiver cheia. Retorna
+// o ID de requisição da mensagem. Precisa ser feito em exclusão mútua, com a
+// trava "mutex".
+uint32_t pending_push(pending_window_t* window, pthread_mutex_t* mutex, int id_receiver,
+                      const char* message) {
+  while (window->count == PRIVATE_WINDOW) {
+    pthread_cond_wait(&window->space, mutex);
+  }
+
+  pending_t* item = &window->items[(window->head + window->count) % PRIVATE_WINDOW];
+  item->req_id = window->next_id++;
+  if (window->next_id == 0) {
+    window->next_id = 1;
+  }
+  item->id_receiver = id_receiver;
+  item->message = strdup(message);
+  if (item->message == NULL) {
+    log_exit("strdup");
+  }
+  window->count++;
+
+  return item->req_id;
+}
+
+// Libera a mensagem mais antiga da janela "window".
+void pending_pop(pending_window_t* window) {
+  free(window->items[window->head].message);
+  window->head = (window->head + 1) % PRIVATE_WINDOW;
+  window->count--;
+  pthread_cond_signal(&window->space);
+}
+
+// Trata a confirmação de ID de requisição "req_id" recebida do servidor, que
+// pode ser positiva ("ok" igual a 1) ou negativa (0). A mensagem enviada é
+// impressa caso tenha sido confirmada, e sua posição na janela é liberada.
+// Precisa ser feito em exclusão mútua, com a trava que protege a janela.
+void pending_resolve(pending_window_t* window, uint32_t req_id, int ok) {
+  // As confirmações chegam na ordem de envio. No formato de texto não há ID,
+  // e a confirmação é associada à mensagem mais antiga. Caso contrário, a
+  // mensagem é procurada na janela, e uma confirmação desconhecida é ignorada
+  size_t index = 0;
+  if (req_id != 0) {
+    while (index < window->count &&
+           window->items[(window->head + index) % PRIVATE_WINDOW].req_id != req_id) {
+      index++;
+    }
+  }
+  if (index == window->count) {
+    return;
+  }
+
+  // As mensagens anteriores, cujas confirmações não chegaram, não serão mais
+  // confirmadas e deixam a janela
+  for (; index > 0; index--) {
+    pending_t* item = &window->items[window->head];
+    printf("Private message to %d was not confirmed\n", item->id_receiver);
+    pending_pop(window);
+  }
+
+  if (ok) {
+    pending_t* item = &window->items[window->head];
+    char time_str[TIME_STR_SIZE];
+    set_time_str(time_str);
+    printf("P %s -> %d: %s\n", time_str, item->id_receiver, item->message);
+  }
+  pending_pop(window);
 }
 
 // Imprime os usuários presentes na lista "user_list", mas ignora o ID "my_id".
 // Precisa ser feito em exclusão mútua, para evitar condições de corrida no
 // acesso à variável "user_list"
-void list_users(const int* user_list, int my_id) {
-  for (int i = 0; i < MAX_CLIENTS; i++) {
-    if (user_list[i] != 0 && i != my_id) {
-      printf("%d ", i);
+void list_users(const user_list_t* user_list, int my_id) {
+  for (size_t i = 0; i < user_list->size; i++) {
+    if (user_list->present[i] != 0 && (int)i != my_id) {
+      printf("%zu ", i);
     }
   }
   printf("\n");
 }
 
+// Trava que serializa os envios no socket, já que tanto a thread de envio
+// quanto a de recebimento (ao devolver créditos) e as threads de transferência
+// enviam mensagens, e os bytes de dois quadros não podem se misturar.
+pthread_mutex_t send_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Codifica a mensagem "msg" no formato em uso e a envia no socket "socket". A
+// mensagem é uma visão do conteúdo, que não é copiado para um "msg_t". No
+// formato binário, as mensagens longas são compactadas.
+void send_message(int socket, const msg_view_t* msg, int binary) {
+  char buffer[BUFFER_SIZE];
+  int len = binary ? encode_lz(msg, buffer) : encode_view(msg, buffer);
+
+  pthread_mutex_lock(&send_mutex);
+  int ret = send_frame(socket, buffer, len);
+  pthread_mutex_unlock(&send_mutex);
+  if (ret != 0) {
+    log_exit("send");
+  }
+}
+
+// Obtém o próximo quadro do leitor "reader", lendo do socket "socket" somente
+// quando não há um quadro completo no buffer. O quadro é copiado para "buffer",
+// terminado por caractere nulo, e é descompactado caso esteja compactado.
+// Retorna o tamanho do quadro.
+size_t next_frame(frame_reader_t* reader, int socket, char* buffer) {
+  char* frame;
+  size_t len;
+  int ret;
+  while ((ret = frame_reader_next(reader, &frame, &len)) == 0) {
+    if (frame_reader_fill(reader, socket, 0) <= 0) {
+      log_exit("recv");
+    }
+  }
+
+  if (ret < 0) {
+    parse_error();
+  }
+
+  if (is_binary_msg(frame, len) && is_compressed_msg(frame, len)) {
+    if (lz_inflate_msg(frame, len, buffer, &len) == 0) {
+      parse_error();
+    }
+  } else {
+    memcpy(buffer, frame, len);
+  }
+
+  buffer[len] = '\0';
+  return len;
+}
+
+// Recebe uma mensagem no socket "socket", por meio do leitor "reader", e a
+// decodifica no formato em uso sem copiar o seu conteúdo, que permanece em
+// "buffer". O conteúdo é sempre seguido por um caractere nulo, mas pode conter
+// outros caracteres nulos no caso de um trecho de stream.
+void recv_view(frame_reader_t* reader, int socket, char* buffer, msg_view_t* msg, int binary) {
+  size_t len = next_frame(reader, socket, buffer);
+
+  int ret = binary ? decode_bin(msg, buffer, len) : decode_text(msg, buffer, len);
+  if (ret == 0) {
+    parse_error();
+  }
+}
+
 // Realiza o envio e recebimento de mensagens necessárias para a abertura de
 // conexão com o servidor. Ao final da função, o valor de "msg" será igual à
 // mensagem de resposta enviada pelo servidor, que pode ser do tipo ERROR ou MSG.
-void req_add(int socket, msg_t* msg) {
-  memset(msg->message, 0, BUFFER_SIZE);
+// O REQ_ADD é enviado no formato de texto e solicita o formato binário com
+// compactação e presença compacta. Retorna
+// 1 caso o servidor tenha respondido no formato binário e 0 caso contrário.
+int req_add(frame_reader_t* reader, int socket, msg_t* msg) {
   msg->id_msg = REQ_ADD;
   msg->id_sender = NULL_ID;
   msg->id_receiver = NULL_ID;
-  strcpy(msg->message, "REQ_ADD");
+  strcpy(msg->message, "REQ_ADD " CAP_BINARY " " CAP_LZ " " CAP_PRESENCE);
 
   char buffer[BUFFER_SIZE];
-  memset(buffer, 0, BUFFER_SIZE);
   encode(msg, buffer);
 
   // Envio do REQ_ADD
@@ -75,33 +358,39 @@ void req_add(int socket, msg_t* msg) {
     log_exit("send");
   }
 
-  // Recebimento da resposta
-  memset(buffer, 0, BUFFER_SIZE);
-  if (recv_msg(socket, buffer) <= 0) {
-    log_exit("recv");
-  }
+  // Recebimento da resposta. Um servidor que não suporta o formato binário
+  // responde no formato de texto, o que é identificado pelo primeiro byte
+  size_t len = next_frame(reader, socket, buffer);
 
-  if (decode(msg, buffer) == 0) {
+  int binary = is_binary_msg(buffer, len);
+  if (decode_msg(msg, buffer, len, binary) == 0) {
     parse_error();
   }
+
+  return binary;
 }
 
-// Realiza o recebimento de uma mensagem do tipo RES_LIST e faz a atualização do
-// array "user_list" de acordo com a resposta recebida.
-void res_list(int socket, int* user_list) {
+// Realiza o recebimento de uma mensagem do tipo RES_LIST, ou do primeiro trecho
+// do snapshot de presença caso o servidor tenha aceitado a presença compacta, e
+// faz a atualização da lista "user_list" de acordo com a resposta recebida.
+// Caso a lista de usuários não caiba em uma única mensagem, o servidor envia
+// mensagens adicionais, que são tratadas pela thread de recebimento.
+void res_list(frame_reader_t* reader, int socket, user_list_t* user_list, int binary) {
   char buffer[BUFFER_SIZE];
-  memset(buffer, 0, BUFFER_SIZE);
-  if (recv_msg(socket, buffer) <= 0) {
-    log_exit("recv");
-  }
-
-  msg_t msg;
-  if (decode(&msg, buffer) == 0) {
-    parse_error();
+  msg_view_t msg;
+  recv_view(reader, socket, buffer, &msg, binary);
+
+  // Atualiza a lista de usuários conhecidos. As threads ainda não foram
+  // criadas, então a lista é alterada sem a trava
+  if (msg.id_msg == PRESENCE) {
+    presence_args_t args = {.user_list = user_list, .mutex = NULL, .transfers = NULL};
+    int kind = presence_decode(msg.message, msg.len, apply_presence, &args);
+    if (kind != PRESENCE_LIST && kind != PRESENCE_BITMAP) {
+      parse_error();
+    }
+  } else {
+    set_user_list(user_list, (char*)msg.message);
   }
-
-  // Atualiza a lista de usuários conhecidos
-  set_user_list(user_list, msg.message);
 }
 
 // Função a ser executada pela thread responsável pela leitura de comandos na
@@ -112,26 +401,53 @@ void* handle_input(void* args) {
   // Lê continuamente da entrada padrão
   while (1) {
     char input[BUFFER_SIZE];
-    fgets(input, BUFFER_SIZE, stdin);
+    if (fgets(input, BUFFER_SIZE, stdin) == NULL) {
+      // O fim da entrada, por exemplo ao final de um script, encerra a conexão
+      strcpy(input, "close connection");
+    }
 
     // Remove \n do input lido pelo fgets
     input[strcspn(input, "\n")] = '\0';
 
     char* ptr;
-    if (strcmp(input, "close connection") == 0) {
-      // Fechamento da conexão com o servidor
+    if ((ptr = strstr(input, "send file to ")) != NULL) {
+      // Envio de arquivo, no formato: send file to <ID> "<caminho>"
+      ptr += strlen("send file to ");
 
-      msg_t msg = {.id_msg = REQ_REM, .id_sender = input_args->my_id, .id_receiver = NULL_ID};
-      memset(msg.message, 0, BUFFER_SIZE);
-      strcpy(msg.message, "REQ_REM");
+      char id_receiver[BUFFER_SIZE];
+      char path[BUFFER_SIZE];
+      id_receiver[0] = '\0';
+      path[0] = '\0';
+      sscanf(ptr, "%s \"%[^\"]\"", id_receiver, path);
+
+      if (path[0] == '\0')
+        continue;
 
-      char buffer[BUFFER_SIZE];
-      memset(buffer, 0, BUFFER_SIZE);
-      encode(&msg, buffer);
+      if (!is_number(id_receiver, strlen(id_receiver)) || strcmp(id_receiver, "-1") == 0) {
+        printf("Receiver not found\n");
+        continue;
+      }
+
+      // Os trechos do arquivo podem conter qualquer byte, o que só é possível
+      // no formato binário
+      if (!input_args->binary) {
+        printf("File transfer is not supported by the server\n");
+        continue;
+      }
 
-      if (send_msg(input_args->socket, buffer) != 0) {
-        log_exit("send");
+      if (transfer_start(input_args->transfers, atoi(id_receiver), path) != 0) {
+        printf("Could not open %s\n", path);
       }
+    } else if (strcmp(input, "close connection") == 0) {
+      // Fechamento da conexão com o servidor
+
+      msg_view_t msg = {.id_msg = REQ_REM,
+                        .id_sender = input_args->my_id,
+                        .id_receiver = NULL_ID,
+                        .message = "REQ_REM",
+                        .len = strlen("REQ_REM")};
+
+      send_message(input_args->socket, &msg, input_args->binary);
 
       // Finaliza o loop e a thread para de executar
       break;
@@ -139,6 +455,53 @@ void* handle_input(void* args) {
       pthread_mutex_lock(input_args->mutex);
       list_users(input_args->user_list, input_args->my_id);
       pthread_mutex_unlock(input_args->mutex);
+    } else if (strncmp(input, "join room ", strlen("join room ")) == 0 ||
+               strncmp(input, "leave room ", strlen("leave room ")) == 0) {
+      // Entrada ou saída de uma sala, no formato: join room <nome> ou
+      // leave room <nome>. A confirmação é impressa pela thread de recebimento.
+      // Os comandos de sala precisam estar no início da entrada, para que não
+      // sejam confundidos com o texto de uma mensagem
+      int join = input[0] == 'j';
+      ptr = input + (join ? strlen("join room ") : strlen("leave room "));
+
+      char name[BUFFER_SIZE];
+      name[0] = '\0';
+      sscanf(ptr, "%s", name);
+
+      if (name[0] == '\0')
+        continue;
+
+      msg_view_t msg = {.id_msg = join ? ROOM_JOIN : ROOM_LEAVE,
+                        .id_sender = input_args->my_id,
+                        .id_receiver = NULL_ID,
+                        .message = name,
+                        .len = strlen(name)};
+
+      send_message(input_args->socket, &msg, input_args->binary);
+    } else if (strncmp(input, "send room ", strlen("send room ")) == 0) {
+      // Mensagem para uma sala, no formato: send room <nome> "<mensagem>"
+      ptr = input + strlen("send room ");
+
+      char name[BUFFER_SIZE];
+      char message[BUFFER_SIZE];
+      name[0] = '\0';
+      message[0] = '\0';
+      sscanf(ptr, "%s \"%[^\"]\"", name, message);
+
+      if (message[0] == '\0')
+        continue;
+
+      // O conteúdo é o nome da sala seguido da mensagem
+      char content[2 * BUFFER_SIZE];
+      int len = snprintf(content, sizeof(content), "%s %s", name, message);
+
+      msg_view_t msg = {.id_msg = ROOM_MSG,
+                        .id_sender = input_args->my_id,
+                        .id_receiver = NULL_ID,
+                        .message = content,
+                        .len = len};
+
+      send_message(input_args->socket, &msg, input_args->binary);
     }
     // A função strstr encontra a primeira ocorrência de um padrão em uma
     // string. Caso o padrão "send to " for encontrado, então o resto da string
@@ -152,9 +515,9 @@ void* handle_input(void* args) {
 
       // Obtém o resto dos parâmetros da string de entrada
       char id_receiver[BUFFER_SIZE];
-      memset(id_receiver, 0, BUFFER_SIZE);
       char message[BUFFER_SIZE];
-      memset(message, 0, BUFFER_SIZE);
+      id_receiver[0] = '\0';
+      message[0] = '\0';
 
       // O ID do destinatário é a primeira string após "send to ", enquanto a
       // mensagem é o resto da string que está entre aspas
@@ -173,31 +536,23 @@ void* handle_input(void* args) {
         continue;
       }
 
-      msg_t msg = {
-          .id_msg = MSG, .id_sender = input_args->my_id, .id_receiver = atoi(id_receiver)};
-      memset(msg.message, 0, BUFFER_SIZE);
-      strcpy(msg.message, message);
-
-      char buffer[BUFFER_SIZE];
-      memset(buffer, 0, BUFFER_SIZE);
-      encode(&msg, buffer);
-
-      if (send_msg(input_args->socket, buffer) != 0) {
-        log_exit("send");
-      }
+      msg_view_t msg = {.id_msg = MSG,
+                        .id_sender = input_args->my_id,
+                        .id_receiver = atoi(id_receiver),
+                        .message = message,
+                        .len = strlen(message)};
 
-      // Após enviar a mensagem, é preciso aguardar a confirmação de OK ou ERROR,
-      // que será recebida na outra thread e notificada a partir da variável de
-      // condição "confirmation_arrived". Isso é necessário para saber se a
-      // mensagem deve ser impressa ou não
+      // A mensagem entra na janela antes do envio, para que a confirmação
+      // nunca chegue antes dela. A thread só aguarda caso a janela esteja
+      // cheia: a confirmação é tratada pela thread de recebimento, que imprime
+      // a mensagem caso ela tenha sido entregue
       pthread_mutex_lock(input_args->mutex);
-      pthread_cond_wait(input_args->confirmation_arrived, input_args->mutex);
-      if (*input_args->confirmed) {
-        char time_str[7];
-        set_time_str(time_str);
-        printf("P %s -> %d: %s\n", time_str, msg.id_receiver, msg.message);
-      }
+      msg.req_id =
+          pending_push(input_args->pending, input_args->mutex, msg.id_receiver, message);
       pthread_mutex_unlock(input_args->mutex);
+
+      // No formato de texto, o ID de requisição não é transmitido
+      send_message(input_args->socket, &msg, input_args->binary);
     }
     // Nesse caso, se o padrão "send all " for encontrado, então o resto da
     // string provavelmente é um comando para mensagem de broadcast
@@ -209,23 +564,19 @@ void* handle_input(void* args) {
         continue;
 
       char message[BUFFER_SIZE];
-      memset(message, 0, BUFFER_SIZE);
+      message[0] = '\0';
       sscanf(ptr, "\"%[^\"]\"", message);
 
       if (message[0] == '\0')
         continue;
 
-      msg_t msg = {.id_msg = MSG, .id_sender = input_args->my_id, .id_receiver = NULL_ID};
-      memset(msg.message, 0, BUFFER_SIZE);
-      strcpy(msg.message, message);
+      msg_view_t msg = {.id_msg = MSG,
+                        .id_sender = input_args->my_id,
+                        .id_receiver = NULL_ID,
+                        .message = message,
+                        .len = strlen(message)};
 
-      char buffer[BUFFER_SIZE];
-      memset(buffer, 0, BUFFER_SIZE);
-      encode(&msg, buffer);
-
-      if (send_msg(input_args->socket, buffer) != 0) {
-        log_exit("send");
-      }
+      send_message(input_args->socket, &msg, input_args->binary);
     } else {
       // Se o input passado não cai em nenhum dos casos anteriores, então é um
       // comando desconhecido
@@ -240,31 +591,79 @@ void* handle_input(void* args) {
 void* handle_recv(void* args) {
   user_thread_args* recv_args = (user_thread_args*)args;
 
+  // As mensagens são decodificadas sem cópia, com o conteúdo em "buffer"
   char buffer[BUFFER_SIZE];
-  msg_t msg;
+  msg_view_t msg;
   while (1) {
-    memset(buffer, 0, BUFFER_SIZE);
-    if (recv_msg(recv_args->socket, buffer) <= 0) {
-      log_exit("recv");
-    }
-
-    if (decode(&msg, buffer) == 0) {
-      parse_error();
-    }
+    recv_view(recv_args->reader, recv_args->socket, buffer, &msg, recv_args->binary);
 
     if (msg.id_msg == REQ_REM) {
       printf("User %d left the group!\n", msg.id_sender);
 
       // Marca o usuário remetente como inativo na lista de usuários
       pthread_mutex_lock(recv_args->mutex);
-      recv_args->user_list[msg.id_sender] = 0;
+      user_list_set(recv_args->user_list, msg.id_sender, 0);
       pthread_mutex_unlock(recv_args->mutex);
+
+      transfer_peer_left(recv_args->transfers, msg.id_sender);
+    } else if (msg.id_msg == PRESENCE) {
+      presence_args_t presence_args = {.user_list = recv_args->user_list,
+                                       .mutex = recv_args->mutex,
+                                       .transfers = recv_args->transfers};
+      if (presence_decode(msg.message, msg.len, apply_presence, &presence_args) < 0) {
+        parse_error();
+      }
+    } else if (msg.id_msg == RES_LIST) {
+      // Continuação da lista de usuários recebida ao entrar no grupo. O
+      // conteúdo está em "buffer" e pode ser alterado
+      pthread_mutex_lock(recv_args->mutex);
+      set_user_list(recv_args->user_list, (char*)msg.message);
+      pthread_mutex_unlock(recv_args->mutex);
+    } else if (msg.id_msg == HISTORY) {
+      // Mensagem pública enviada antes da entrada no grupo. O conteúdo já
+      // começa com o horário original, e o autor pode já ter saído do grupo,
+      // então ele não é marcado como ativo
+      int time_len = strcspn(msg.message, " ");
+      const char* text = msg.message[time_len] == ' ' ? msg.message + time_len + 1 : "";
+      printf("%.*s %d: %s\n", time_len, msg.message, msg.id_sender, text);
+    } else if (msg.id_msg == ROOM_JOIN || msg.id_msg == ROOM_LEAVE) {
+      const char* action = msg.id_msg == ROOM_JOIN ? "joined" : "left";
+      if (msg.id_sender == recv_args->my_id) {
+        printf("You %s room %s\n", action, msg.message);
+      } else {
+        printf("User %d %s room %s\n", msg.id_sender, action, msg.message);
+      }
+    } else if (msg.id_msg == ROOM_MSG) {
+      // O conteúdo é o nome da sala seguido da mensagem
+      int name_len = strcspn(msg.message, " ");
+      const char* text = msg.message[name_len] == ' ' ? msg.message + name_len + 1 : "";
+
+      char time_str[TIME_STR_SIZE];
+      set_time_str(time_str);
+
+      if (msg.id_sender == recv_args->my_id) {
+        printf("%s -> #%.*s %s\n", time_str, name_len, msg.message, text);
+      } else {
+        printf("%s #%.*s %d: %s\n", time_str, name_len, msg.message, msg.id_sender, text);
+      }
+    } else if (msg.id_msg == HEARTBEAT) {
+      // Responde ao servidor, indicando que o cliente continua ativo
+      msg_view_t reply = {.id_msg = HEARTBEAT,
+                          .id_sender = recv_args->my_id,
+                          .id_receiver = NULL_ID,
+                          .message = "HEARTBEAT",
+                          .len = strlen("HEARTBEAT")};
+      send_message(recv_args->socket, &reply, recv_args->binary);
+    } else if (msg.id_msg == STREAM) {
+      transfer_handle_stream(recv_args->transfers, &msg);
+    } else if (msg.id_msg == CREDIT) {
+      transfer_handle_credit(recv_args->transfers, &msg);
     } else if (msg.id_msg == MSG) {
-      if (recv_args->user_list[msg.id_sender] == 1) {
+      if (user_list_get(recv_args->user_list, msg.id_sender) == 1) {
         // Se o usuário já está marcado como ativo, ou seja, se já foi recebida
         // uma mensagem dele antes, então a mensagem é impressa com o timestamp
 
-        char time_str[7];
+        char time_str[TIME_STR_SIZE];
         set_time_str(time_str);
 
         // Imprime "P" se não for uma mensagem de broadcast
@@ -286,7 +685,7 @@ void* handle_recv(void* args) {
 
         // Marca o usuário remetente como ativo na lista de usuários
         pthread_mutex_lock(recv_args->mutex);
-        recv_args->user_list[msg.id_sender] = 1;
+        user_list_set(recv_args->user_list, msg.id_sender, 1);
         pthread_mutex_unlock(recv_args->mutex);
       }
     } else if (msg.id_msg == OK) {
@@ -299,24 +698,26 @@ void* handle_recv(void* args) {
       } else {
         // Caso o conteúdo da mensagem seja diferente de "Removed Successfully",
         // então essa é uma mensagem de confirmação para uma mensagem privada
-        // que foi enviada anteriormente. Nesse caso, é preciso atualizar
-        // "confirmed" para 1 e notificar a outra thread
+        // que foi enviada anteriormente
         pthread_mutex_lock(recv_args->mutex);
-        *recv_args->confirmed = 1;
-        pthread_cond_signal(recv_args->confirmation_arrived);
+        pending_resolve(recv_args->pending, msg.req_id, 1);
         pthread_mutex_unlock(recv_args->mutex);
       }
     } else if (msg.id_msg == ERROR) {
       printf("%s\n", msg.message);
 
-      if (strcmp(msg.message, "Receiver not found") == 0) {
-        // Se a mensagem recebida indica um erro para uma mensagem privada que
-        // foi enviada anteriormente, é preciso notificar a outra thread, e
-        // atualizar o valor de "confirmed" para 0
-
+      // Se a mensagem recebida indica um erro para uma mensagem privada que foi
+      // enviada anteriormente, ela é removida da janela sem ser impressa. No
+      // formato binário, uma mensagem recusada pelo limite de taxa só é
+      // associada à janela pelo ID de requisição, já que mensagens públicas
+      // também podem ser recusadas. No formato de texto não há ID, e a recusa é
+      // associada à mensagem mais antiga, pois o servidor responde na ordem
+      // de envio
+      if (strcmp(msg.message, "Receiver not found") == 0 ||
+          (strcmp(msg.message, "Rate limit exceeded") == 0 &&
+           (msg.req_id != 0 || !recv_args->binary))) {
         pthread_mutex_lock(recv_args->mutex);
-        *recv_args->confirmed = 0;
-        pthread_cond_signal(recv_args->confirmation_arrived);
+        pending_resolve(recv_args->pending, msg.req_id, 0);
         pthread_mutex_unlock(recv_args->mutex);
       }
     }
@@ -327,17 +728,30 @@ void* handle_recv(void* args) {
 
 // Retirado das aulas do professor Ítalo.
 void usage(const char* bin) {
-  eprintf("Usage: %s <server IP address> <server port>\n", bin);
+  eprintf("Usage: %s <server IP address> <server port> | <server UNIX socket path>\n", bin);
   eprintf("Example IPv4: %s 127.0.0.1 51511\n", bin);
   eprintf("Example IPv6: %s ::1 51511\n", bin);
+  eprintf("Example UNIX: %s /tmp/chat.sock\n", bin);
   exit(EXIT_FAILURE);
 }
 
 // Faz o parse do endereço passado como argumento e inicializa um struct do tipo
-// sockaddr_storage de acordo com o protocolo adequado. Retorna 0 quando há
+// sockaddr_storage de acordo com o protocolo adequado. Um endereço que contém
+// "/" é o caminho de um socket UNIX, e dispensa a porta. Retorna 0 quando há
 // sucesso e -1 caso contrário. Retirado das aulas do professor Ítalo.
 int parse_address(const char* addr_str, const char* port_str,
                   struct sockaddr_storage* storage) {
+  if (addr_str != NULL && strchr(addr_str, '/') != NULL) {
+    struct sockaddr_un* addr_un = (struct sockaddr_un*)storage;
+    if (port_str != NULL || strlen(addr_str) >= sizeof(addr_un->sun_path)) {
+      return -1;
+    }
+    memset(storage, 0, sizeof(*storage));
+    addr_un->sun_family = AF_UNIX;
+    strcpy(addr_un->sun_path, addr_str);
+    return 0;
+  }
+
   if (addr_str == NULL || port_str == NULL) {
     return -1;
   }
@@ -370,7 +784,7 @@ int parse_address(const char* addr_str, const char* port_str,
 }
 
 int main(int argc, const char* argv[]) {
-  if (argc < 3)
+  if (argc < 2 || argc > 3)
     usage(argv[0]);
 
   // Faz o parse do endereço recebido como parâmetro
@@ -378,6 +792,8 @@ int main(int argc, const char* argv[]) {
   if (parse_address(argv[1], argv[2], &storage) != 0) {
     usage(argv[0]);
   }
+  socklen_t addrlen =
+      storage.ss_family == AF_UNIX ? sizeof(struct sockaddr_un) : sizeof(storage);
 
   // Cria um novo socket no endereço
   int sock;
@@ -388,16 +804,20 @@ int main(int argc, const char* argv[]) {
 
   // Abre uma nova conexão no socket criado
   struct sockaddr* addr = (struct sockaddr*)(&storage);
-  if (connect(sock, addr, sizeof(storage)) != 0) {
+  if (connect(sock, addr, addrlen) != 0) {
     // A conexão pode falhar caso o servidor não esteja ouvindo
     log_exit("connect");
   }
 
   int my_id;
-  int user_list[MAX_CLIENTS] = {0};
+  user_list_t user_list = {.present = NULL, .size = 0, .snapshot = 0, .versions = NULL};
 
   msg_t msg;
-  req_add(sock, &msg);
+  // Leitor de quadros usado por todas as leituras do socket
+  static frame_reader_t reader;
+  frame_reader_init(&reader);
+
+  int binary = req_add(&reader, sock, &msg);
 
   // Trata a resposta para a requisição de conexão com o servidor
   printf("%s\n", msg.message);
@@ -409,23 +829,26 @@ int main(int argc, const char* argv[]) {
   }
 
   // Recebe a mensagem do tipo RES_LIST
-  res_list(sock, user_list);
+  res_list(&reader, sock, &user_list, binary);
 
   pthread_mutex_t mutex;
   pthread_mutex_init(&mutex, NULL);
-  pthread_cond_t confirmation_arrived;
-  pthread_cond_init(&confirmation_arrived, NULL);
+  static pending_window_t pending = {.head = 0, .count = 0, .next_id = 1};
+  pthread_cond_init(&pending.space, NULL);
 
-  int confirmed;
+  static transfers_t transfers;
+  transfers_init(&transfers, sock, my_id, &send_mutex);
 
   // Variáveis para a thread que faz leitura da entrada padrão e o envio de
   // mensagens
   pthread_t input_thread;
   user_thread_args input_args = {.socket = sock,
                                  .my_id = my_id,
-                                 .user_list = user_list,
-                                 .confirmed = &confirmed,
-                                 .confirmation_arrived = &confirmation_arrived,
+                                 .user_list = &user_list,
+                                 .pending = &pending,
+                                 .transfers = &transfers,
+                                 .binary = binary,
+                                 .reader = &reader,
                                  .mutex = &mutex};
 
   // Variáveis para a thread que faz o recebimento das mensagens enviadas pelo
@@ -442,7 +865,9 @@ int main(int argc, const char* argv[]) {
   pthread_join(recv_thread, NULL);
 
   pthread_mutex_destroy(&mutex);
-  pthread_cond_destroy(&confirmation_arrived);
+  pthread_cond_destroy(&pending.space);
+  free(user_list.present);
+  free(user_list.versions);
   close(sock);
 
   exit(EXIT_SUCCESS);
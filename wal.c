@@ -0,0 +1,393 @@
+#include "wal.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Tabela do CRC-32 (polinômio 0xEDB88320), gerada na primeira utilização.
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init() {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int j = 0; j < 8; j++) {
+      crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+    crc_table[i] = crc;
+  }
+}
+
+static uint32_t crc32(const char* data, size_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc = crc_table[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFF;
+}
+
+// Monta em "path" o caminho do segmento "segment" do diretório "dir".
+static void segment_path(char* path, size_t size, const char* dir, uint64_t segment) {
+  snprintf(path, size, "%s/wal-%016" PRIu64 ".log", dir, segment);
+}
+
+static int segment_cmp(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+// Retorna em ordem crescente os números dos segmentos do diretório "dir",
+// armazenando sua quantidade em "count". O array deve ser liberado com "free".
+static uint64_t* list_segments(const char* dir, size_t* count) {
+  *count = 0;
+  DIR* d = opendir(dir);
+  if (d == NULL) {
+    return NULL;
+  }
+
+  uint64_t* segments = NULL;
+  size_t capacity = 0;
+  struct dirent* entry;
+  while ((entry = readdir(d)) != NULL) {
+    uint64_t segment;
+    char suffix[8];
+    if (sscanf(entry->d_name, "wal-%" SCNu64 ".%7s", &segment, suffix) != 2 ||
+        strcmp(suffix, "log") != 0) {
+      continue;
+    }
+
+    if (*count == capacity) {
+      capacity = capacity == 0 ? 16 : capacity * 2;
+      segments = (uint64_t*)realloc(segments, capacity * sizeof(uint64_t));
+      if (segments == NULL) {
+        log_exit("realloc");
+      }
+    }
+    segments[(*count)++] = segment;
+  }
+  closedir(d);
+
+  qsort(segments, *count, sizeof(uint64_t), segment_cmp);
+  return segments;
+}
+
+// Valida o registro na posição "offset" do segmento mapeado "data", de tamanho
+// "size", decodificando a mensagem em "msg". Retorna o tamanho do registro ou
+// 0 caso ele esteja incompleto ou corrompido.
+static size_t record_parse(const char* data, size_t size, size_t offset, msg_view_t* msg,
+                           uint64_t* ts) {
+  if (size - offset < WAL_RECORD_HDR_SIZE) {
+    return 0;
+  }
+
+  uint32_t len, crc;
+  memcpy(&len, data + offset, sizeof(uint32_t));
+  memcpy(&crc, data + offset + 4, sizeof(uint32_t));
+  if (len < WIRE_HDR_SIZE || len >= BUFFER_SIZE ||
+      size - offset - WAL_RECORD_HDR_SIZE < len) {
+    return 0;
+  }
+
+  if (crc32(data + offset + 8, sizeof(uint64_t) + len) != crc ||
+      decode_bin(msg, data + offset + WAL_RECORD_HDR_SIZE, len) == 0) {
+    return 0;
+  }
+
+  memcpy(ts, data + offset + 8, sizeof(uint64_t));
+  return WAL_RECORD_HDR_SIZE + len;
+}
+
+// Entrega a "fn" os registros do segmento "path", do mais recente para o mais
+// antigo. Retorna 0 caso a recuperação deva ser encerrada.
+static int segment_replay(const char* path, wal_replay_fn fn, void* arg, size_t* count) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size <= WAL_MAGIC_SIZE) {
+    close(fd);
+    return 1;
+  }
+
+  size_t size = st.st_size;
+  char* data = (char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return 1;
+  }
+  if (memcmp(data, WAL_MAGIC, WAL_MAGIC_SIZE) != 0) {
+    munmap(data, size);
+    return 1;
+  }
+  madvise(data, size, MADV_SEQUENTIAL);
+
+  // Os registros só podem ser percorridos do início para o fim, então as
+  // posições dos registros válidos são armazenadas antes da entrega
+  size_t* offsets = NULL;
+  size_t num = 0, capacity = 0;
+  size_t offset = WAL_MAGIC_SIZE;
+  for (;;) {
+    msg_view_t msg;
+    uint64_t ts;
+    size_t len = record_parse(data, size, offset, &msg, &ts);
+    if (len == 0) {
+      break;
+    }
+
+    if (num == capacity) {
+      capacity = capacity == 0 ? 1024 : capacity * 2;
+      offsets = (size_t*)realloc(offsets, capacity * sizeof(size_t));
+      if (offsets == NULL) {
+        log_exit("realloc");
+      }
+    }
+    offsets[num++] = offset;
+    offset += len;
+  }
+
+  int proceed = 1;
+  while (proceed && num > 0) {
+    msg_view_t msg;
+    uint64_t ts;
+    record_parse(data, size, offsets[--num], &msg, &ts);
+    (*count)++;
+    proceed = fn(&msg, (time_t)(ts / 1000000000), arg);
+  }
+
+  free(offsets);
+  munmap(data, size);
+  return proceed;
+}
+
+size_t wal_recover(const char* dir, wal_replay_fn fn, void* arg) {
+  pthread_once(&crc_once, crc_init);
+
+  size_t num_segments;
+  uint64_t* segments = list_segments(dir, &num_segments);
+
+  size_t count = 0;
+  for (size_t i = num_segments; i > 0; i--) {
+    char path[512];
+    segment_path(path, sizeof(path), dir, segments[i - 1]);
+    if (segment_replay(path, fn, arg, &count) == 0) {
+      break;
+    }
+  }
+
+  free(segments);
+  return count;
+}
+
+// Cria o segmento "wal->segment" e apaga os segmentos mais antigos do que os
+// WAL_KEEP_SEGMENTS mais recentes.
+static void segment_open(wal_t* wal) {
+  char path[512];
+  segment_path(path, sizeof(path), wal->dir, wal->segment);
+  wal->fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644);
+  if (wal->fd < 0) {
+    log_exit("open");
+  }
+  if (write(wal->fd, WAL_MAGIC, WAL_MAGIC_SIZE) != WAL_MAGIC_SIZE) {
+    log_exit("write");
+  }
+  wal->segment_bytes = WAL_MAGIC_SIZE;
+
+  size_t num_segments;
+  uint64_t* segments = list_segments(wal->dir, &num_segments);
+  for (size_t i = 0; i + WAL_KEEP_SEGMENTS < num_segments; i++) {
+    segment_path(path, sizeof(path), wal->dir, segments[i]);
+    unlink(path);
+  }
+  free(segments);
+
+  // A entrada do novo segmento no diretório também precisa ser durável
+  int dir_fd = open(wal->dir, O_RDONLY | O_DIRECTORY);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+}
+
+// Escreve e sincroniza o lote "buf", de tamanho "len", iniciando um novo
+// segmento caso o atual tenha atingido WAL_SEGMENT_SIZE. Os lotes só contêm
+// registros completos, então nenhum registro é dividido entre segmentos.
+static void wal_commit(wal_t* wal, const char* buf, size_t len) {
+  if (wal->segment_bytes >= WAL_SEGMENT_SIZE) {
+    close(wal->fd);
+    wal->segment++;
+    segment_open(wal);
+  }
+
+  size_t written = 0;
+  while (written < len) {
+    ssize_t n = write(wal->fd, buf + written, len - written);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      log_exit("write");
+    }
+    written += n;
+  }
+  wal->segment_bytes += len;
+
+  if (fdatasync(wal->fd) < 0) {
+    log_exit("fdatasync");
+  }
+}
+
+// Thread de escrita. Aguarda o primeiro registro de um lote e, a partir dele,
+// até "commit_ms" milissegundos ou até que o lote atinja "commit_bytes" bytes.
+// O lote é trocado pelo buffer vazio da thread, de modo que os reatores
+// continuam inserindo registros enquanto o lote anterior é escrito.
+static void* wal_writer(void* arg) {
+  wal_t* wal = (wal_t*)arg;
+  char* batch = (char*)malloc(WAL_MAX_PENDING);
+  if (batch == NULL) {
+    log_exit("malloc");
+  }
+
+  pthread_mutex_lock(&wal->lock);
+  for (;;) {
+    while (wal->pending_len == 0 && !wal->closing) {
+      pthread_cond_wait(&wal->wakeup, &wal->lock);
+    }
+    if (wal->pending_len == 0) {
+      break;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    uint64_t nsec = deadline.tv_nsec + wal->commit_ms * 1000000;
+    deadline.tv_sec += nsec / 1000000000;
+    deadline.tv_nsec = nsec % 1000000000;
+    while (wal->pending_len < wal->commit_bytes && !wal->closing) {
+      if (pthread_cond_timedwait(&wal->wakeup, &wal->lock, &deadline) == ETIMEDOUT) {
+        break;
+      }
+    }
+
+    char* full = wal->pending;
+    size_t len = wal->pending_len;
+    wal->pending = batch;
+    wal->pending_len = 0;
+    batch = full;
+    pthread_cond_broadcast(&wal->space);
+    pthread_mutex_unlock(&wal->lock);
+
+    wal_commit(wal, batch, len);
+
+    pthread_mutex_lock(&wal->lock);
+  }
+  pthread_mutex_unlock(&wal->lock);
+
+  free(batch);
+  return NULL;
+}
+
+int wal_open(wal_t* wal, const char* dir, uint64_t commit_ms, size_t commit_bytes) {
+  pthread_once(&crc_once, crc_init);
+
+  if (strlen(dir) >= sizeof(wal->dir) || (mkdir(dir, 0755) < 0 && errno != EEXIST)) {
+    return -1;
+  }
+  strcpy(wal->dir, dir);
+
+  size_t num_segments;
+  uint64_t* segments = list_segments(dir, &num_segments);
+  wal->segment = num_segments > 0 ? segments[num_segments - 1] + 1 : 0;
+  free(segments);
+
+  // Um último segmento sem registros é substituído, para que reinícios sem
+  // mensagens não descartem os segmentos mais antigos
+  if (wal->segment > 0) {
+    char path[512];
+    struct stat st;
+    segment_path(path, sizeof(path), dir, wal->segment - 1);
+    if (stat(path, &st) == 0 && st.st_size <= WAL_MAGIC_SIZE) {
+      unlink(path);
+      wal->segment--;
+    }
+  }
+  segment_open(wal);
+
+  wal->commit_ms = commit_ms;
+  wal->commit_bytes = commit_bytes < WAL_MAX_PENDING ? commit_bytes : WAL_MAX_PENDING;
+  wal->closing = 0;
+  wal->pending_len = 0;
+  wal->pending = (char*)malloc(WAL_MAX_PENDING);
+  if (wal->pending == NULL) {
+    log_exit("malloc");
+  }
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_mutex_init(&wal->lock, NULL);
+  pthread_cond_init(&wal->wakeup, &attr);
+  pthread_cond_init(&wal->space, NULL);
+  pthread_condattr_destroy(&attr);
+
+  pthread_create(&wal->writer, NULL, wal_writer, wal);
+  return 0;
+}
+
+void wal_append(wal_t* wal, const msg_view_t* msg) {
+  // O registro é montado fora da trava. O ID de requisição só tem significado
+  // para a conexão de origem e não é armazenado
+  char record[WAL_RECORD_HDR_SIZE + BUFFER_SIZE];
+  msg_view_t view = *msg;
+  view.req_id = 0;
+  uint32_t len = encode_bin(&view, record + WAL_RECORD_HDR_SIZE);
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint64_t ts = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+  memcpy(record + 8, &ts, sizeof(uint64_t));
+
+  uint32_t crc = crc32(record + 8, sizeof(uint64_t) + len);
+  memcpy(record, &len, sizeof(uint32_t));
+  memcpy(record + 4, &crc, sizeof(uint32_t));
+  size_t size = WAL_RECORD_HDR_SIZE + len;
+
+  pthread_mutex_lock(&wal->lock);
+
+  while (wal->pending_len + size > WAL_MAX_PENDING) {
+    pthread_cond_wait(&wal->space, &wal->lock);
+  }
+
+  memcpy(wal->pending + wal->pending_len, record, size);
+  size_t prev = wal->pending_len;
+  wal->pending_len += size;
+
+  // A thread de escrita é acordada no início de cada lote, para que comece a
+  // contar o prazo, e quando o lote atinge o tamanho de commit
+  if (prev == 0 || (prev < wal->commit_bytes && wal->pending_len >= wal->commit_bytes)) {
+    pthread_cond_signal(&wal->wakeup);
+  }
+
+  pthread_mutex_unlock(&wal->lock);
+}
+
+void wal_close(wal_t* wal) {
+  pthread_mutex_lock(&wal->lock);
+  wal->closing = 1;
+  pthread_cond_signal(&wal->wakeup);
+  pthread_mutex_unlock(&wal->lock);
+
+  pthread_join(wal->writer, NULL);
+
+  close(wal->fd);
+  free(wal->pending);
+  pthread_cond_destroy(&wal->space);
+  pthread_cond_destroy(&wal->wakeup);
+  pthread_mutex_destroy(&wal->lock);
+}
@@ -0,0 +1,93 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include "common.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Log de escrita antecipada (WAL) das mensagens repassadas pelo servidor. O log
+// é dividido em arquivos de segmento "wal-<número>.log" em um diretório. Cada
+// segmento começa com WAL_MAGIC e é seguido por registros com o tamanho da
+// mensagem (32 bits), o CRC-32 do instante e da mensagem (32 bits), o instante
+// em que a mensagem foi repassada (64 bits, em nanossegundos desde a época
+// Unix) e a mensagem no formato binário, todos os inteiros na ordem de bytes
+// do host. Um registro incompleto ou corrompido encerra a leitura do segmento.
+#define WAL_MAGIC "CHATWAL1"
+#define WAL_MAGIC_SIZE 8
+#define WAL_RECORD_HDR_SIZE 16
+
+// Tamanho a partir do qual um novo segmento é iniciado e número de segmentos
+// mantidos no diretório. Os segmentos mais antigos são apagados.
+#define WAL_SEGMENT_SIZE (16 * 1024 * 1024)
+#define WAL_KEEP_SEGMENTS 8
+
+// Política padrão de group commit: os registros acumulados são escritos e
+// sincronizados com o disco a cada WAL_DEFAULT_COMMIT_MS milissegundos ou
+// quando acumulam WAL_DEFAULT_COMMIT_BYTES bytes, o que ocorrer primeiro.
+#define WAL_DEFAULT_COMMIT_MS 10
+#define WAL_DEFAULT_COMMIT_BYTES (64 * 1024)
+
+// Limite de bytes aguardando escrita. Caso o disco não acompanhe as mensagens,
+// as threads que inserem registros aguardam até que haja espaço.
+#define WAL_MAX_PENDING (8 * 1024 * 1024)
+
+// Log aberto para escrita. As threads dos reatores apenas copiam os registros
+// para um buffer em memória, e uma thread própria escreve e sincroniza o
+// buffer, de modo que a sincronização com o disco nunca bloqueia o repasse das
+// mensagens e é compartilhada por todos os registros de um lote.
+typedef struct wal_t {
+  // Diretório dos segmentos, segmento atual e seu tamanho.
+  char dir[256];
+  uint64_t segment;
+  int fd;
+  size_t segment_bytes;
+
+  // Política de group commit.
+  uint64_t commit_ms;
+  size_t commit_bytes;
+
+  // Trava e variáveis de condição que protegem o buffer de registros
+  // pendentes: "wakeup" acorda a thread de escrita e "space" as threads que
+  // aguardam espaço no buffer.
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  pthread_cond_t space;
+
+  // Registros pendentes, ainda não entregues à thread de escrita.
+  char* pending;
+  size_t pending_len;
+
+  // Indica que o log está sendo fechado.
+  int closing;
+
+  pthread_t writer;
+} wal_t;
+
+// Função chamada para cada registro recuperado do log, com a mensagem "msg" e
+// o instante "time" em que ela foi repassada. O conteúdo da mensagem só é
+// válido durante a chamada. Retorna 0 para encerrar a recuperação.
+typedef int (*wal_replay_fn)(const msg_view_t* msg, time_t time, void* arg);
+
+// Lê os registros dos segmentos do diretório "dir", do mais recente para o
+// mais antigo, chamando "fn" para cada um. Os segmentos são mapeados em
+// memória e os registros são decodificados sem cópia. Retorna o número de
+// registros lidos.
+size_t wal_recover(const char* dir, wal_replay_fn fn, void* arg);
+
+// Abre o log no diretório "dir", que é criado caso não exista, iniciando um
+// novo segmento após os existentes, e inicia a thread de escrita com a
+// política de group commit "commit_ms" e "commit_bytes". Retorna 0 em caso de
+// sucesso e -1 caso contrário.
+int wal_open(wal_t* wal, const char* dir, uint64_t commit_ms, size_t commit_bytes);
+
+// Insere no log a mensagem "msg", repassada no instante atual. A mensagem se
+// torna durável no próximo group commit.
+void wal_append(wal_t* wal, const msg_view_t* msg);
+
+// Escreve e sincroniza os registros pendentes, encerra a thread de escrita e
+// fecha o segmento atual.
+void wal_close(wal_t* wal);
+
+#endif
@@ -0,0 +1,118 @@
+#include "wheel.h"
+#include <string.h>
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+// Maior distância, em ticks, entre o tick atual e um prazo.
+#define WHEEL_MAX_DELTA ((1ULL << (WHEEL_LEVELS * WHEEL_BITS)) - 1)
+
+void wheel_init(wheel_t* wheel, uint64_t now) {
+  memset(wheel->slots, 0, sizeof(wheel->slots));
+  wheel->now = now;
+  wheel->count = 0;
+}
+
+void wheel_timer_init(wheel_timer_t* timer) {
+  timer->next = NULL;
+  timer->pprev = NULL;
+  timer->expires = 0;
+}
+
+// Insere o temporizador na posição correspondente ao seu prazo: no primeiro
+// nível cujas posições cobrem a distância até o prazo.
+static void wheel_insert(wheel_t* wheel, wheel_timer_t* timer) {
+  uint64_t delta = timer->expires - wheel->now;
+
+  int level = 0;
+  while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << ((level + 1) * WHEEL_BITS))) {
+    level++;
+  }
+
+  wheel_timer_t** slot =
+      &wheel->slots[level][(timer->expires >> (level * WHEEL_BITS)) & WHEEL_MASK];
+  timer->next = *slot;
+  if (*slot != NULL) {
+    (*slot)->pprev = &timer->next;
+  }
+  timer->pprev = slot;
+  *slot = timer;
+}
+
+void wheel_add(wheel_t* wheel, wheel_timer_t* timer, uint64_t expires) {
+  if (expires <= wheel->now) {
+    expires = wheel->now + 1;
+  } else if (expires - wheel->now > WHEEL_MAX_DELTA) {
+    expires = wheel->now + WHEEL_MAX_DELTA;
+  }
+
+  timer->expires = expires;
+  wheel_insert(wheel, timer);
+  wheel->count++;
+}
+
+// Retira o temporizador da lista em que está.
+static void unlink_timer(wheel_timer_t* timer) {
+  *timer->pprev = timer->next;
+  if (timer->next != NULL) {
+    timer->next->pprev = timer->pprev;
+  }
+  timer->next = NULL;
+  timer->pprev = NULL;
+}
+
+void wheel_remove(wheel_t* wheel, wheel_timer_t* timer) {
+  if (timer->pprev != NULL) {
+    unlink_timer(timer);
+    wheel->count--;
+  }
+}
+
+// Redistribui nos níveis inferiores os temporizadores da posição atual do nível
+// "level". Retorna o índice da posição.
+static size_t cascade(wheel_t* wheel, int level) {
+  size_t index = (wheel->now >> (level * WHEEL_BITS)) & WHEEL_MASK;
+
+  wheel_timer_t* timer = wheel->slots[level][index];
+  wheel->slots[level][index] = NULL;
+  while (timer != NULL) {
+    wheel_timer_t* next = timer->next;
+    wheel_insert(wheel, timer);
+    timer = next;
+  }
+
+  return index;
+}
+
+size_t wheel_advance(wheel_t* wheel, uint64_t now, wheel_fn fn, void* arg) {
+  size_t expired = 0;
+
+  while (wheel->now < now) {
+    wheel->now++;
+
+    // Quando um nível completa uma volta, a posição seguinte do nível superior
+    // é redistribuída, antes que a posição atual do primeiro nível seja
+    // processada
+    size_t index = wheel->now & WHEEL_MASK;
+    for (int level = 1; index == 0 && level < WHEEL_LEVELS; level++) {
+      index = cascade(wheel, level);
+    }
+
+    // A posição é esvaziada antes das chamadas, já que cada temporizador pode
+    // ser inserido novamente na roda
+    wheel_timer_t** slot = &wheel->slots[0][wheel->now & WHEEL_MASK];
+    while (*slot != NULL) {
+      wheel_timer_t* timer = *slot;
+      unlink_timer(timer);
+      wheel->count--;
+      expired++;
+      fn(timer, arg);
+    }
+
+    // Sem temporizadores, os ticks restantes não precisam ser percorridos
+    if (wheel->count == 0) {
+      wheel->now = now;
+    }
+  }
+
+  return expired;
+}
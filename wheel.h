@@ -0,0 +1,62 @@
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Roda de temporizadores hierárquica. Cada nível possui WHEEL_SLOTS posições,
+// e cada posição de um nível cobre WHEEL_SLOTS posições do nível anterior. Um
+// temporizador é inserido no nível que cobre o seu prazo, e é movido para os
+// níveis inferiores à medida que o prazo se aproxima, de modo que a inserção e
+// a remoção são O(1) e cada avanço só processa os temporizadores das posições
+// alcançadas, independentemente do número de temporizadores. Com 4 níveis de
+// 64 posições, os prazos podem chegar a 2^24 ticks.
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+// Temporizador, inserido como campo da estrutura que o utiliza.
+typedef struct wheel_timer_t {
+  // Lista duplamente encadeada da posição em que o temporizador está. "pprev"
+  // aponta para o ponteiro que aponta para o temporizador, ou é NULL caso o
+  // temporizador não esteja na roda.
+  struct wheel_timer_t* next;
+  struct wheel_timer_t** pprev;
+
+  // Tick em que o temporizador expira.
+  uint64_t expires;
+} wheel_timer_t;
+
+// Roda de temporizadores, acessada por uma única thread.
+typedef struct wheel_t {
+  // Último tick processado.
+  uint64_t now;
+
+  // Número de temporizadores na roda.
+  size_t count;
+
+  wheel_timer_t* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+} wheel_t;
+
+// Função chamada para cada temporizador expirado, que já foi retirado da roda
+// e pode ser inserido novamente.
+typedef void (*wheel_fn)(wheel_timer_t* timer, void* arg);
+
+// Inicializa uma roda vazia no tick "now".
+void wheel_init(wheel_t* wheel, uint64_t now);
+
+// Inicializa um temporizador fora da roda.
+void wheel_timer_init(wheel_timer_t* timer);
+
+// Insere na roda o temporizador "timer", que não pode estar nela, com prazo no
+// tick "expires". Prazos já alcançados expiram no próximo tick.
+void wheel_add(wheel_t* wheel, wheel_timer_t* timer, uint64_t expires);
+
+// Remove o temporizador "timer" da roda, caso ele esteja nela.
+void wheel_remove(wheel_t* wheel, wheel_timer_t* timer);
+
+// Avança a roda até o tick "now", chamando "fn" para cada temporizador
+// expirado. Retorna o número de temporizadores expirados.
+size_t wheel_advance(wheel_t* wheel, uint64_t now, wheel_fn fn, void* arg);
+
+#endif